@@ -0,0 +1,344 @@
+#include "central2d_pnode.h"
+#include "shallow2d.h"
+#include "minmod.h"
+#include "initial_conditions.h"
+
+#include <omp.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+
+//ldoc on
+/**
+ * # Benchmark harness
+ *
+ * Performance numbers used to be the raw output of batch jobs: `Time:`
+ * lines interleaved with `solution_check` output, collected by hand.
+ * `shallow-bench` runs a whole sweep in one go instead.  It takes
+ * comma-separated lists of grid sizes, initial conditions, block
+ * layouts, batch depths and schedules, and runs the node solver on
+ * every combination.  Each configuration gets a few untimed warmup
+ * runs and then a number of timed repeats, each starting again from
+ * the initial conditions; we report the median, the 10th and 90th
+ * percentiles, and the throughput in cell updates per second at the
+ * median.  A cell update is one full time step of one interior cell,
+ * so redundant work in the ghost layers does not count.
+ *
+ * Results go out as CSV (default) or JSON.  Given a baseline CSV from
+ * an earlier run, the harness compares medians configuration by
+ * configuration, flags any that got slower by more than the allowed
+ * fraction, and exits with a nonzero status if there were any.
+ */
+
+typedef Central2D< Shallow2D, MinMod<Shallow2D::real> > Sim;
+
+struct BenchConfig {
+    int nx;
+    std::string ic;
+    int nxblocks, nyblocks;
+    int nbatch;
+    std::string schedule;
+
+    std::string key() const {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "%d,%s,%dx%d,%d,%s", nx, ic.c_str(),
+                 nxblocks, nyblocks, nbatch, schedule.c_str());
+        return buf;
+    }
+};
+
+struct BenchResult {
+    BenchConfig config;
+    int    nbatch_used;         // Batch depth after tuning
+    long   steps;               // Full steps per timed run
+    double median, p10, p90;    // Seconds per run
+    double cups;                // Cell updates per second at the median
+};
+
+/**
+ * ## Statistics
+ *
+ * Percentiles interpolate linearly between order statistics.
+ */
+
+double percentile(std::vector<double> v, double p)
+{
+    std::sort(v.begin(), v.end());
+    double r = p * (v.size()-1);
+    size_t k = (size_t) r;
+    if (k+1 >= v.size())
+        return v.back();
+    return v[k] + (r-k) * (v[k+1]-v[k]);
+}
+
+/**
+ * ## Running one configuration
+ */
+
+BenchResult run_config(const BenchConfig& config, double width,
+                       int frames, double ftime, int warmup, int repeats)
+{
+    Sim sim(width,width, config.nx,config.nx,
+            config.nxblocks,config.nyblocks, config.nbatch);
+    if (config.schedule == "persistent")
+        sim.set_schedule(Sim::PERSISTENT);
+    else if (config.schedule == "tasks")
+        sim.set_schedule(Sim::TASKS);
+    auto icfun = initial_condition<Sim::vec>(config.ic);
+
+    std::vector<double> times;
+    long steps = 0;
+    for (int r = 0; r < warmup + repeats; ++r) {
+        sim.init(icfun);
+        long steps0 = sim.get_steps();
+        double t0 = omp_get_wtime();
+        for (int i = 0; i < frames; ++i)
+            sim.run(ftime);
+        double t1 = omp_get_wtime();
+        if (r >= warmup) {
+            times.push_back(t1-t0);
+            steps = sim.get_steps() - steps0;
+        }
+    }
+
+    BenchResult result;
+    result.config      = config;
+    result.nbatch_used = sim.get_nbatch();
+    result.steps       = steps;
+    result.median      = percentile(times, 0.5);
+    result.p10         = percentile(times, 0.1);
+    result.p90         = percentile(times, 0.9);
+    result.cups        = (double) config.nx * config.nx * steps / result.median;
+    return result;
+}
+
+/**
+ * ## Output
+ *
+ * The first five CSV columns identify the configuration; the baseline
+ * comparison matches on them and reads the `median` column.
+ */
+
+void write_csv(FILE* fp, const std::vector<BenchResult>& results)
+{
+    fprintf(fp, "size,ic,layout,batch,schedule,batch_used,threads,steps,"
+                "median,p10,p90,cups\n");
+    for (auto& r : results)
+        fprintf(fp, "%s,%d,%d,%ld,%.6e,%.6e,%.6e,%.6e\n",
+                r.config.key().c_str(), r.nbatch_used, omp_get_max_threads(),
+                r.steps, r.median, r.p10, r.p90, r.cups);
+}
+
+void write_json(FILE* fp, const std::vector<BenchResult>& results)
+{
+    fprintf(fp, "[\n");
+    for (size_t k = 0; k < results.size(); ++k) {
+        const BenchResult& r = results[k];
+        fprintf(fp, "  {\"size\": %d, \"ic\": \"%s\", \"layout\": \"%dx%d\", "
+                    "\"batch\": %d, \"schedule\": \"%s\", \"batch_used\": %d, "
+                    "\"threads\": %d, \"steps\": %ld, \"median\": %.6e, "
+                    "\"p10\": %.6e, \"p90\": %.6e, \"cups\": %.6e}%s\n",
+                r.config.nx, r.config.ic.c_str(),
+                r.config.nxblocks, r.config.nyblocks, r.config.nbatch,
+                r.config.schedule.c_str(), r.nbatch_used, omp_get_max_threads(),
+                r.steps, r.median, r.p10, r.p90, r.cups,
+                k+1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "]\n");
+}
+
+/**
+ * ## Baseline comparison
+ *
+ * Returns the number of configurations whose median is more than
+ * `threshold` (a fraction) slower than in the baseline.
+ * Configurations missing from the baseline are skipped.
+ */
+
+int compare_baseline(const char* fname, const std::vector<BenchResult>& results,
+                     double threshold)
+{
+    FILE* fp = fopen(fname, "r");
+    if (!fp) {
+        perror(fname);
+        return -1;
+    }
+
+    // Median by configuration key (first five columns)
+    std::map<std::string, double> baseline;
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+        std::vector<std::string> cols;
+        for (char* tok = strtok(line, ",\n"); tok; tok = strtok(nullptr, ",\n"))
+            cols.push_back(tok);
+        if (cols.size() < 9 || cols[0] == "size")
+            continue;
+        std::string key = cols[0];
+        for (int c = 1; c < 5; ++c)
+            key += "," + cols[c];
+        baseline[key] = atof(cols[8].c_str());
+    }
+    fclose(fp);
+
+    int nregress = 0;
+    for (auto& r : results) {
+        auto it = baseline.find(r.config.key());
+        if (it == baseline.end())
+            continue;
+        double change = r.median / it->second - 1;
+        bool regressed = change > threshold;
+        fprintf(stderr, "%-8s %-40s %+6.1f%%\n", regressed ? "SLOWER" : "ok",
+                r.config.key().c_str(), 100*change);
+        nregress += regressed;
+    }
+    return nregress;
+}
+
+/**
+ * ## Main
+ */
+
+std::vector<std::string> split(const std::string& s)
+{
+    std::vector<std::string> parts;
+    for (size_t start = 0; start <= s.size(); ) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos)
+            end = s.size();
+        if (end > start)
+            parts.push_back(s.substr(start, end-start));
+        start = end+1;
+    }
+    return parts;
+}
+
+int main(int argc, char** argv)
+{
+    std::string sizes     = "200,400";
+    std::string ics       = "dam_break";
+    std::string layouts   = "1x1";
+    std::string batches   = "1";
+    std::string schedules = "fork";
+    std::string outname;
+    std::string format    = "csv";
+    std::string baseline;
+    double width     = 2.0;
+    double ftime     = 0.01;
+    int    frames    = 10;
+    int    warmup    = 1;
+    int    repeats   = 5;
+    double threshold = 0.1;
+
+    int c;
+    extern char* optarg;
+    while ((c = getopt(argc, argv, "hn:i:l:b:s:w:f:F:W:R:o:j:B:t:")) != -1) {
+        switch (c) {
+        case 'h':
+            fprintf(stderr,
+                    "%s\n"
+                    "\t-h: print this message\n"
+                    "\t-n: cells per side, comma-separated (%s)\n"
+                    "\t-i: initial conditions, comma-separated (%s)\n"
+                    "\t-l: block layouts XxY, comma-separated (%s)\n"
+                    "\t-b: batch depths, 0 to tune, comma-separated (%s)\n"
+                    "\t-s: schedules fork, persistent or tasks, comma-separated (%s)\n"
+                    "\t-w: domain width (%g)\n"
+                    "\t-f: time between frames (%g)\n"
+                    "\t-F: frames per timed run (%d)\n"
+                    "\t-W: untimed warmup runs (%d)\n"
+                    "\t-R: timed repeats (%d)\n"
+                    "\t-o: CSV output file (stdout)\n"
+                    "\t-j: JSON output file\n"
+                    "\t-B: baseline CSV to compare against\n"
+                    "\t-t: slowdown that counts as a regression (%g)\n",
+                    argv[0], sizes.c_str(), ics.c_str(), layouts.c_str(),
+                    batches.c_str(), schedules.c_str(), width, ftime,
+                    frames, warmup, repeats, threshold);
+            return -1;
+        case 'n':  sizes     = optarg;       break;
+        case 'i':  ics       = optarg;       break;
+        case 'l':  layouts   = optarg;       break;
+        case 'b':  batches   = optarg;       break;
+        case 's':  schedules = optarg;       break;
+        case 'w':  width     = atof(optarg); break;
+        case 'f':  ftime     = atof(optarg); break;
+        case 'F':  frames    = atoi(optarg); break;
+        case 'W':  warmup    = atoi(optarg); break;
+        case 'R':  repeats   = atoi(optarg); break;
+        case 'o':  outname   = optarg; format = "csv";  break;
+        case 'j':  outname   = optarg; format = "json"; break;
+        case 'B':  baseline  = optarg;       break;
+        case 't':  threshold = atof(optarg); break;
+        default:
+            fprintf(stderr, "Unknown option (-%c)\n", c);
+            return -1;
+        }
+    }
+    if (repeats < 1)
+        repeats = 1;
+
+    // Expand the sweep
+    std::vector<BenchConfig> configs;
+    for (auto& n : split(sizes))
+        for (auto& ic : split(ics))
+            for (auto& layout : split(layouts))
+                for (auto& b : split(batches))
+                    for (auto& s : split(schedules)) {
+                        BenchConfig config;
+                        config.nx = atoi(n.c_str());
+                        config.ic = ic;
+                        config.nbatch = atoi(b.c_str());
+                        config.schedule = s;
+                        if (sscanf(layout.c_str(), "%dx%d", &config.nxblocks,
+                                   &config.nyblocks) != 2) {
+                            fprintf(stderr, "Bad layout (%s)\n", layout.c_str());
+                            return -1;
+                        }
+                        if (!initial_condition<Sim::vec>(ic)) {
+                            fprintf(stderr, "Unknown initial conditions (%s)\n", ic.c_str());
+                            return -1;
+                        }
+                        if (s != "fork" && s != "persistent" && s != "tasks") {
+                            fprintf(stderr, "Unknown schedule (%s)\n", s.c_str());
+                            return -1;
+                        }
+                        configs.push_back(config);
+                    }
+
+    std::vector<BenchResult> results;
+    for (auto& config : configs) {
+        results.push_back(run_config(config, width, frames, ftime, warmup, repeats));
+        const BenchResult& r = results.back();
+        fprintf(stderr, "# %-40s median %.4e s  %.3e cells/s\n",
+                config.key().c_str(), r.median, r.cups);
+    }
+
+    FILE* fp = outname.empty() ? stdout : fopen(outname.c_str(), "w");
+    if (!fp) {
+        perror(outname.c_str());
+        return -1;
+    }
+    if (format == "json")
+        write_json(fp, results);
+    else
+        write_csv(fp, results);
+    if (fp != stdout)
+        fclose(fp);
+
+    if (!baseline.empty()) {
+        int nregress = compare_baseline(baseline.c_str(), results, threshold);
+        if (nregress < 0)
+            return -1;
+        if (nregress > 0) {
+            fprintf(stderr, "%d configuration(s) regressed\n", nregress);
+            return 1;
+        }
+    }
+    return 0;
+}
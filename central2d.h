@@ -7,6 +7,8 @@
 #include <vector>
 
 #include "aligned_allocator.h"
+#include "local_state.h"
+#include "stage_timers.h"
 
 //ldoc on
 /**
@@ -66,7 +68,8 @@
  * physics and the limiter.
  *
  * The `Central2D` solver class takes two template arguments:
- * `Physics` and `Limiter`.  For `Physics`, we expect the name of a class
+ * `Physics` and `Limiter` (plus an optional storage `Layout`, described
+ * below).  For `Physics`, we expect the name of a class
  * that defines:
  * 
  *  - A type for numerical data (`real`)
@@ -105,11 +108,37 @@
     #define DEF_ALIGN(x) __attribute__ ((aligned((x))))
     #define USE_ALIGN(var, align) ((void)0) /* __builtin_assume_align is unreliabale... */
 #endif
+
+/**
+ * ## Storage layout
+ *
+ * The solver takes an optional third template argument that selects
+ * how the per-cell state is laid out in memory.  The default `AoS`
+ * layout (array of structures) stores one `vec` per cell; this makes
+ * the kernels read almost exactly like the math, but the `vec` carries
+ * a dead padding lane and the innermost loops run over the components
+ * of a single cell.  The `SoA` layout (structure of arrays, see
+ * `central2d_soa.h`) stores each component in its own row-padded plane
+ * so that the inner loops vectorize across cells in $x$ instead.
+ * The `Ensemble` layout (`central2d_ensemble.h`) holds many independent
+ * runs at once, with the member index innermost, so that they
+ * vectorize across members.
+ */
+
+struct AoS {};  // One (padded) vec per cell
+struct SoA {};  // One row-padded plane per component
+struct AMR {};  // Uniform base grid with refined patches (central2d_amr.h)
+struct Ensemble {};  // Independent members interleaved per cell (central2d_ensemble.h)
+
+template <class Physics, class Limiter, class Layout = AoS>
+class Central2D;
+
 template <class Physics, class Limiter>
-class Central2D {
+class Central2D<Physics, Limiter, AoS> {
 public:
-    typedef typename Physics::real real;
-    typedef typename Physics::vec  vec;
+    typedef typename Physics::real  real;
+    typedef typename Physics::accum accum;   // Precision of long sums
+    typedef typename Physics::vec   vec;
 
     Central2D(real w, real h,      // Domain width / height
               int nx, int ny,      // Number of cells in x/y (without ghosts)
@@ -126,11 +155,32 @@ public:
         uy_(nx_all * ny_all),
         fx_(nx_all * ny_all),
         gy_(nx_all * ny_all),
-        v_ (nx_all * ny_all) {}
+        v_ (nx_all * ny_all),
+        fused(false),
+        tile(0), tbatch(1),
+        tile_(0, 0),
+        cull(-1), tiles_run(0), tiles_skipped(0) {}
 
     // Advance from time 0 to time tfinal
     void run(real tfinal);
 
+    // Switch between the staged full-grid sweeps (default) and the
+    // fused row-streaming kernel
+    void set_fused(bool on);
+
+    // Advance tile x tile blocks nbatch full steps at a time (0 = off)
+    void set_tiled(int tile, int nbatch = 1);
+
+    // Let the tiled kernel skip tiles whose neighbourhood is uniform to
+    // within tol in every component (< 0 = never, 0 = exactly uniform)
+    void set_culling(real tol) { cull = tol; }
+
+    // Fraction of tile visits skipped so far
+    double culled_fraction() const {
+        long visits = tiles_run + tiles_skipped;
+        return visits ? double(tiles_skipped) / visits : 0;
+    }
+
     // Call f(Uxy, x, y) at each cell center to set initial conditions
     template <typename F>
     void init(F f);
@@ -170,6 +220,35 @@ private:
     aligned_vector gy_;           // y differences of g
     aligned_vector v_;            // Solution values at next step
 
+    // Rolling row windows for the fused kernel
+    bool fused;                   // Use the fused kernel?
+    aligned_vector fw_;           // Fluxes in x   (last 3 rows)
+    aligned_vector gw_;           // Fluxes in y   (last 3 rows)
+    aligned_vector uxw_;          // x differences (last 2 rows)
+    aligned_vector uyw_;          // y differences (last 2 rows)
+    aligned_vector fxw_;          // x differences of f (current row)
+    aligned_vector gyw_;          // y differences of g (current row)
+    aligned_vector fhw_;          // Half-step fluxes in x (last 2 rows)
+    aligned_vector ghw_;          // Half-step fluxes in y (last 2 rows)
+
+    // Temporal tiling
+    int tile;                     // Tile edge in cells (0 = untiled)
+    int tbatch;                   // Full steps per tile visit
+    LocalState<Physics> tile_;    // The tile in flight, with 3*tbatch ghosts
+    aligned_vector w_;            // Solution values after the batch
+
+    // Activity culling
+    struct TileStats {
+        vec  lo, hi;              // Range of each component over the tile
+        real cx, cy;              // Wave speed bound over the tile
+        bool synced;              // Do u_ and w_ both hold the tile?
+    };
+    real cull;                    // Spread below which tiles sleep (< 0 = never)
+    std::vector<TileStats> stats_;
+    std::vector<char> asleep_;    // Tiles skipped in the current batch
+    long tiles_run;               // Tile visits computed
+    long tiles_skipped;           // Tile visits skipped
+
     // Array accessor functions
 
     inline int offset(int ix, int iy) const { return iy*nx_all+ix; }
@@ -184,6 +263,14 @@ private:
     inline vec& fx(int ix, int iy)   { return fx_[offset(ix,iy)]; }
     inline vec& gy(int ix, int iy)   { return gy_[offset(ix,iy)]; }
 
+    // Window accessors (indexed by global row, wrapped into the window)
+    inline vec& fw(int ix, int iy)   { return fw_ [(iy%3)*nx_all+ix]; }
+    inline vec& gw(int ix, int iy)   { return gw_ [(iy%3)*nx_all+ix]; }
+    inline vec& uxw(int ix, int iy)  { return uxw_[(iy%2)*nx_all+ix]; }
+    inline vec& uyw(int ix, int iy)  { return uyw_[(iy%2)*nx_all+ix]; }
+    inline vec& fhw(int ix, int iy)  { return fhw_[(iy%2)*nx_all+ix]; }
+    inline vec& ghw(int ix, int iy)  { return ghw_[(iy%2)*nx_all+ix]; }
+
     // Wrapped accessor (periodic BC)
     inline int ioffset(int ix, int iy) {
         return offset( (ix+nx-nghost) % nx + nghost,
@@ -211,6 +298,27 @@ private:
     void limited_derivs();
     void compute_step(int io, real dt);
 
+    // Stages of the fused kernel
+    void compute_wave_speeds(real& cx, real& cy);
+    void compute_step_fused(int io, real dt);
+
+    // Stages of the tiled kernel
+    void run_tiled(real tfinal);
+    void gather_tile(int x0, int y0);
+    void scatter_tile(int x0, int y0, real& cx, real& cy);
+    void measure_tile(const aligned_vector& src, int x0, int y0,
+                      TileStats& s, bool speeds);
+    void mark_asleep(int ntx, int nty);
+    void sleep_tile(int x0, int y0, TileStats& s);
+
+    // Steps on one block with ghost cells (shared with the AMR solver)
+    friend class Central2D<Physics, Limiter, AMR>;
+    static void tile_flux(LocalState<Physics>& L);
+    static void tile_derivs(LocalState<Physics>& L);
+    static void tile_step(LocalState<Physics>& L, int io, real dt, real dx, real dy);
+    static void tile_shift(LocalState<Physics>& L, int io);
+    static void advance_tile(LocalState<Physics>& L, int nsteps, real dt, real dx, real dy);
+
 };
 
 
@@ -227,7 +335,7 @@ private:
 
 template <class Physics, class Limiter>
 template <typename F>
-void Central2D<Physics, Limiter>::init(F f)
+void Central2D<Physics, Limiter, AoS>::init(F f)
 {
     for (int iy = 0; iy < ny; ++iy)
         for (int ix = 0; ix < nx; ++ix)
@@ -252,8 +360,10 @@ void Central2D<Physics, Limiter>::init(F f)
  */
 
 template <class Physics, class Limiter>
-void Central2D<Physics, Limiter>::apply_periodic()
+void Central2D<Physics, Limiter, AoS>::apply_periodic()
 {
+    STAGE_TIMER(STAGE_APPLY_PERIODIC, nx_all*ny_all - nx*ny);
+
     // Copy data between right and left boundaries
     for (int iy = 0; iy < ny_all; ++iy) {
         for (int ix = 0; ix < nghost; ++ix) {
@@ -299,9 +409,10 @@ void Central2D<Physics, Limiter>::apply_periodic()
  */
 
 template <class Physics, class Limiter>
-void Central2D<Physics, Limiter>::compute_fg_speeds(real& cx_, real& cy_)
+void Central2D<Physics, Limiter, AoS>::compute_fg_speeds(real& cx_, real& cy_)
 {
     using namespace std;
+    STAGE_TIMER(STAGE_FLUX, nx_all*ny_all); // Wave speeds ride along
     real cx = 1.0e-15;
     real cy = 1.0e-15;
     for (int iy = 0; iy < ny_all; ++iy) {
@@ -333,40 +444,19 @@ void Central2D<Physics, Limiter>::compute_fg_speeds(real& cx_, real& cy_)
  */
 
 template <class Physics, class Limiter>
-void Central2D<Physics, Limiter>::limited_derivs()
+void Central2D<Physics, Limiter, AoS>::limited_derivs()
 {
+    STAGE_TIMER(STAGE_LIMITED_DERIVS, (nx_all-2)*(ny_all-2));
+    // Each row of cells is one run of values, so a neighbour in x is
+    // one vec away and a neighbour in y one row of vecs away
+    const int n  = (nx_all-2) * Physics::vec_size;
+    const int sx = Physics::vec_size;
+    const int sy = nx_all * Physics::vec_size;
     for (int iy = 1; iy < ny_all-1; ++iy) {
-        for (int ix = 1; ix < nx_all-1; ++ix) {
-            //
-            // x derivs
-            //
-            real *ux_x0_y0 = ux(ix, iy).data();  USE_ALIGN(ux_x0_y0, Physics::VEC_ALIGN);
-            real *u_xM1_y0 = u(ix-1, iy).data(); USE_ALIGN(u_xM1_y0, Physics::VEC_ALIGN);
-            real *u_x0_y0  = u(ix, iy).data();   USE_ALIGN(u_x0_y0,  Physics::VEC_ALIGN);
-            real *u_xP1_y0 = u(ix+1, iy).data(); USE_ALIGN(u_xP1_y0, Physics::VEC_ALIGN);
-
-            real *fx_x0_y0 = fx(ix, iy).data();  USE_ALIGN(fx_x0_y0, Physics::VEC_ALIGN);
-            real *f_xM1_y0 = f(ix-1, iy).data(); USE_ALIGN(f_xM1_y0, Physics::VEC_ALIGN);
-            real *f_x0_y0  = f(ix, iy).data();   USE_ALIGN(f_x0_y0,  Physics::VEC_ALIGN);
-            real *f_xP1_y0 = f(ix+1, iy).data(); USE_ALIGN(f_xP1_y0, Physics::VEC_ALIGN);
-
-            //
-            // y derivs
-            //
-            real *uy_x0_y0 = uy(ix, iy).data();  USE_ALIGN(uy_x0_y0, Physics::VEC_ALIGN);
-            real *u_x0_yM1 = u(ix, iy-1).data(); USE_ALIGN(u_x0_yM1, Physics::VEC_ALIGN);
-            real *u_x0_yP1 = u(ix, iy+1).data(); USE_ALIGN(u_x0_yP1, Physics::VEC_ALIGN);
-
-            real *gy_x0_y0 = gy(ix, iy).data();  USE_ALIGN(gy_x0_y0, Physics::VEC_ALIGN);
-            real *g_x0_yM1 = g(ix, iy-1).data(); USE_ALIGN(g_x0_yM1, Physics::VEC_ALIGN);
-            real *g_x0_y0  = g(ix, iy).data();   USE_ALIGN(g_x0_y0,  Physics::VEC_ALIGN);
-            real *g_x0_yP1 = g(ix, iy+1).data(); USE_ALIGN(g_x0_yP1, Physics::VEC_ALIGN);
-
-            limdiff( ux_x0_y0, u_xM1_y0, u_x0_y0, u_xP1_y0 );
-            limdiff( fx_x0_y0, f_xM1_y0, f_x0_y0, f_xP1_y0 );
-            limdiff( uy_x0_y0, u_x0_yM1, u_x0_y0, u_x0_yP1 );
-            limdiff( gy_x0_y0, g_x0_yM1, g_x0_y0, g_x0_yP1 );
-        }
+        Limiter::limdiff_row(ux(1, iy).data(), u(1, iy).data(), n, sx);
+        Limiter::limdiff_row(fx(1, iy).data(), f(1, iy).data(), n, sx);
+        Limiter::limdiff_row(uy(1, iy).data(), u(1, iy).data(), n, sy);
+        Limiter::limdiff_row(gy(1, iy).data(), g(1, iy).data(), n, sy);
     }
 }
 
@@ -394,8 +484,9 @@ void Central2D<Physics, Limiter>::limited_derivs()
  */
 
 template <class Physics, class Limiter>
-void Central2D<Physics, Limiter>::compute_step(int io, real dt)
+void Central2D<Physics, Limiter, AoS>::compute_step(int io, real dt)
 {
+    STAGE_TIMER(STAGE_STEP, (nx_all-3)*(ny_all-3));
     real dtcdx2 = 0.5f * dt / dx;
     real dtcdy2 = 0.5f * dt / dy;
 
@@ -470,16 +561,243 @@ void Central2D<Physics, Limiter>::compute_step(int io, real dt)
             #pragma simd
             for(int m = 0; m < Physics::vec_size; ++m) {
                 v_ix_iy[m] =
-                    0.2500f * ( u_x0_y0[m]  + u_x1_y0[m]    +
-                                u_x0_y1[m]  + u_x1_y1[m]  ) -
-                    0.0625f * ( ux_x1_y0[m] - ux_x0_y0[m]   +
-                                ux_x1_y1[m] - ux_x0_y1[m]   +
-                                uy_x0_y1[m] - uy_x0_y0[m]   +
-                                uy_x1_y1[m] - uy_x1_y0[m] ) -
-                    dtcdx2  * ( f_x1_y0[m]  - f_x0_y0[m]    +
-                                f_x1_y1[m]  - f_x0_y1[m]  ) -
-                    dtcdy2  * ( g_x0_y1[m]  - g_x0_y0[m]    +
-                                g_x1_y1[m]  - g_x1_y0[m]  );                    
+                    0.2500f * ( accum(u_x0_y0[m])  + u_x1_y0[m]    +
+                                       u_x0_y1[m]  + u_x1_y1[m]  ) -
+                    0.0625f * ( accum(ux_x1_y0[m]) - ux_x0_y0[m]   +
+                                       ux_x1_y1[m] - ux_x0_y1[m]   +
+                                       uy_x0_y1[m] - uy_x0_y0[m]   +
+                                       uy_x1_y1[m] - uy_x1_y0[m] ) -
+                    dtcdx2  * ( accum(f_x1_y0[m])  - f_x0_y0[m]    +
+                                       f_x1_y1[m]  - f_x0_y1[m]  ) -
+                    dtcdy2  * ( accum(g_x0_y1[m])  - g_x0_y0[m]    +
+                                       g_x1_y1[m]  - g_x1_y0[m]  );                    
+            }
+        }
+    }
+
+    // Copy from v storage back to main grid
+    for (int j = nghost; j < ny+nghost; ++j){
+        for (int i = nghost; i < nx+nghost; ++i){
+            real *u_ij = u(i, j).data();
+            real *v_ij_io = v(i-io, j-io).data();
+
+            #pragma unroll
+            for(int m = 0; m < Physics::vec_size; ++m) u_ij[m] = v_ij_io[m];
+        }
+    }
+}
+
+
+/**
+ * ### Fused streaming kernel
+ * 
+ * The staged kernels above each sweep the whole grid and keep a full
+ * array for every intermediate (fluxes, four sets of differences, and
+ * the next step), so on large grids the solver spends most of its time
+ * streaming those arrays through memory.  But every stage only looks
+ * one row up or down.  The fused kernel exploits this by walking down
+ * the grid one row at a time: when row `r` comes in we compute its
+ * fluxes, which completes the stencil for the limited derivatives and
+ * the predictor on row `d = r-1`, which in turn completes the stencil
+ * for the corrector on row `c = r-2`.  The intermediates only need to
+ * live in small rolling windows (three rows of $F$ and $G$, at most two
+ * rows of everything else), so the working set is just `u` and `v`.
+ * Within a row, each stage is still its own loop so that the compiler
+ * vectorizes it the same way as the staged version.
+ * 
+ * The arithmetic per cell is the same as in the staged kernels, so the
+ * two modes produce the same answer.  The only difference in `run` is
+ * that the wave speed bound is computed in its own read-only sweep,
+ * and only on the even sub-step where we actually use it.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::set_fused(bool on)
+{
+    fused = on;
+    int nfull = on ? 0 : nx_all * ny_all;
+    int nrows = on ? nx_all : 0;
+
+    f_.resize(nfull);  f_.shrink_to_fit();
+    g_.resize(nfull);  g_.shrink_to_fit();
+    ux_.resize(nfull); ux_.shrink_to_fit();
+    uy_.resize(nfull); uy_.shrink_to_fit();
+    fx_.resize(nfull); fx_.shrink_to_fit();
+    gy_.resize(nfull); gy_.shrink_to_fit();
+
+    fw_.resize(3*nrows);
+    gw_.resize(3*nrows);
+    uxw_.resize(2*nrows);
+    uyw_.resize(2*nrows);
+    fxw_.resize(nrows);
+    gyw_.resize(nrows);
+    fhw_.resize(2*nrows);
+    ghw_.resize(2*nrows);
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::compute_wave_speeds(real& cx_, real& cy_)
+{
+    using namespace std;
+    STAGE_TIMER(STAGE_WAVE_SPEEDS, nx_all*ny_all);
+    real cx = 1.0e-15;
+    real cy = 1.0e-15;
+    for (int iy = 0; iy < ny_all; ++iy) {
+        #pragma ivdep
+        for (int ix = 0; ix < nx_all; ++ix) {
+            real cell_cx, cell_cy;
+            real *u_xy = u(ix, iy).data(); USE_ALIGN(u_xy, Physics::VEC_ALIGN);
+            Physics::wave_speed(cell_cx, cell_cy, u_xy);
+            cx = max(cx, cell_cx);
+            cy = max(cy, cell_cy);
+        }
+    }
+    cx_ = cx;
+    cy_ = cy;
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::compute_step_fused(int io, real dt)
+{
+    STAGE_TIMER(STAGE_STEP, (nx_all-3)*(ny_all-3)); // Flux and derivatives too
+    real dtcdx2 = 0.5f * dt / dx;
+    real dtcdy2 = 0.5f * dt / dy;
+
+    real uh_copy[] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    for (int r = 0; r < ny_all; ++r) {
+
+        // Fluxes on the incoming row
+        vec *u_r  = &u(0, r);
+        vec *fw_r = &fw(0, r);
+        vec *gw_r = &gw(0, r);
+
+        #pragma ivdep
+        for (int ix = 0; ix < nx_all; ++ix) {
+            real *f_xy = fw_r[ix].data(); USE_ALIGN(f_xy, Physics::VEC_ALIGN);
+            real *g_xy = gw_r[ix].data(); USE_ALIGN(g_xy, Physics::VEC_ALIGN);
+            real *u_xy = u_r[ix].data();  USE_ALIGN(u_xy, Physics::VEC_ALIGN);
+            Physics::flux(f_xy, g_xy, u_xy);
+        }
+
+        // Limited derivatives and predictor on the row behind it
+        int d = r-1;
+        if (d < 1 || d > ny_all-2)
+            continue;
+
+        vec *u_dM1  = &u(0, d-1);
+        vec *u_d    = &u(0, d);
+        vec *u_dP1  = &u(0, d+1);
+        vec *fw_d   = &fw(0, d);
+        vec *gw_dM1 = &gw(0, d-1);
+        vec *gw_d   = &gw(0, d);
+        vec *gw_dP1 = &gw(0, d+1);
+        vec *uxw_d  = &uxw(0, d);
+        vec *uyw_d  = &uyw(0, d);
+        vec *fhw_d  = &fhw(0, d);
+        vec *ghw_d  = &ghw(0, d);
+
+        for (int ix = 1; ix < nx_all-1; ++ix) {
+            real *ux_x0_y0 = uxw_d[ix].data();    USE_ALIGN(ux_x0_y0, Physics::VEC_ALIGN);
+            real *u_xM1_y0 = u_d[ix-1].data();    USE_ALIGN(u_xM1_y0, Physics::VEC_ALIGN);
+            real *u_x0_y0  = u_d[ix].data();      USE_ALIGN(u_x0_y0,  Physics::VEC_ALIGN);
+            real *u_xP1_y0 = u_d[ix+1].data();    USE_ALIGN(u_xP1_y0, Physics::VEC_ALIGN);
+
+            real *fx_x0_y0 = fxw_[ix].data();     USE_ALIGN(fx_x0_y0, Physics::VEC_ALIGN);
+            real *f_xM1_y0 = fw_d[ix-1].data();   USE_ALIGN(f_xM1_y0, Physics::VEC_ALIGN);
+            real *f_x0_y0  = fw_d[ix].data();     USE_ALIGN(f_x0_y0,  Physics::VEC_ALIGN);
+            real *f_xP1_y0 = fw_d[ix+1].data();   USE_ALIGN(f_xP1_y0, Physics::VEC_ALIGN);
+
+            real *uy_x0_y0 = uyw_d[ix].data();    USE_ALIGN(uy_x0_y0, Physics::VEC_ALIGN);
+            real *u_x0_yM1 = u_dM1[ix].data();    USE_ALIGN(u_x0_yM1, Physics::VEC_ALIGN);
+            real *u_x0_yP1 = u_dP1[ix].data();    USE_ALIGN(u_x0_yP1, Physics::VEC_ALIGN);
+
+            real *gy_x0_y0 = gyw_[ix].data();     USE_ALIGN(gy_x0_y0, Physics::VEC_ALIGN);
+            real *g_x0_yM1 = gw_dM1[ix].data();   USE_ALIGN(g_x0_yM1, Physics::VEC_ALIGN);
+            real *g_x0_y0  = gw_d[ix].data();     USE_ALIGN(g_x0_y0,  Physics::VEC_ALIGN);
+            real *g_x0_yP1 = gw_dP1[ix].data();   USE_ALIGN(g_x0_yP1, Physics::VEC_ALIGN);
+
+            limdiff( ux_x0_y0, u_xM1_y0, u_x0_y0, u_xP1_y0 );
+            limdiff( fx_x0_y0, f_xM1_y0, f_x0_y0, f_xP1_y0 );
+            limdiff( uy_x0_y0, u_x0_yM1, u_x0_y0, u_x0_yP1 );
+            limdiff( gy_x0_y0, g_x0_yM1, g_x0_y0, g_x0_yP1 );
+        }
+
+        #pragma simd
+        for (int ix = 1; ix < nx_all-1; ++ix) {
+            real *uh    = u_d[ix].data();   USE_ALIGN(uh,    Physics::VEC_ALIGN);
+            real *fx_xy = fxw_[ix].data();  USE_ALIGN(fx_xy, Physics::VEC_ALIGN);
+            real *gy_xy = gyw_[ix].data();  USE_ALIGN(gy_xy, Physics::VEC_ALIGN);
+            real *fh_xy = fhw_d[ix].data(); USE_ALIGN(fh_xy, Physics::VEC_ALIGN);
+            real *gh_xy = ghw_d[ix].data(); USE_ALIGN(gh_xy, Physics::VEC_ALIGN);
+
+            #pragma unroll
+            for(int m = 0; m < Physics::vec_size; ++m) uh_copy[m] = uh[m];
+
+            #pragma unroll
+            for (int m = 0; m < Physics::vec_size; ++m) {
+                uh_copy[m] -= dtcdx2 * fx_xy[m];
+                uh_copy[m] -= dtcdy2 * gy_xy[m];
+            }
+            Physics::flux(fh_xy, gh_xy, uh_copy);
+        }
+
+        // Corrector on the row behind that
+        int c = d-1;
+        if (c < nghost-io || c >= ny+nghost-io)
+            continue;
+
+        vec *v_c    = &v(0, c);
+        vec *u_c    = &u(0, c);     vec *u_cP1   = &u(0, c+1);
+        vec *uxw_c  = &uxw(0, c);   vec *uxw_cP1 = &uxw(0, c+1);
+        vec *uyw_c  = &uyw(0, c);   vec *uyw_cP1 = &uyw(0, c+1);
+        vec *fhw_c  = &fhw(0, c);   vec *fhw_cP1 = &fhw(0, c+1);
+        vec *ghw_c  = &ghw(0, c);   vec *ghw_cP1 = &ghw(0, c+1);
+
+        // Too many row pointers for the compiler's alias checks, so
+        // tell it explicitly that the iterations are independent
+        #pragma omp simd
+        for (int ix = nghost-io; ix < nx+nghost-io; ++ix) {
+            real *v_ix_iy  = v_c[ix].data();        USE_ALIGN(v_ix_iy,  Physics::VEC_ALIGN );
+
+            real *u_x0_y0  = u_c[ix  ].data();      USE_ALIGN(u_x0_y0,  Physics::VEC_ALIGN );
+            real *u_x1_y0  = u_c[ix+1].data();      USE_ALIGN(u_x1_y0,  Physics::VEC_ALIGN );
+            real *u_x0_y1  = u_cP1[ix  ].data();    USE_ALIGN(u_x0_y1,  Physics::VEC_ALIGN );
+            real *u_x1_y1  = u_cP1[ix+1].data();    USE_ALIGN(u_x1_y1,  Physics::VEC_ALIGN );
+
+            real *ux_x0_y0 = uxw_c[ix  ].data();    USE_ALIGN(ux_x0_y0, Physics::VEC_ALIGN );
+            real *ux_x1_y0 = uxw_c[ix+1].data();    USE_ALIGN(ux_x1_y0, Physics::VEC_ALIGN );
+            real *ux_x0_y1 = uxw_cP1[ix  ].data();  USE_ALIGN(ux_x0_y1, Physics::VEC_ALIGN );
+            real *ux_x1_y1 = uxw_cP1[ix+1].data();  USE_ALIGN(ux_x1_y1, Physics::VEC_ALIGN );
+
+            real *uy_x0_y0 = uyw_c[ix  ].data();    USE_ALIGN(uy_x0_y0, Physics::VEC_ALIGN );
+            real *uy_x1_y0 = uyw_c[ix+1].data();    USE_ALIGN(uy_x1_y0, Physics::VEC_ALIGN );
+            real *uy_x0_y1 = uyw_cP1[ix  ].data();  USE_ALIGN(uy_x0_y1, Physics::VEC_ALIGN );
+            real *uy_x1_y1 = uyw_cP1[ix+1].data();  USE_ALIGN(uy_x1_y1, Physics::VEC_ALIGN );
+
+            real *f_x0_y0  = fhw_c[ix  ].data();    USE_ALIGN(f_x0_y0,  Physics::VEC_ALIGN );
+            real *f_x1_y0  = fhw_c[ix+1].data();    USE_ALIGN(f_x1_y0,  Physics::VEC_ALIGN );
+            real *f_x0_y1  = fhw_cP1[ix  ].data();  USE_ALIGN(f_x0_y1,  Physics::VEC_ALIGN );
+            real *f_x1_y1  = fhw_cP1[ix+1].data();  USE_ALIGN(f_x1_y1,  Physics::VEC_ALIGN );
+
+            real *g_x0_y0  = ghw_c[ix  ].data();    USE_ALIGN(g_x0_y0,  Physics::VEC_ALIGN );
+            real *g_x1_y0  = ghw_c[ix+1].data();    USE_ALIGN(g_x1_y0,  Physics::VEC_ALIGN );
+            real *g_x0_y1  = ghw_cP1[ix  ].data();  USE_ALIGN(g_x0_y1,  Physics::VEC_ALIGN );
+            real *g_x1_y1  = ghw_cP1[ix+1].data();  USE_ALIGN(g_x1_y1,  Physics::VEC_ALIGN );
+
+            #pragma simd
+            for(int m = 0; m < Physics::vec_size; ++m) {
+                v_ix_iy[m] =
+                    0.2500f * ( accum(u_x0_y0[m])  + u_x1_y0[m]    +
+                                       u_x0_y1[m]  + u_x1_y1[m]  ) -
+                    0.0625f * ( accum(ux_x1_y0[m]) - ux_x0_y0[m]   +
+                                       ux_x1_y1[m] - ux_x0_y1[m]   +
+                                       uy_x0_y1[m] - uy_x0_y0[m]   +
+                                       uy_x1_y1[m] - uy_x1_y0[m] ) -
+                    dtcdx2  * ( accum(f_x1_y0[m])  - f_x0_y0[m]    +
+                                       f_x1_y1[m]  - f_x0_y1[m]  ) -
+                    dtcdy2  * ( accum(g_x0_y1[m])  - g_x0_y0[m]    +
+                                       g_x1_y1[m]  - g_x1_y0[m]  );
             }
         }
     }
@@ -497,6 +815,491 @@ void Central2D<Physics, Limiter>::compute_step(int io, real dt)
 }
 
 
+/**
+ * ### Temporally tiled kernel
+ *
+ * The fused kernel keeps the intermediates in cache, but it still
+ * streams `u` and `v` through memory once per half step, and on large
+ * grids that traffic is most of the run time.  The tiled kernel
+ * instead takes several half steps on one small piece of the grid
+ * before moving on to the next, the same trade of redundant ghost work
+ * for locality that the node solver makes with `nbatch`.
+ *
+ * The grid is cut into `tile` by `tile` tiles.  Each tile is copied,
+ * together with `3*tbatch` ghost layers read from the periodic grid,
+ * into a `LocalState` block, advanced `tbatch` full steps there, and
+ * its interior written to `w_`.  Each full step eats three ghost
+ * layers, exactly as for a node block.  A tile of 64 cells with one
+ * step per visit is 70 by 70 cells of eight arrays, which fits in a
+ * typical L2 cache; only `u` and `w` cross the memory bus, once per
+ * batch instead of once per stage.  When all tiles are done, `w_` and
+ * `u_` trade places.
+ *
+ * Every step of a batch uses the time step chosen at its start, as in
+ * the node solver, and each tile leaves the speed bound of its interior
+ * behind for the next batch.  With `tbatch = 1` the steps are those of
+ * the staged kernel, cell for cell, and so is the answer.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::set_tiled(int tile, int nbatch)
+{
+    set_fused(false);
+    v_.resize(nx_all * ny_all);
+    this->tile   = tile;
+    this->tbatch = nbatch > 0 ? nbatch : 1;
+    if (!tile) {
+        w_.clear();  w_.shrink_to_fit();
+        tile_.resize(0, 0);
+        return;
+    }
+
+    // Tiles keep their intermediates locally
+    f_.clear();  f_.shrink_to_fit();
+    g_.clear();  g_.shrink_to_fit();
+    ux_.clear(); ux_.shrink_to_fit();
+    uy_.clear(); uy_.shrink_to_fit();
+    fx_.clear(); fx_.shrink_to_fit();
+    gy_.clear(); gy_.shrink_to_fit();
+    v_.clear();  v_.shrink_to_fit();
+
+    w_.resize(nx_all * ny_all);
+    int nt = tile + 6*tbatch;
+    tile_.resize(nt, nt);
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::gather_tile(int x0, int y0)
+{
+    int nx_tile = tile_.get_nx();
+    int ny_tile = tile_.get_ny();
+    STAGE_TIMER(STAGE_COPY_TO_LOCAL, nx_tile*ny_tile);
+
+    // Canonical cell under local (0,0), wrapped into the domain
+    int gx0 = ((x0 - 3*tbatch) % nx + nx) % nx;
+    int gy  = ((y0 - 3*tbatch) % ny + ny) % ny;
+
+    for (int iy = 0; iy < ny_tile; ++iy) {
+        int gx = gx0;
+        for (int ix = 0; ix < nx_tile; ++ix) {
+            real *tile_u_xy   = tile_.u(ix, iy).data();              USE_ALIGN(tile_u_xy,   Physics::VEC_ALIGN);
+            real *global_u_xy = u(gx+nghost, gy+nghost).data();      USE_ALIGN(global_u_xy, Physics::VEC_ALIGN);
+
+            #pragma unroll
+            for(int m = 0; m < Physics::vec_size; ++m) tile_u_xy[m] = global_u_xy[m];
+
+            if (++gx == nx) gx = 0;
+        }
+        if (++gy == ny) gy = 0;
+    }
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::tile_flux(LocalState<Physics>& L)
+{
+    int nx_tile = L.get_nx();
+    int ny_tile = L.get_ny();
+    STAGE_TIMER(STAGE_FLUX, nx_tile*ny_tile);
+
+    for (int iy = 0; iy < ny_tile; ++iy) {
+        #pragma ivdep
+        for (int ix = 0; ix < nx_tile; ++ix) {
+            real *f_xy = L.f(ix,iy).data(); USE_ALIGN(f_xy, Physics::VEC_ALIGN);
+            real *g_xy = L.g(ix,iy).data(); USE_ALIGN(g_xy, Physics::VEC_ALIGN);
+            real *u_xy = L.u(ix,iy).data(); USE_ALIGN(u_xy, Physics::VEC_ALIGN);
+
+            Physics::flux(f_xy, g_xy, u_xy);
+        }
+    }
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::tile_derivs(LocalState<Physics>& L)
+{
+    int nx_tile = L.get_nx();
+    int ny_tile = L.get_ny();
+    STAGE_TIMER(STAGE_LIMITED_DERIVS, (nx_tile-2)*(ny_tile-2));
+
+    const int n  = (nx_tile-2) * Physics::vec_size;
+    const int sx = Physics::vec_size;
+    const int sy = nx_tile * Physics::vec_size;
+    for (int iy = 1; iy < ny_tile-1; ++iy) {
+        Limiter::limdiff_row(L.ux(1, iy).data(), L.u(1, iy).data(), n, sx);
+        Limiter::limdiff_row(L.fx(1, iy).data(), L.f(1, iy).data(), n, sx);
+        Limiter::limdiff_row(L.uy(1, iy).data(), L.u(1, iy).data(), n, sy);
+        Limiter::limdiff_row(L.gy(1, iy).data(), L.g(1, iy).data(), n, sy);
+    }
+}
+
+/**
+ * A tile step is the staged step applied to every cell of the tile
+ * that has a full stencil, ghosts included; the band of valid cells
+ * shrinks from the outside in as described for the node solver.  The
+ * tile stages only touch the block they are given, so they are static,
+ * and the adaptive solver runs its patches through them too.  Moving
+ * the result from `v` back onto `u` is a stage of its own, so that the
+ * adaptive solver can record the flows of a sub-step in between.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::tile_step(LocalState<Physics>& L, int io, real dt,
+                                                 real dx, real dy)
+{
+    int nx_tile = L.get_nx();
+    int ny_tile = L.get_ny();
+    STAGE_TIMER(STAGE_STEP, (nx_tile-3)*(ny_tile-3));
+    real dtcdx2 = 0.5f * dt / dx;
+    real dtcdy2 = 0.5f * dt / dy;
+
+    real uh_copy[] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    // Predictor (flux values of f and g at half step)
+    for (int iy = 1; iy < ny_tile-1; ++iy) {
+        #pragma simd
+        for (int ix = 1; ix < nx_tile-1; ++ix) {
+            real *uh    = L.u(ix, iy).data();  USE_ALIGN(uh,    Physics::VEC_ALIGN);
+            real *fx_xy = L.fx(ix, iy).data(); USE_ALIGN(fx_xy, Physics::VEC_ALIGN);
+            real *gy_xy = L.gy(ix, iy).data(); USE_ALIGN(gy_xy, Physics::VEC_ALIGN);
+            real *f_xy  = L.f(ix, iy).data();  USE_ALIGN(f_xy,  Physics::VEC_ALIGN);
+            real *g_xy  = L.g(ix, iy).data();  USE_ALIGN(g_xy,  Physics::VEC_ALIGN);
+
+            #pragma unroll
+            for(int m = 0; m < Physics::vec_size; ++m) uh_copy[m] = uh[m];
+
+            #pragma unroll
+            for (int m = 0; m < Physics::vec_size; ++m) {
+                uh_copy[m] -= dtcdx2 * fx_xy[m];
+                uh_copy[m] -= dtcdy2 * gy_xy[m];
+            }
+            Physics::flux(f_xy, g_xy, uh_copy);
+        }
+    }
+
+    // Corrector (finish the step)
+    for (int iy = 1; iy < ny_tile-2; ++iy) {
+        vec *v_c   = &L.v(0, iy);
+        vec *u_c   = &L.u(0, iy);   vec *u_cP1  = &L.u(0, iy+1);
+        vec *ux_c  = &L.ux(0, iy);  vec *ux_cP1 = &L.ux(0, iy+1);
+        vec *uy_c  = &L.uy(0, iy);  vec *uy_cP1 = &L.uy(0, iy+1);
+        vec *f_c   = &L.f(0, iy);   vec *f_cP1  = &L.f(0, iy+1);
+        vec *g_c   = &L.g(0, iy);   vec *g_cP1  = &L.g(0, iy+1);
+
+        #pragma omp simd
+        for (int ix = 1; ix < nx_tile-2; ++ix) {
+            real *v_ix_iy  = v_c[ix].data();       USE_ALIGN(v_ix_iy,  Physics::VEC_ALIGN );
+
+            real *u_x0_y0  = u_c[ix  ].data();     USE_ALIGN(u_x0_y0,  Physics::VEC_ALIGN );
+            real *u_x1_y0  = u_c[ix+1].data();     USE_ALIGN(u_x1_y0,  Physics::VEC_ALIGN );
+            real *u_x0_y1  = u_cP1[ix  ].data();   USE_ALIGN(u_x0_y1,  Physics::VEC_ALIGN );
+            real *u_x1_y1  = u_cP1[ix+1].data();   USE_ALIGN(u_x1_y1,  Physics::VEC_ALIGN );
+
+            real *ux_x0_y0 = ux_c[ix  ].data();    USE_ALIGN(ux_x0_y0, Physics::VEC_ALIGN );
+            real *ux_x1_y0 = ux_c[ix+1].data();    USE_ALIGN(ux_x1_y0, Physics::VEC_ALIGN );
+            real *ux_x0_y1 = ux_cP1[ix  ].data();  USE_ALIGN(ux_x0_y1, Physics::VEC_ALIGN );
+            real *ux_x1_y1 = ux_cP1[ix+1].data();  USE_ALIGN(ux_x1_y1, Physics::VEC_ALIGN );
+
+            real *uy_x0_y0 = uy_c[ix  ].data();    USE_ALIGN(uy_x0_y0, Physics::VEC_ALIGN );
+            real *uy_x1_y0 = uy_c[ix+1].data();    USE_ALIGN(uy_x1_y0, Physics::VEC_ALIGN );
+            real *uy_x0_y1 = uy_cP1[ix  ].data();  USE_ALIGN(uy_x0_y1, Physics::VEC_ALIGN );
+            real *uy_x1_y1 = uy_cP1[ix+1].data();  USE_ALIGN(uy_x1_y1, Physics::VEC_ALIGN );
+
+            real *f_x0_y0  = f_c[ix  ].data();     USE_ALIGN(f_x0_y0,  Physics::VEC_ALIGN );
+            real *f_x1_y0  = f_c[ix+1].data();     USE_ALIGN(f_x1_y0,  Physics::VEC_ALIGN );
+            real *f_x0_y1  = f_cP1[ix  ].data();   USE_ALIGN(f_x0_y1,  Physics::VEC_ALIGN );
+            real *f_x1_y1  = f_cP1[ix+1].data();   USE_ALIGN(f_x1_y1,  Physics::VEC_ALIGN );
+
+            real *g_x0_y0  = g_c[ix  ].data();     USE_ALIGN(g_x0_y0,  Physics::VEC_ALIGN );
+            real *g_x1_y0  = g_c[ix+1].data();     USE_ALIGN(g_x1_y0,  Physics::VEC_ALIGN );
+            real *g_x0_y1  = g_cP1[ix  ].data();   USE_ALIGN(g_x0_y1,  Physics::VEC_ALIGN );
+            real *g_x1_y1  = g_cP1[ix+1].data();   USE_ALIGN(g_x1_y1,  Physics::VEC_ALIGN );
+
+            #pragma simd
+            for(int m = 0; m < Physics::vec_size; ++m) {
+                v_ix_iy[m] =
+                    0.2500f * ( accum(u_x0_y0[m])  + u_x1_y0[m]    +
+                                       u_x0_y1[m]  + u_x1_y1[m]  ) -
+                    0.0625f * ( accum(ux_x1_y0[m]) - ux_x0_y0[m]   +
+                                       ux_x1_y1[m] - ux_x0_y1[m]   +
+                                       uy_x0_y1[m] - uy_x0_y0[m]   +
+                                       uy_x1_y1[m] - uy_x1_y0[m] ) -
+                    dtcdx2  * ( accum(f_x1_y0[m])  - f_x0_y0[m]    +
+                                       f_x1_y1[m]  - f_x0_y1[m]  ) -
+                    dtcdy2  * ( accum(g_x0_y1[m])  - g_x0_y0[m]    +
+                                       g_x1_y1[m]  - g_x1_y0[m]  );
+            }
+        }
+    }
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::tile_shift(LocalState<Physics>& L, int io)
+{
+    int nx_tile = L.get_nx();
+    int ny_tile = L.get_ny();
+
+    // Copy from v storage back to the tile
+    for (int j = 1+io; j < ny_tile-2+io; ++j) {
+        for (int i = 1+io; i < nx_tile-2+io; ++i) {
+            real *u_ij    = L.u(i, j).data();       USE_ALIGN(u_ij,    Physics::VEC_ALIGN );
+            real *v_ij_io = L.v(i-io, j-io).data(); USE_ALIGN(v_ij_io, Physics::VEC_ALIGN );
+
+            #pragma unroll
+            for(int m = 0; m < Physics::vec_size; ++m) u_ij[m] = v_ij_io[m];
+        }
+    }
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::advance_tile(LocalState<Physics>& L, int nsteps,
+                                                    real dt, real dx, real dy)
+{
+    for (int bi = 0; bi < nsteps; ++bi) {
+        for (int io = 0; io < 2; ++io) {
+            tile_flux(L);
+            tile_derivs(L);
+            tile_step(L, io, dt, dx, dy);
+            tile_shift(L, io);
+        }
+    }
+}
+
+/**
+ * The interior of a finished tile goes to `w_`; on the way out we fold
+ * its wave speeds into the bound for the next batch.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::scatter_tile(int x0, int y0, real& cx_, real& cy_)
+{
+    using namespace std;
+    const int G = 3*tbatch;
+    int nx_tile = tile_.get_nx();
+    int ny_tile = tile_.get_ny();
+    STAGE_TIMER(STAGE_COPY_FROM_LOCAL, (nx_tile-2*G)*(ny_tile-2*G));
+
+    real cx = cx_;
+    real cy = cy_;
+    for (int iy = G; iy < ny_tile-G; ++iy) {
+        vec *w_r = &w_[offset(x0+nghost-G, y0+nghost+iy-G)];
+        #pragma ivdep
+        for (int ix = G; ix < nx_tile-G; ++ix) {
+            real cell_cx, cell_cy;
+            real *tile_u_xy   = tile_.u(ix, iy).data(); USE_ALIGN(tile_u_xy,   Physics::VEC_ALIGN);
+            real *global_u_xy = w_r[ix].data();         USE_ALIGN(global_u_xy, Physics::VEC_ALIGN);
+
+            #pragma unroll
+            for(int m = 0; m < Physics::vec_size; ++m) global_u_xy[m] = tile_u_xy[m];
+
+            Physics::wave_speed(cell_cx, cell_cy, tile_u_xy);
+            cx = max(cx, cell_cx);
+            cy = max(cy, cell_cy);
+        }
+    }
+    cx_ = cx;
+    cy_ = cy;
+}
+
+/**
+ * #### Activity culling
+ *
+ * In the pond and the river, and far from the wave in the early dam
+ * break frames, most tiles do not change from one batch to the next,
+ * and advancing them is wasted work.  A tile's batch only depends on
+ * its `3*tbatch` ghost layers, which lie in the neighbouring tiles, and
+ * if all of those cells hold the same state the slopes and flux
+ * differences vanish and the tile comes back as it went in.  So each
+ * tile keeps the range of each component over its interior, and a tile
+ * whose own range and those of its neighbours all fit in a band of
+ * width `cull` is skipped for the batch.  Its speed bound carries over
+ * from the last time it ran.  When a wave reaches a neighbour, the
+ * neighbour's range widens and the tile wakes up in time for the wave
+ * to arrive, so the cost follows the size of the disturbance rather
+ * than the size of the domain.
+ *
+ * With `cull = 0` only exactly uniform neighbourhoods sleep, and the
+ * answer is the unculled one.  A positive `cull` also lets nearly
+ * uniform regions sleep, and the error is bounded by the tolerance,
+ * since the scheme keeps a state inside the band the data spans.
+ *
+ * `u_` and `w_` trade places after each batch, so a tile that goes to
+ * sleep copies itself into `w_` once; after that both buffers hold it
+ * and later skips cost nothing until the tile runs again.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::measure_tile(const aligned_vector& src,
+                                                   int x0, int y0,
+                                                   TileStats& s, bool speeds)
+{
+    using namespace std;
+    int x1 = min(x0+tile, nx);
+    int y1 = min(y0+tile, ny);
+    vec lo = src[offset(x0+nghost, y0+nghost)];
+    vec hi = lo;
+    real cx = 1.0e-15;
+    real cy = 1.0e-15;
+    for (int iy = y0; iy < y1; ++iy) {
+        const vec *src_r = &src[offset(nghost, iy+nghost)];
+        for (int ix = x0; ix < x1; ++ix) {
+            const vec& src_xy = src_r[ix];
+            for (int m = 0; m < Physics::vec_size; ++m) {
+                lo[m] = min(lo[m], src_xy[m]);
+                hi[m] = max(hi[m], src_xy[m]);
+            }
+            if (speeds) {
+                real cell_cx, cell_cy;
+                Physics::wave_speed(cell_cx, cell_cy, src_xy.data());
+                cx = max(cx, cell_cx);
+                cy = max(cy, cell_cy);
+            }
+        }
+    }
+    s.lo = lo;
+    s.hi = hi;
+    if (speeds) {
+        s.cx = cx;
+        s.cy = cy;
+    }
+}
+
+/**
+ * The decisions for a batch are all made from the ranges at its start,
+ * before any tile runs.  The neighbourhood reaches far enough in tiles
+ * to cover the ghost layers even when the last tile in a row is a
+ * narrow remainder.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::mark_asleep(int ntx, int nty)
+{
+    using namespace std;
+    const int G = 3*tbatch;
+    int min_tile = min(min(tile, nx-(ntx-1)*tile), ny-(nty-1)*tile);
+    int reach = (G + min_tile-1) / min_tile;
+
+    asleep_.assign(ntx*nty, 0);
+    for (int ty = 0; ty < nty; ++ty)
+        for (int tx = 0; tx < ntx; ++tx) {
+            vec lo = stats_[ty*ntx+tx].lo;
+            vec hi = stats_[ty*ntx+tx].hi;
+            for (int dy = -reach; dy <= reach; ++dy)
+                for (int dx = -reach; dx <= reach; ++dx) {
+                    int nbr = ((ty+dy) % nty + nty) % nty * ntx
+                            + ((tx+dx) % ntx + ntx) % ntx;
+                    for (int m = 0; m < Physics::vec_size; ++m) {
+                        lo[m] = min(lo[m], stats_[nbr].lo[m]);
+                        hi[m] = max(hi[m], stats_[nbr].hi[m]);
+                    }
+                }
+            bool quiet = true;
+            for (int m = 0; m < Physics::vec_size; ++m)
+                quiet = quiet && hi[m]-lo[m] <= cull;
+            asleep_[ty*ntx+tx] = quiet;
+        }
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::sleep_tile(int x0, int y0, TileStats& s)
+{
+    if (s.synced)
+        return;
+    int nx_tile = std::min(tile, nx-x0);
+    int ny_tile = std::min(tile, ny-y0);
+    STAGE_TIMER(STAGE_COPY_FROM_LOCAL, nx_tile*ny_tile);
+    for (int iy = y0; iy < y0+ny_tile; ++iy) {
+        int row = offset(x0+nghost, iy+nghost);
+        std::copy(&u_[row], &u_[row] + nx_tile, &w_[row]);
+    }
+    s.synced = true;
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AoS>::run_tiled(real tfinal)
+{
+    const int ntx = (nx + tile-1) / tile;
+    const int nty = (ny + tile-1) / tile;
+
+    // Wave speeds for the first batch. After that, each batch leaves
+    // the speeds for the next one behind.
+    real cx, cy;
+    apply_periodic();
+    if (cull < 0) {
+        compute_wave_speeds(cx, cy);
+    } else {
+        stats_.resize(ntx*nty);
+        cx = cy = 1.0e-15;
+        for (int ty = 0; ty < nty; ++ty)
+            for (int tx = 0; tx < ntx; ++tx) {
+                TileStats& s = stats_[ty*ntx+tx];
+                measure_tile(u_, tx*tile, ty*tile, s, true);
+                s.synced = false;
+                cx = std::max(cx, s.cx);
+                cy = std::max(cy, s.cy);
+            }
+    }
+
+    bool done = false;
+    real t = 0;
+    while (!done) {
+
+        // Shorten the steps of the last batch to land on tfinal
+        real dt = cfl / std::max(cx/dx, cy/dy);
+        int  nsteps = tbatch;
+        if (t + 2*tbatch*dt >= tfinal) {
+            nsteps = ceil((tfinal-t) / (2*dt));
+            dt = (tfinal-t) / (2*nsteps);
+            done = true;
+        }
+
+        if (cull >= 0)
+            mark_asleep(ntx, nty);
+
+        real cx_next = 1.0e-15;
+        real cy_next = 1.0e-15;
+        for (int y0 = 0; y0 < ny; y0 += tile) {
+            for (int x0 = 0; x0 < nx; x0 += tile) {
+                TileStats *s = nullptr;
+                if (cull >= 0) {
+                    s = &stats_[(y0/tile)*ntx + x0/tile];
+                    if (asleep_[(y0/tile)*ntx + x0/tile]) {
+                        sleep_tile(x0, y0, *s);
+                        cx_next = std::max(cx_next, s->cx);
+                        cy_next = std::max(cy_next, s->cy);
+                        ++tiles_skipped;
+                        continue;
+                    }
+                }
+
+                int nx_tile = std::min(tile, nx-x0) + 6*tbatch;
+                int ny_tile = std::min(tile, ny-y0) + 6*tbatch;
+                tile_.resize(nx_tile, ny_tile);
+
+                gather_tile(x0, y0);
+                advance_tile(tile_, nsteps, dt, dx, dy);
+                if (s) {
+                    s->cx = s->cy = 1.0e-15;
+                    s->synced = false;
+                    scatter_tile(x0, y0, s->cx, s->cy);
+                    measure_tile(w_, x0, y0, *s, false);
+                    cx_next = std::max(cx_next, s->cx);
+                    cy_next = std::max(cy_next, s->cy);
+                } else {
+                    scatter_tile(x0, y0, cx_next, cy_next);
+                }
+                ++tiles_run;
+            }
+        }
+        u_.swap(w_);
+        cx = cx_next;
+        cy = cy_next;
+
+        // Sum the steps one at a time, as the untiled loop does
+        for (int k = 0; k < 2*nsteps; ++k)
+            t += dt;
+    }
+}
+
+
 /**
  * ### Advance time
  * 
@@ -512,8 +1315,13 @@ void Central2D<Physics, Limiter>::compute_step(int io, real dt)
  */
 
 template <class Physics, class Limiter>
-void Central2D<Physics, Limiter>::run(real tfinal)
+void Central2D<Physics, Limiter, AoS>::run(real tfinal)
 {
+    if (tile) {
+        run_tiled(tfinal);
+        return;
+    }
+
     bool done = false;
     real t = 0;
     while (!done) {
@@ -521,8 +1329,12 @@ void Central2D<Physics, Limiter>::run(real tfinal)
         for (int io = 0; io < 2; ++io) {
             real cx, cy;
             apply_periodic();
-            compute_fg_speeds(cx, cy);
-            limited_derivs();
+            if (!fused) {
+                compute_fg_speeds(cx, cy);
+                limited_derivs();
+            } else if (io == 0) {
+                compute_wave_speeds(cx, cy);
+            }
             if (io == 0) {
                 dt = cfl / std::max(cx/dx, cy/dy);
                 if (t + 2*dt >= tfinal) {
@@ -530,7 +1342,10 @@ void Central2D<Physics, Limiter>::run(real tfinal)
                     done = true;
                 }
             }
-            compute_step(io, dt);
+            if (fused)
+                compute_step_fused(io, dt);
+            else
+                compute_step(io, dt);
             t += dt;
         }
     }
@@ -549,10 +1364,10 @@ void Central2D<Physics, Limiter>::run(real tfinal)
  */
 
 template <class Physics, class Limiter>
-void Central2D<Physics, Limiter>::solution_check()
+void Central2D<Physics, Limiter, AoS>::solution_check()
 {
     using namespace std;
-    real h_sum = 0, hu_sum = 0, hv_sum = 0;
+    accum h_sum = 0, hu_sum = 0, hv_sum = 0;
     real hmin = u(nghost,nghost)[0];
     real hmax = hmin;
     for (int j = nghost; j < ny+nghost; ++j)
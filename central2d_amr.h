@@ -0,0 +1,832 @@
+#ifndef CENTRAL2D_AMR_H
+#define CENTRAL2D_AMR_H
+
+#include <cstdio>
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "aligned_allocator.h"
+#include "local_state.h"
+#include "central2d.h"
+
+//ldoc on
+/**
+ * # Block-structured adaptive refinement
+ *
+ * This is the `AMR` specialization of the serial `Central2D` solver.
+ * A uniform `nx` by `ny` base grid is cut into blocks of `nb` by `nb`
+ * cells, and blocks where the solution is steep carry a *patch*: the
+ * same block refined by `ratio` in each direction.  In the dam break
+ * most of the domain is still water, so only the few blocks that the
+ * front passes through are refined at any time.
+ *
+ * Each block is advanced on its own, through the tile stages of the
+ * `AoS` solver (see "Temporally tiled kernel" in `central2d.h`): the
+ * block is gathered with ghost cells into a `LocalState`, stepped, and
+ * its interior written to a second copy of the grid.
+ *
+ *  - A coarse block takes one full step with ghost cells read from the
+ *    base grid.
+ *  - A refined block takes `ratio` full steps of `dt/ratio` on cells of
+ *    size `dx/ratio` (subcycling), so its CFL number is the coarse one.
+ *    It needs `3*ratio` fine ghost layers, which is three coarse cells,
+ *    filled once at the start of the coarse step: from neighbouring
+ *    patches where there are any, and otherwise by prolongation from
+ *    the base grid.  As with `nbatch` in the node solver, the fine
+ *    substeps then need no further exchange.
+ *
+ * Prolongation is piecewise linear, with the limited slopes of the
+ * `Limiter` class, so the fine cells of a coarse cell average to
+ * exactly its value and new minima or maxima are not created.
+ * Restriction replaces each coarse cell under a patch by the average of
+ * its fine cells after every step.  The base grid therefore always
+ * holds the conservative average of the composite solution; it is what
+ * `operator()` returns, what the output files see, and what coarse
+ * blocks read as ghost cells next to a patch.
+ *
+ * The coarse and fine updates at a coarse/fine interface are computed
+ * independently, so they move different amounts through it.  As in the
+ * node solver's local time stepping (see "Flux registers" in
+ * `central2d_pnode.h`), every block records the flow through each face
+ * of its edge over the step, in the flux form given there, and a coarse
+ * cell next to a patch then trades its own flow for the patch's.  Mass
+ * and momentum are conserved to rounding.
+ *
+ * Before every step a block is refined if any cell within `nbuffer`
+ * cells of it has a jump in $h$ to a neighbour larger than `tol*h`,
+ * and a patch is kept until no cell near it exceeds half of that.  New
+ * patches are filled by prolongation.
+ */
+
+template <class Physics, class Limiter>
+class Central2D<Physics, Limiter, AMR> {
+public:
+    typedef typename Physics::real  real;
+    typedef typename Physics::accum accum;   // Precision of long sums
+    typedef typename Physics::vec   vec;
+
+    Central2D(real w, real h,      // Domain width / height
+              int nx, int ny,      // Number of base cells in x/y
+              real cfl = 0.45f) :  // Max allowed CFL number
+        nx(nx), ny(ny),
+        dx(w/nx), dy(h/ny),
+        cfl(cfl),
+        u_(nx * ny),
+        w_(nx * ny),
+        ux_(nx * ny),
+        uy_(nx * ny),
+        tile_(0, 0) {
+        set_refinement(2, 16, 0.05f);
+    }
+
+    // Advance from time 0 to time tfinal
+    void run(real tfinal);
+
+    // Refine nb x nb blocks by ratio where a jump in h is > tol*h
+    void set_refinement(int ratio, int nb, real tol);
+
+    // Call f(Uxy, x, y) at each cell center to set initial conditions
+    template <typename F>
+    void init(F f);
+
+    // Diagnostics
+    void solution_check();
+
+    // Array size accessors (of the base grid)
+    int xsize() const { return nx; }
+    int ysize() const { return ny; }
+
+    // Read / write elements of the base grid
+    inline vec&       operator()(int i, int j)       { return u_[offset(i,j)]; }
+    inline const vec& operator()(int i, int j) const { return u_[offset(i,j)]; }
+
+private:
+    typedef Central2D<Physics, Limiter, AoS> Uniform;  // Owner of the tile stages
+
+    static constexpr int nghost  = 3;  // Ghost cells per full step
+    static constexpr int nbuffer = 2;  // Flag margin around steep cells
+
+    const int nx, ny;          // Number of base cells in x/y
+    const real dx, dy;         // Base cell size in x/y
+    const real cfl;            // Allowed CFL number
+
+    int  ratio;                // Fine cells per base cell in each direction
+    int  nb;                   // Block edge in base cells
+    real tol;                  // Refinement threshold on |jump in h|/h
+    int  nbx, nby;             // Number of blocks in x/y
+
+    typedef DEF_ALIGN(Physics::BYTE_ALIGN) std::vector<vec, aligned_allocator<vec, Physics::BYTE_ALIGN>> aligned_vector;
+
+    // Fine cells of one refined block, now and after the step
+    struct Patch {
+        Patch(int n) : u(n), w(n) {}
+        aligned_vector u;
+        aligned_vector w;
+    };
+
+    // Flow into +x/+y through each face of an edge over the step, in
+    // base cell values; part holds the ring of dual cells in flight
+    struct FluxRegister {
+        std::vector<vec> west, east, south, north;
+        std::vector<vec> part;
+    };
+
+    aligned_vector u_;         // Base grid (no ghost cells)
+    aligned_vector w_;         // Base grid after the step
+    aligned_vector ux_;        // Limited x slopes of u_ (for prolongation)
+    aligned_vector uy_;        // Limited y slopes of u_
+    std::vector< std::unique_ptr<Patch> > patches_; // Per block, null if coarse
+    std::vector<FluxRegister> registers_;           // Per block
+    LocalState<Physics> tile_; // The block in flight, with ghost cells
+    FluxRegister ring_;        // Edges of the interior of tile_
+
+    // Array accessor functions
+
+    inline int offset(int ix, int iy) const { return iy*nx+ix; }
+
+    inline vec& u(int ix, int iy) { return u_[offset(ix,iy)]; }
+
+    // Wrapped accessor (periodic BC)
+    inline vec& uwrap(int ix, int iy) {
+        return u_[offset( (ix % nx + nx) % nx, (iy % ny + ny) % ny )];
+    }
+
+    // Block geometry in base cells
+    inline int block_x0(int b) const { return (b % nbx) * nb; }
+    inline int block_y0(int b) const { return (b / nbx) * nb; }
+    inline int block_nx(int b) const { return std::min(nb, nx - block_x0(b)); }
+    inline int block_ny(int b) const { return std::min(nb, ny - block_y0(b)); }
+    inline int block_of(int ix, int iy) const { return (iy/nb)*nbx + ix/nb; }
+
+    // Fine cell (fx,fy) of the composite grid, wrapped, at the current time
+    void limited_slopes();
+    void fine_value(real *out, int fx, int fy);
+
+    // Stages of a coarse step
+    void regrid();
+    void compute_wave_speeds(real& cx, real& cy);
+    void advance_tile(int g, int nsteps, real dt, real dx, real dy);
+    void record_fluxes(int g, int io, real dt, real dx, real dy);
+    void advance_coarse(int x0, int y0, int nx_run, int ny_run, real dt);
+    void advance_fine(int b, real dt);
+    void restrict_patch(int b, const aligned_vector& fine, aligned_vector& coarse);
+    void correct_fluxes();
+
+};
+
+
+/**
+ * ## Setup
+ *
+ * Changing the block size or ratio drops all patches; the next regrid
+ * builds new ones from the base grid.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::set_refinement(int ratio, int nb, real tol)
+{
+    this->ratio = ratio > 0 ? ratio : 1;
+    this->nb    = nb > 0 ? nb : 16;
+    this->tol   = tol;
+    nbx = (nx + this->nb-1) / this->nb;
+    nby = (ny + this->nb-1) / this->nb;
+
+    patches_.clear();
+    patches_.resize(nbx * nby);
+    registers_.resize(nbx * nby);
+    for (int b = 0; b < nbx*nby; ++b) {
+        registers_[b].west .resize(block_ny(b));
+        registers_[b].east .resize(block_ny(b));
+        registers_[b].south.resize(block_nx(b));
+        registers_[b].north.resize(block_nx(b));
+    }
+
+    int nt = std::max(this->nb*this->ratio, nx) + 2*nghost*this->ratio;
+    tile_.resize(nt, nt);
+}
+
+/**
+ * ## Initialization
+ *
+ * The base grid is set at cell centers as usual.  Blocks that the
+ * initial data already flags are then refined and sampled again at the
+ * fine cell centers, and restricted back, so that a sharp initial front
+ * starts out resolved.
+ */
+
+template <class Physics, class Limiter>
+template <typename F>
+void Central2D<Physics, Limiter, AMR>::init(F f)
+{
+    for (int iy = 0; iy < ny; ++iy)
+        for (int ix = 0; ix < nx; ++ix)
+            f(u(ix,iy), (ix+0.5f)*dx, (iy+0.5f)*dy);
+
+    for (auto& p : patches_)
+        p.reset();
+    limited_slopes();
+    regrid();
+
+    real fdx = dx/ratio;
+    real fdy = dy/ratio;
+    for (int b = 0; b < nbx*nby; ++b) {
+        Patch *p = patches_[b].get();
+        if (!p)
+            continue;
+        int pw  = block_nx(b)*ratio;
+        int ph  = block_ny(b)*ratio;
+        int fx0 = block_x0(b)*ratio;
+        int fy0 = block_y0(b)*ratio;
+        for (int iy = 0; iy < ph; ++iy)
+            for (int ix = 0; ix < pw; ++ix)
+                f(p->u[iy*pw+ix], (fx0+ix+0.5f)*fdx, (fy0+iy+0.5f)*fdy);
+        restrict_patch(b, p->u, u_);
+    }
+}
+
+/**
+ * ## Prolongation and restriction
+ *
+ * A fine cell inside a patch is just read from it.  Anywhere else it is
+ * reconstructed from its base cell and the limited slopes there; the
+ * fine cell centers sit at offsets $((k+1/2)/r - 1/2)$ base cells from
+ * the base center, which sum to zero over the $r$ fine cells in each
+ * direction.  The slopes are taken once per step, since every base
+ * cell next to a patch is reconstructed many times over.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::limited_slopes()
+{
+    const int vs = Physics::vec_size;
+    auto slope = [&](real *du, int ix0, int iy0, int ixM, int iyM, int ixP, int iyP) {
+        const real *uM = u(ixM, iyM).data();
+        const real *u0 = u(ix0, iy0).data();
+        const real *uP = u(ixP, iyP).data();
+        for (int m = 0; m < vs; ++m)
+            du[m] = Limiter::limdiff(uM[m], u0[m], uP[m]);
+    };
+
+    // Row kernels away from the periodic seams, one cell at a time on them
+    for (int iy = 0; iy < ny; ++iy) {
+        Limiter::limdiff_row(ux_[offset(1,iy)].data(), u(1,iy).data(), (nx-2)*vs, vs);
+        slope(ux_[offset(0,iy)].data(),    0,    iy, nx-1, iy, 1, iy);
+        slope(ux_[offset(nx-1,iy)].data(), nx-1, iy, nx-2, iy, 0, iy);
+    }
+    for (int iy = 1; iy < ny-1; ++iy)
+        Limiter::limdiff_row(uy_[offset(0,iy)].data(), u(0,iy).data(), nx*vs, nx*vs);
+    for (int ix = 0; ix < nx; ++ix) {
+        slope(uy_[offset(ix,0)].data(),    ix, 0,    ix, ny-1, ix, 1);
+        slope(uy_[offset(ix,ny-1)].data(), ix, ny-1, ix, ny-2, ix, 0);
+    }
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::fine_value(real *out, int fx, int fy)
+{
+    const int nfx = nx*ratio;
+    const int nfy = ny*ratio;
+    fx = (fx % nfx + nfx) % nfx;
+    fy = (fy % nfy + nfy) % nfy;
+    int ix = fx / ratio;
+    int iy = fy / ratio;
+    int b  = block_of(ix, iy);
+
+    if (Patch *p = patches_[b].get()) {
+        int pw = block_nx(b)*ratio;
+        const real *src = p->u[(fy - block_y0(b)*ratio)*pw + fx - block_x0(b)*ratio].data();
+        for (int m = 0; m < Physics::vec_size; ++m)
+            out[m] = src[m];
+        return;
+    }
+
+    real ox = ((fx - ix*ratio) + 0.5f) / ratio - 0.5f;
+    real oy = ((fy - iy*ratio) + 0.5f) / ratio - 0.5f;
+    const real *u_xy  = u_[offset(ix,iy)].data();
+    const real *ux_xy = ux_[offset(ix,iy)].data();
+    const real *uy_xy = uy_[offset(ix,iy)].data();
+    for (int m = 0; m < Physics::vec_size; ++m)
+        out[m] = u_xy[m] + ox*ux_xy[m] + oy*uy_xy[m];
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::restrict_patch(int b, const aligned_vector& fine,
+                                                      aligned_vector& coarse)
+{
+    int pw = block_nx(b)*ratio;
+    accum scale = accum(1) / (ratio*ratio);
+    for (int iy = block_y0(b); iy < block_y0(b) + block_ny(b); ++iy)
+        for (int ix = block_x0(b); ix < block_x0(b) + block_nx(b); ++ix) {
+            accum sum[Physics::vec_size] = {};
+            int fx0 = (ix - block_x0(b))*ratio;
+            int fy0 = (iy - block_y0(b))*ratio;
+            for (int jy = 0; jy < ratio; ++jy)
+                for (int jx = 0; jx < ratio; ++jx) {
+                    const real *src = fine[(fy0+jy)*pw + fx0+jx].data();
+                    for (int m = 0; m < Physics::vec_size; ++m)
+                        sum[m] += src[m];
+                }
+            real *dst = coarse[offset(ix,iy)].data();
+            for (int m = 0; m < Physics::vec_size; ++m)
+                dst[m] = sum[m] * scale;
+        }
+}
+
+/**
+ * ## Regridding
+ *
+ * Cells are flagged by the largest one-sided difference in $h$ to
+ * their four neighbours: 2 if more than `tol*h` (refine), 1 if more
+ * than half that (keep refined).  The MinMod slope itself would be the
+ * natural choice, but it is zero on both sides of an isolated jump,
+ * which is exactly what most needs refining.  A
+ * block looks at its own cells and `nbuffer` more on each side, so a
+ * front cannot leave a patch before the next regrid.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::regrid()
+{
+    using namespace std;
+    std::vector<char> flag(nx*ny);
+    auto level_of = [&](int ix, int ixM1, int ixP1, int iy, int iyM1, int iyP1) {
+        real h = u(ix,iy)[0];
+        real s = max( max(fabs(u(ixP1,iy)[0] - h), fabs(h - u(ixM1,iy)[0])),
+                      max(fabs(u(ix,iyP1)[0] - h), fabs(h - u(ix,iyM1)[0])) );
+        return (char) ((s > tol*h) ? 2 : (s > 0.5f*tol*h) ? 1 : 0);
+    };
+    for (int iy = 0; iy < ny; ++iy) {
+        int iyM1 = iy > 0    ? iy-1 : ny-1;
+        int iyP1 = iy < ny-1 ? iy+1 : 0;
+        char *flag_y = &flag[offset(0,iy)];
+        flag_y[0]    = level_of(0,    nx-1, 1, iy, iyM1, iyP1);
+        flag_y[nx-1] = level_of(nx-1, nx-2, 0, iy, iyM1, iyP1);
+        for (int ix = 1; ix < nx-1; ++ix)
+            flag_y[ix] = level_of(ix, ix-1, ix+1, iy, iyM1, iyP1);
+    }
+
+    // Few cells are flagged, so push each one out to the blocks whose
+    // buffered range holds it rather than scanning every block's range
+    std::vector<char> block_level(nbx*nby);
+    for (int iy = 0; iy < ny; ++iy)
+        for (int ix = 0; ix < nx; ++ix) {
+            char level = flag[offset(ix,iy)];
+            if (!level)
+                continue;
+            for (int jy = iy-nbuffer; jy <= iy+nbuffer; ++jy)
+                for (int jx = ix-nbuffer; jx <= ix+nbuffer; ++jx) {
+                    int b = block_of((jx + nx) % nx, (jy + ny) % ny);
+                    block_level[b] = max(block_level[b], level);
+                }
+        }
+
+    for (int b = 0; b < nbx*nby; ++b) {
+        int level = block_level[b];
+        bool refine = (level == 2) || (level == 1 && patches_[b]);
+        if (refine && !patches_[b]) {
+            int pw  = block_nx(b)*ratio;
+            int ph  = block_ny(b)*ratio;
+            std::unique_ptr<Patch> p(new Patch(pw*ph));
+            for (int iy = 0; iy < ph; ++iy)
+                for (int ix = 0; ix < pw; ++ix)
+                    fine_value(p->u[iy*pw+ix].data(),
+                               block_x0(b)*ratio + ix, block_y0(b)*ratio + iy);
+            patches_[b] = std::move(p);
+        } else if (!refine && patches_[b]) {
+            patches_[b].reset();
+        }
+    }
+}
+
+/**
+ * ## Time stepper implementation
+ *
+ * ### Wave speeds
+ *
+ * A fine cell takes steps of `dt/ratio` over cells of `dx/ratio`, so
+ * its speed bounds the coarse `dt` exactly as a coarse cell's would.
+ * The bound is taken over the base cells of coarse blocks and the fine
+ * cells of patches.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::compute_wave_speeds(real& cx_, real& cy_)
+{
+    using namespace std;
+    STAGE_TIMER(STAGE_WAVE_SPEEDS, nx*ny);
+    real cx = 1.0e-15;
+    real cy = 1.0e-15;
+    for (int b = 0; b < nbx*nby; ++b) {
+        if (Patch *p = patches_[b].get()) {
+            for (auto& uxy : p->u) {
+                real cell_cx, cell_cy;
+                Physics::wave_speed(cell_cx, cell_cy, uxy.data());
+                cx = max(cx, cell_cx);
+                cy = max(cy, cell_cy);
+            }
+            continue;
+        }
+        for (int iy = block_y0(b); iy < block_y0(b) + block_ny(b); ++iy)
+            for (int ix = block_x0(b); ix < block_x0(b) + block_nx(b); ++ix) {
+                real cell_cx, cell_cy;
+                Physics::wave_speed(cell_cx, cell_cy, u(ix,iy).data());
+                cx = max(cx, cell_cx);
+                cy = max(cy, cell_cy);
+            }
+    }
+    cx_ = cx;
+    cy_ = cy;
+}
+
+/**
+ * ### Advancing a block
+ *
+ * Both kinds of block read only the current grids (`u_` and the
+ * patches' `u`) and write only the next ones (`w_` and the patches'
+ * `w`), so the blocks can go in any order.  A refined block also
+ * restricts its result into `w_`.  Neighbouring coarse blocks in a row
+ * are advanced together as one tile, which saves the ghost cells
+ * between them.
+ *
+ * The tile stages run one by one, so that each sub-step's flows through
+ * the edge of the interior can be recorded before the shift back onto
+ * `u` overwrites the cells they come from.  `g` is the number of ghost
+ * layers around the interior.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::advance_tile(int g, int nsteps, real dt,
+                                                    real dx, real dy)
+{
+    const int nxi = tile_.get_nx() - 2*g;
+    const int nyi = tile_.get_ny() - 2*g;
+    ring_.west .assign(nyi, vec());
+    ring_.east .assign(nyi, vec());
+    ring_.south.assign(nxi, vec());
+    ring_.north.assign(nxi, vec());
+    ring_.part.resize(4 * 2*(nxi + nyi + 2));
+
+    for (int step = 0; step < nsteps; ++step) {
+        for (int io = 0; io < 2; ++io) {
+            Uniform::tile_flux(tile_);
+            Uniform::tile_derivs(tile_);
+            Uniform::tile_step(tile_, io, dt, dx, dy);
+            record_fluxes(g, io, dt, dx, dy);
+            Uniform::tile_shift(tile_, io);
+        }
+    }
+}
+
+/**
+ * The flows are put in flux form exactly as by the node solver's
+ * `record_fluxes`: the even sub-step leaves each quarter's share of the
+ * dual cells on the ring, and the odd one completes the flows through
+ * the primal faces and adds them up in `ring_`.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::record_fluxes(int g, int io, real dt,
+                                                     real dx, real dy)
+{
+    LocalState<Physics>& L = tile_;
+    FluxRegister& reg = ring_;
+    const int nxi = L.get_nx() - 2*g;
+    const int nyi = L.get_ny() - 2*g;
+    const int nring = 2*(nxi + nyi + 2);
+    STAGE_TIMER(STAGE_FLUX_REGISTER, nring);
+
+    real dtcdx2 = 0.5f * dt / dx;
+    real dtcdy2 = 0.5f * dt / dy;
+
+    // Dual cell (i,j) has its center at the corner of primal cells
+    // (i,j) and (i+1,j+1).  Slots on the ring: west and east columns,
+    // then south and north rows.
+    auto ring = [&](int k, int& i, int& j) {
+        if (k < 2*(nyi+1)) {
+            i = (k < nyi+1) ? g-1 : g+nxi-1;
+            j = g-1 + k % (nyi+1);
+        } else {
+            k -= 2*(nyi+1);
+            j = (k < nxi+1) ? g-1 : g+nyi-1;
+            i = g-1 + k % (nxi+1);
+        }
+    };
+
+    if (io == 0) {
+        for (int k = 0; k < nring; ++k) {
+            int i, j;
+            ring(k, i, j);
+            vec* part = &reg.part[4*k];
+            for (int m = 0; m < Physics::vec_size; ++m) {
+                part[0][m] = -(0.25f*L.u(i,j)[m]     + 0.0625f*( L.ux(i,j)[m]     + L.uy(i,j)[m]))
+                             - (dtcdx2*L.f(i,j)[m]     + dtcdy2*L.g(i,j)[m]);
+                part[1][m] = -(0.25f*L.u(i+1,j)[m]   + 0.0625f*(-L.ux(i+1,j)[m]   + L.uy(i+1,j)[m]))
+                             - (-dtcdx2*L.f(i+1,j)[m]  + dtcdy2*L.g(i+1,j)[m]);
+                part[2][m] = -(0.25f*L.u(i,j+1)[m]   + 0.0625f*( L.ux(i,j+1)[m]   - L.uy(i,j+1)[m]))
+                             - (dtcdx2*L.f(i,j+1)[m]   - dtcdy2*L.g(i,j+1)[m]);
+            }
+        }
+        return;
+    }
+
+    // Flows out of the lower left quarter in x (a) and y (c), and into
+    // the upper right one in x (b) and y (e)
+    for (int k = 0; k < nring; ++k) {
+        int i, j;
+        ring(k, i, j);
+        vec* part = &reg.part[4*k];
+        const real *d    = L.u(i,j).data();
+        const real *d_dx = L.ux(i,j).data();
+        const real *d_dy = L.uy(i,j).data();
+        for (int m = 0; m < Physics::vec_size; ++m) {
+            real gain_mm = part[0][m] + 0.25f*d[m] - 0.0625f*(d_dx[m] + d_dy[m]);
+            real gain_pm = part[1][m] + 0.25f*d[m] + 0.0625f*(d_dx[m] - d_dy[m]);
+            real gain_mp = part[2][m] + 0.25f*d[m] - 0.0625f*(d_dx[m] - d_dy[m]);
+            real a = -gain_mm;
+            real b = -gain_mp;
+            real e = -gain_mm - gain_pm;
+            real s = -0.25f*(a - b + e);
+            part[0][m] = a + s;
+            part[1][m] = b - s;
+            part[2][m] = -s;
+            part[3][m] = e + s;
+        }
+    }
+
+    // Each face is half in the dual cell below (left) and half in the
+    // one above (right), plus the odd sub-step's flux through it
+    const vec* west  = &reg.part[0];
+    const vec* east  = &reg.part[4*(nyi+1)];
+    const vec* south = &reg.part[4*2*(nyi+1)];
+    const vec* north = &reg.part[4*(2*(nyi+1) + nxi+1)];
+    for (int r = 0; r < nyi; ++r) {
+        int j = g + r;
+        for (int m = 0; m < Physics::vec_size; ++m) {
+            reg.west[r][m] += west[4*r+1][m] + west[4*(r+1)][m]
+                            + dtcdx2*(L.f(g-1, j-1)[m] + L.f(g-1, j)[m]);
+            reg.east[r][m] += east[4*r+1][m] + east[4*(r+1)][m]
+                            + dtcdx2*(L.f(g+nxi-1, j-1)[m] + L.f(g+nxi-1, j)[m]);
+        }
+    }
+    for (int c = 0; c < nxi; ++c) {
+        int i = g + c;
+        for (int m = 0; m < Physics::vec_size; ++m) {
+            reg.south[c][m] += south[4*c+3][m] + south[4*(c+1)+2][m]
+                             + dtcdy2*(L.g(i-1, g-1)[m] + L.g(i, g-1)[m]);
+            reg.north[c][m] += north[4*c+3][m] + north[4*(c+1)+2][m]
+                             + dtcdy2*(L.g(i-1, g+nyi-1)[m] + L.g(i, g+nyi-1)[m]);
+        }
+    }
+}
+
+/**
+ * A coarse run hands the flows through its edge to the blocks it is
+ * made of; only the ends of the run have a west or east edge.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::advance_coarse(int x0, int y0, int nx_run, int ny_run, real dt)
+{
+    int nx_tile = nx_run + 2*nghost;
+    int ny_tile = ny_run + 2*nghost;
+    tile_.resize(nx_tile, ny_tile);
+
+    {
+        STAGE_TIMER(STAGE_COPY_TO_LOCAL, nx_tile*ny_tile);
+        for (int iy = 0; iy < ny_tile; ++iy) {
+            int gx = ((x0-nghost) % nx + nx) % nx;
+            int gy = ((y0+iy-nghost) % ny + ny) % ny;
+            for (int ix = 0; ix < nx_tile; ++ix) {
+                tile_.u(ix, iy) = u(gx, gy);
+                if (++gx == nx) gx = 0;
+            }
+        }
+    }
+
+    advance_tile(nghost, 1, dt, dx, dy);
+
+    registers_[block_of(x0, y0)].west          = ring_.west;
+    registers_[block_of(x0+nx_run-1, y0)].east = ring_.east;
+    for (int c = 0; c < nx_run; ++c) {
+        int b = block_of(x0+c, y0);
+        registers_[b].south[x0+c - block_x0(b)] = ring_.south[c];
+        registers_[b].north[x0+c - block_x0(b)] = ring_.north[c];
+    }
+
+    STAGE_TIMER(STAGE_COPY_FROM_LOCAL, nx_run*ny_run);
+    for (int iy = nghost; iy < ny_tile-nghost; ++iy)
+        for (int ix = nghost; ix < nx_tile-nghost; ++ix)
+            w_[offset(x0+ix-nghost, y0+iy-nghost)] = tile_.u(ix, iy);
+}
+
+/**
+ * A patch sums the flows through the `ratio` fine faces along each base
+ * face, scaled by the `1/ratio^2` that a fine cell weighs in the base
+ * cell under it.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::advance_fine(int b, real dt)
+{
+    Patch *p = patches_[b].get();
+    const int G  = nghost*ratio;
+    int pw  = block_nx(b)*ratio;
+    int ph  = block_ny(b)*ratio;
+    int fx0 = block_x0(b)*ratio;
+    int fy0 = block_y0(b)*ratio;
+    int nx_tile = pw + 2*G;
+    int ny_tile = ph + 2*G;
+    tile_.resize(nx_tile, ny_tile);
+
+    {
+        STAGE_TIMER(STAGE_COPY_TO_LOCAL, nx_tile*ny_tile);
+        for (int iy = 0; iy < ny_tile; ++iy)
+            for (int ix = 0; ix < nx_tile; ++ix) {
+                int lx = ix-G;
+                int ly = iy-G;
+                if (lx >= 0 && lx < pw && ly >= 0 && ly < ph)
+                    tile_.u(ix, iy) = p->u[ly*pw+lx];
+                else
+                    fine_value(tile_.u(ix, iy).data(), fx0+lx, fy0+ly);
+            }
+    }
+
+    advance_tile(G, ratio, dt/ratio, dx/ratio, dy/ratio);
+
+    {
+        FluxRegister& reg = registers_[b];
+        accum scale = accum(1) / (ratio*ratio);
+        auto coarsen = [&](std::vector<vec>& dst, const std::vector<vec>& src) {
+            for (size_t c = 0; c < dst.size(); ++c)
+                for (int m = 0; m < Physics::vec_size; ++m) {
+                    accum sum = 0;
+                    for (int k = 0; k < ratio; ++k)
+                        sum += src[c*ratio + k][m];
+                    dst[c][m] = sum * scale;
+                }
+        };
+        coarsen(reg.west,  ring_.west);
+        coarsen(reg.east,  ring_.east);
+        coarsen(reg.south, ring_.south);
+        coarsen(reg.north, ring_.north);
+    }
+
+    {
+        STAGE_TIMER(STAGE_COPY_FROM_LOCAL, pw*ph);
+        for (int iy = G; iy < ny_tile-G; ++iy)
+            for (int ix = G; ix < nx_tile-G; ++ix)
+                p->w[(iy-G)*pw + ix-G] = tile_.u(ix, iy);
+    }
+    restrict_patch(b, p->w, w_);
+}
+
+/**
+ * Once every block is through the step, a coarse block takes the flow
+ * through each of its edges from the patch across it, if there is
+ * one.  The patch side needs no correction: its own flows are the ones
+ * that the restriction already put into `w_`.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::correct_fluxes()
+{
+    for (int b = 0; b < nbx*nby; ++b) {
+        if (patches_[b])
+            continue;
+        const FluxRegister& reg = registers_[b];
+        const int x0 = block_x0(b), x1 = x0 + block_nx(b) - 1;
+        const int y0 = block_y0(b), y1 = y0 + block_ny(b) - 1;
+        STAGE_TIMER(STAGE_FLUX_REGISTER, 2*(block_nx(b) + block_ny(b)));
+
+        int bx = b % nbx;
+        int by = b / nbx;
+        int west  = by*nbx + (bx + nbx-1) % nbx;
+        int east  = by*nbx + (bx + 1) % nbx;
+        int south = ((by + nby-1) % nby)*nbx + bx;
+        int north = ((by + 1) % nby)*nbx + bx;
+
+        for (int r = 0; r < block_ny(b); ++r)
+            for (int m = 0; m < Physics::vec_size; ++m) {
+                if (patches_[west])
+                    w_[offset(x0, y0+r)][m] += registers_[west].east[r][m] - reg.west[r][m];
+                if (patches_[east])
+                    w_[offset(x1, y0+r)][m] -= registers_[east].west[r][m] - reg.east[r][m];
+            }
+        for (int c = 0; c < block_nx(b); ++c)
+            for (int m = 0; m < Physics::vec_size; ++m) {
+                if (patches_[south])
+                    w_[offset(x0+c, y0)][m] += registers_[south].north[c][m] - reg.south[c][m];
+                if (patches_[north])
+                    w_[offset(x0+c, y1)][m] -= registers_[north].south[c][m] - reg.north[c][m];
+            }
+    }
+}
+
+/**
+ * ### Advance time
+ *
+ * As in the other solvers, `run` takes coarse steps until `tfinal`,
+ * shortening the last one to land on it.  Each step regrids, bounds
+ * the wave speeds over the composite grid, advances every block,
+ * corrects the coarse side of the coarse/fine interfaces, and swaps the
+ * current and next grids.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::run(real tfinal)
+{
+    bool done = false;
+    real t = 0;
+    while (!done) {
+        limited_slopes();
+        regrid();
+
+        real cx, cy;
+        compute_wave_speeds(cx, cy);
+        real dt = cfl / std::max(cx/dx, cy/dy);
+        if (t + 2*dt >= tfinal) {
+            dt = (tfinal-t)/2;
+            done = true;
+        }
+
+        for (int by = 0; by < nby; ++by) {
+            for (int bx = 0; bx < nbx; ) {
+                int b = by*nbx + bx;
+                if (patches_[b]) {
+                    advance_fine(b, dt);
+                    ++bx;
+                    continue;
+                }
+                int bend = bx;
+                while (bend < nbx && !patches_[by*nbx + bend])
+                    ++bend;
+                int x0 = block_x0(b);
+                int x1 = block_x0(b + bend-bx-1) + block_nx(b + bend-bx-1);
+                advance_coarse(x0, block_y0(b), x1-x0, block_ny(b), dt);
+                bx = bend;
+            }
+        }
+
+        correct_fluxes();
+        u_.swap(w_);
+        for (auto& p : patches_)
+            if (p)
+                p->u.swap(p->w);
+        t += dt;
+        t += dt;
+    }
+}
+
+/**
+ * ### Diagnostics
+ *
+ * Volume and momentum are summed over the base grid, which holds the
+ * composite averages; the range of $h$ also covers the fine cells.  We
+ * report how much of the domain is refined as well.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, AMR>::solution_check()
+{
+    using namespace std;
+    accum h_sum = 0, hu_sum = 0, hv_sum = 0;
+    real hmin = u(0,0)[0];
+    real hmax = hmin;
+    for (int j = 0; j < ny; ++j)
+        for (int i = 0; i < nx; ++i) {
+            vec& uij = u(i,j);
+            real h = uij[0];
+            h_sum += h;
+            hu_sum += uij[1];
+            hv_sum += uij[2];
+            hmax = max(h, hmax);
+            hmin = min(h, hmin);
+            assert( h > 0) ;
+        }
+
+    int nrefined = 0;
+    for (auto& p : patches_) {
+        if (!p)
+            continue;
+        ++nrefined;
+        for (auto& uij : p->u) {
+            hmax = max(uij[0], hmax);
+            hmin = min(uij[0], hmin);
+            assert( uij[0] > 0 );
+        }
+    }
+
+    real cell_area = dx*dy;
+    h_sum *= cell_area;
+    hu_sum *= cell_area;
+    hv_sum *= cell_area;
+    printf("-\n  Volume: %g\n  Momentum: (%g, %g)\n  Range: [%g, %g]\n"
+           "  Refined: %d of %d blocks\n",
+           h_sum, hu_sum, hv_sum, hmin, hmax, nrefined, nbx*nby);
+}
+
+//ldoc off
+#endif /* CENTRAL2D_AMR_H */
@@ -0,0 +1,548 @@
+#ifndef CENTRAL2D_ENSEMBLE_H
+#define CENTRAL2D_ENSEMBLE_H
+
+#include <cstdio>
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+
+#include "aligned_allocator.h"
+#include "central2d.h"
+
+//ldoc on
+/**
+ * # Ensembles
+ *
+ * Parameter sweeps run hundreds of small, independent simulations.
+ * Each one alone is too small to keep a core busy: its rows are short,
+ * and loop overheads and latencies dominate.  The `Ensemble`
+ * specialization of the serial `Central2D` solver advances `nk` such
+ * runs (members) together on the same grid.  The numerical method is
+ * exactly the one in `central2d.h`, applied member by member.
+ *
+ * The member index is the innermost dimension.  Members come in blocks
+ * of `nkb`, one SIMD vector's worth.  Within a grid row of a block,
+ * each component is a run of `nx_all` cells of `nkb` members, and the
+ * components follow one another:
+ * component `m` of member `k` at cell `(ix,iy)` lives at
+ * `iy*row + m*plane + ix*nkb + k` from the start of its block, with
+ * `plane = nx_all*nkb` and `row = nfields*plane`.  All the members of a
+ * cell are therefore adjacent, and the row kernels of the `SoA` solver
+ * (`flux_row`, `limdiff_row`) work unchanged.  They see a row of
+ * `nx_all*nkb` "cells" whose $x$ neighbours are `nkb` apart and whose
+ * $y$ neighbours are `row` apart, so they vectorize across members
+ * even when the grid is small.
+ *
+ * Blocks keep the working set bounded.  One block holds as many arrays
+ * as `nkb` separate runs, which is still small enough to stay in cache
+ * for a sweep-sized grid; the whole ensemble usually is not.  Blocks
+ * are therefore advanced one after the other, each through the whole
+ * call to `run`.  The last block is padded out with copies of the last
+ * member, which take no steps.
+ *
+ * By default each member takes its own CFL-limited steps and stops on
+ * its own at `tfinal`, so it gets the same answer it would have got
+ * alone.  A member that has finished keeps riding along with its
+ * block, but its results are discarded until the others are done.
+ * With `set_shared_dt(true)`, every member takes the smallest of their
+ * steps, so all of them go through the same step sequence and finish
+ * together.  The blocks then have to move in step, and each half step
+ * sweeps the whole ensemble.
+ */
+
+template <class Physics, class Limiter>
+class Central2D<Physics, Limiter, Ensemble> {
+public:
+    typedef typename Physics::real  real;
+    typedef typename Physics::accum accum;   // Precision of long sums
+    typedef typename Physics::vec   vec;
+
+    Central2D(real w, real h,      // Domain width / height
+              int nx, int ny,      // Number of cells in x/y (without ghosts)
+              int nk,              // Number of members
+              real cfl = 0.45f) :  // Max allowed CFL number
+        nx(nx), ny(ny), nk(nk),
+        nkb(std::min(nk, nlanes)),
+        nblocks((nk + nkb-1) / nkb),
+        nx_all(nx + 2*nghost),
+        ny_all(ny + 2*nghost),
+        plane(nx_all * nkb),
+        row(nfields * plane),
+        block(ny_all * row),
+        dx(w/nx), dy(h/ny),
+        cfl(cfl),
+        u_ (nblocks * block),
+        f_ (nblocks * block),
+        g_ (nblocks * block),
+        ux_(nblocks * block),
+        uy_(nblocks * block),
+        fx_(nblocks * block),
+        gy_(nblocks * block),
+        v_ (nblocks * block),
+        shared_dt(false),
+        member(0),
+        cx_(nblocks * nkb), cy_(nblocks * nkb),
+        dt_(nblocks * nkb), t_(nblocks * nkb),
+        active_(nblocks * nkb), done_(nblocks * nkb),
+        cx_lane_(plane), cy_lane_(plane),
+        dtcdx2_(plane), dtcdy2_(plane),
+        keep_(plane) {}
+
+    // Advance every member from time 0 to time tfinal
+    void run(real tfinal);
+
+    // Advance all members with one (the smallest) time step
+    void set_shared_dt(bool on) { shared_dt = on; }
+
+    // Member seen by operator() and solution_check
+    void set_member(int k) { member = k; }
+
+    // Call f(Uxy, x, y) at each cell center to set initial conditions,
+    // for all members or for member k
+    template <typename F>
+    void init(F f);
+
+    template <typename F>
+    void init_member(int k, F f);
+
+    // Diagnostics
+    void solution_check();
+
+    // Array size accessors
+    int xsize() const { return nx; }
+    int ysize() const { return ny; }
+    int nmembers() const { return nk; }
+
+    // Read elements of the selected member (gathered from the rows)
+    inline vec operator()(int i, int j) const {
+        vec uij = {};
+        int o = offset(member, i+nghost, j+nghost);
+        for (int m = 0; m < nfields; ++m)
+            uij[m] = u_[o + m*plane];
+        return uij;
+    }
+
+private:
+    static constexpr int nghost  = 3;                                 // Number of ghost cells
+    static constexpr int nfields = Physics::nfields;                  // Components per cell
+    static constexpr int nlanes  = Physics::BYTE_ALIGN / sizeof(real); // Members per block
+
+    const int nx, ny;          // Number of (non-ghost) cells in x/y
+    const int nk;              // Number of members
+    const int nkb;             // Members per block
+    const int nblocks;         // Number of blocks
+    const int nx_all, ny_all;  // Total cells in x/y (including ghost)
+    const int plane;           // Distance between components in a row
+    const int row;             // Distance between rows
+    const int block;           // Distance between blocks
+    const real dx, dy;         // Cell size in x/y
+    const real cfl;            // Allowed CFL number
+
+    typedef DEF_ALIGN(Physics::BYTE_ALIGN) std::vector<real, aligned_allocator<real, Physics::BYTE_ALIGN>> aligned_vector;
+
+    aligned_vector u_;            // Solution values
+    aligned_vector f_;            // Fluxes in x
+    aligned_vector g_;            // Fluxes in y
+    aligned_vector ux_;           // x differences of u
+    aligned_vector uy_;           // y differences of u
+    aligned_vector fx_;           // x differences of f
+    aligned_vector gy_;           // y differences of g
+    aligned_vector v_;            // Solution values at next step
+
+    // Per-member time stepping (including the padding members)
+    bool shared_dt;               // Take the smallest step in every member?
+    int  member;                  // Member read by operator()
+    std::vector<real> cx_, cy_;   // Wave speed bounds
+    std::vector<real> dt_;        // Current (half) step
+    std::vector<real> t_;         // Time reached
+    std::vector<char> active_;    // Still stepping?
+    std::vector<char> done_;      // Taking its last step?
+
+    // The same per member quantities for one block, spread along a row
+    // so that loops over a row read them with the same index as the data
+    aligned_vector cx_lane_;      // Running wave speed maxima
+    aligned_vector cy_lane_;
+    aligned_vector dtcdx2_;       // Half step over twice the cell size
+    aligned_vector dtcdy2_;
+    std::vector<char> keep_;      // Copy the new state back?
+
+    // Offset of component 0 of member k at cell (ix,iy)
+    inline int offset(int k, int ix, int iy) const {
+        return (k/nkb)*block + iy*row + ix*nkb + k%nkb;
+    }
+
+    // Stages of the main algorithm, on block b
+    void apply_periodic(int b);
+    void compute_fg_speeds(int b);
+    void limited_derivs(int b);
+    void compute_step(int b, int io);
+
+    // Time loop over blocks [b0, b1)
+    void choose_dt(int b0, int b1, real tfinal);
+    void advance(int b0, int b1, real tfinal);
+
+};
+
+
+/**
+ * ## Initialization
+ *
+ * The callback fills a whole `vec`; we scatter it into the component
+ * runs of one member, or of all of them.  The last member is also
+ * copied into the padding of its block.
+ */
+
+template <class Physics, class Limiter>
+template <typename F>
+void Central2D<Physics, Limiter, Ensemble>::init_member(int k, F f)
+{
+    int k1 = (k == nk-1) ? nblocks*nkb : k+1;
+    for (int iy = 0; iy < ny; ++iy)
+        for (int ix = 0; ix < nx; ++ix) {
+            vec uxy = {};
+            f(uxy, (ix+0.5f)*dx, (iy+0.5f)*dy);
+            for (int kk = k; kk < k1; ++kk) {
+                int o = offset(kk, nghost+ix, nghost+iy);
+                for (int m = 0; m < nfields; ++m)
+                    u_[o + m*plane] = uxy[m];
+            }
+        }
+}
+
+template <class Physics, class Limiter>
+template <typename F>
+void Central2D<Physics, Limiter, Ensemble>::init(F f)
+{
+    for (int iy = 0; iy < ny; ++iy)
+        for (int ix = 0; ix < nx; ++ix) {
+            vec uxy = {};
+            f(uxy, (ix+0.5f)*dx, (iy+0.5f)*dy);
+            for (int b = 0; b < nblocks; ++b) {
+                int o = offset(b*nkb, nghost+ix, nghost+iy);
+                for (int m = 0; m < nfields; ++m)
+                    std::fill(&u_[o + m*plane], &u_[o + m*plane] + nkb, uxy[m]);
+            }
+        }
+}
+
+/**
+ * ## Time stepper implementation
+ *
+ * ### Boundary conditions
+ *
+ * The ghost columns of a component are `nghost*nkb` consecutive values,
+ * and the ghost rows are whole rows, so the periodic fill is nothing
+ * but block copies.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, Ensemble>::apply_periodic(int b)
+{
+    const int ng = nghost*nkb;
+    real *ub = &u_[b*block];
+
+    // Copy data between right and left boundaries
+    for (int iy = nghost; iy < ny+nghost; ++iy)
+        for (int m = 0; m < nfields; ++m) {
+            real *ur = ub + iy*row + m*plane;
+            std::copy(ur + nx*nkb, ur + nx*nkb + ng, ur);
+            std::copy(ur + ng,     ur + 2*ng,        ur + (nx+nghost)*nkb);
+        }
+
+    // Copy data between top and bottom boundaries
+    for (int iy = 0; iy < nghost; ++iy) {
+        std::copy(ub + (iy+ny)*row,     ub + (iy+ny+1)*row,     ub + iy*row);
+        std::copy(ub + (nghost+iy)*row, ub + (nghost+iy+1)*row, ub + (ny+nghost+iy)*row);
+    }
+}
+
+
+/**
+ * ### Initial flux and speed computations
+ *
+ * Fluxes go a row at a time through the physics' row function.  The
+ * speed bounds are per member, so instead of a single running maximum
+ * we keep one per position in a row, and fold the positions of each
+ * member together at the end.  Every loop then runs the length of a
+ * row, however few members there are.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, Ensemble>::compute_fg_speeds(int b)
+{
+    using namespace std;
+    real *cx = cx_lane_.data();
+    real *cy = cy_lane_.data();
+    std::fill(cx, cx + plane, real(1.0e-15));
+    std::fill(cy, cy + plane, real(1.0e-15));
+    for (int iy = 0; iy < ny_all; ++iy) {
+        int o = b*block + iy*row;
+        const real *ur = &u_[o];
+        Physics::flux_row(&f_[o], &g_[o], ur, plane, plane);
+        #pragma omp simd
+        for (int j = 0; j < plane; ++j) {
+            real cell_cx, cell_cy;
+            Physics::wave_speed(cell_cx, cell_cy, ur+j, plane);
+            cx[j] = max(cx[j], cell_cx);
+            cy[j] = max(cy[j], cell_cy);
+        }
+    }
+
+    for (int k = 0; k < nkb; ++k) {
+        real cxk = cx[k];
+        real cyk = cy[k];
+        for (int ix = 1; ix < nx_all; ++ix) {
+            cxk = max(cxk, cx[ix*nkb+k]);
+            cyk = max(cyk, cy[ix*nkb+k]);
+        }
+        cx_[b*nkb+k] = cxk;
+        cy_[b*nkb+k] = cyk;
+    }
+}
+
+/**
+ * ### Derivatives with limiters
+ *
+ * One limiter call per component and direction covers a whole row of
+ * the block.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, Ensemble>::limited_derivs(int b)
+{
+    const int n = (nx_all-2)*nkb;
+    for (int iy = 1; iy < ny_all-1; ++iy)
+        for (int m = 0; m < nfields; ++m) {
+            int o = b*block + iy*row + m*plane + nkb;
+            Limiter::limdiff_row(&ux_[o], &u_[o], n, nkb);
+            Limiter::limdiff_row(&fx_[o], &f_[o], n, nkb);
+            Limiter::limdiff_row(&uy_[o], &u_[o], n, row);
+            Limiter::limdiff_row(&gy_[o], &g_[o], n, row);
+        }
+}
+
+
+/**
+ * ### Advancing a time step
+ *
+ * The predictor and corrector are those of the `SoA` solver, run along
+ * whole rows, with the step lengths read per position.  Members that
+ * have already finished are computed with a zero step but are not
+ * copied back, so their state stays put.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, Ensemble>::compute_step(int b, int io)
+{
+    real *dtcdx2 = dtcdx2_.data();
+    real *dtcdy2 = dtcdy2_.data();
+    bool all_active = true;
+    for (int k = 0; k < nkb; ++k) {
+        real dt = dt_[b*nkb+k];
+        all_active = all_active && active_[b*nkb+k];
+        for (int ix = 0; ix < nx_all; ++ix) {
+            dtcdx2[ix*nkb+k] = 0.5f * dt / dx;
+            dtcdy2[ix*nkb+k] = 0.5f * dt / dy;
+            keep_[ix*nkb+k]  = active_[b*nkb+k];
+        }
+    }
+
+    // Predictor (flux values of f and g at half step)
+    for (int iy = 1; iy < ny_all-1; ++iy)
+        for (int m = 0; m < nfields; ++m) {
+            int o = b*block + iy*row + m*plane;
+            const real *um  = &u_[o];
+            const real *fxm = &fx_[o];
+            const real *gym = &gy_[o];
+            real *uh = &v_[o];
+
+            #pragma omp simd
+            for (int j = nkb; j < (nx_all-1)*nkb; ++j) {
+                real uhj = um[j];
+                uhj -= dtcdx2[j] * fxm[j];
+                uhj -= dtcdy2[j] * gym[j];
+                uh[j] = uhj;
+            }
+        }
+
+    for (int iy = 1; iy < ny_all-1; ++iy) {
+        int o = b*block + iy*row + nkb;
+        Physics::flux_row(&f_[o], &g_[o], &v_[o], (nx_all-2)*nkb, plane);
+    }
+
+    // Corrector (finish the step)
+    for (int iy = nghost-io; iy < ny+nghost-io; ++iy)
+        for (int m = 0; m < nfields; ++m) {
+            int o = b*block + iy*row + m*plane;
+            const real *u0  = &u_[o],  *u1  = &u_[o+row];    // Rows iy, iy+1
+            const real *ux0 = &ux_[o], *ux1 = &ux_[o+row];
+            const real *uy0 = &uy_[o], *uy1 = &uy_[o+row];
+            const real *f0  = &f_[o],  *f1  = &f_[o+row];
+            const real *g0  = &g_[o],  *g1  = &g_[o+row];
+            real *vm = &v_[o];
+
+            #pragma omp simd
+            for (int j = (nghost-io)*nkb; j < (nx+nghost-io)*nkb; ++j) {
+                int j1 = j+nkb;  // Next cell in x
+                vm[j] =
+                    0.2500f * ( accum(u0[j])  + u0[j1]    +
+                                       u1[j]  + u1[j1]  ) -
+                    0.0625f * ( accum(ux0[j1]) - ux0[j]   +
+                                       ux1[j1] - ux1[j]   +
+                                       uy1[j]  - uy0[j]   +
+                                       uy1[j1] - uy0[j1] ) -
+                    dtcdx2[j] * ( accum(f0[j1]) - f0[j]   +
+                                         f1[j1] - f1[j] ) -
+                    dtcdy2[j] * ( accum(g1[j])  - g0[j]   +
+                                         g1[j1] - g0[j1] );
+            }
+        }
+
+    // Copy from v storage back to main grid, skipping finished members
+    const char *keep = keep_.data();
+    for (int iy = nghost; iy < ny+nghost; ++iy)
+        for (int m = 0; m < nfields; ++m) {
+            real *urow       = &u_[b*block + iy*row + m*plane + nghost*nkb];
+            const real *vrow = &v_[b*block + (iy-io)*row + m*plane + (nghost-io)*nkb];
+            if (all_active) {
+                std::copy(vrow, vrow + nx*nkb, urow);
+                continue;
+            }
+            for (int j = 0; j < nx*nkb; ++j)
+                if (keep[j])
+                    urow[j] = vrow[j];
+        }
+}
+
+
+/**
+ * ### Choosing the time step
+ *
+ * Each active member picks its step from its own speed bound and
+ * shortens its last step to land on `tfinal`, as the other drivers do.
+ * With a shared step, every member takes the smallest of these.  They
+ * started together and stay together, so they all finish on the same
+ * step.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, Ensemble>::choose_dt(int b0, int b1, real tfinal)
+{
+    real dt_min = 0;
+    for (int k = b0*nkb; k < b1*nkb; ++k) {
+        dt_[k] = 0;
+        if (!active_[k])
+            continue;
+        dt_[k] = cfl / std::max(cx_[k]/dx, cy_[k]/dy);
+        if (dt_min == 0 || dt_[k] < dt_min)
+            dt_min = dt_[k];
+    }
+
+    for (int k = b0*nkb; k < b1*nkb; ++k) {
+        if (!active_[k])
+            continue;
+        if (shared_dt)
+            dt_[k] = dt_min;
+        if (t_[k] + 2*dt_[k] >= tfinal) {
+            dt_[k] = (tfinal-t_[k])/2;
+            done_[k] = true;
+        }
+    }
+}
+
+
+/**
+ * ### Advance time
+ *
+ * The `AoS` driver loop, run on a range of blocks until their last
+ * member is done: one block at a time with separate steps, or all of
+ * them together with a shared step.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, Ensemble>::advance(int b0, int b1, real tfinal)
+{
+    int nactive = std::count(&active_[b0*nkb], &active_[b1*nkb], 1);
+    while (nactive) {
+        for (int io = 0; io < 2; ++io) {
+            for (int b = b0; b < b1; ++b) {
+                apply_periodic(b);
+                compute_fg_speeds(b);
+            }
+            if (io == 0)
+                choose_dt(b0, b1, tfinal);
+            for (int b = b0; b < b1; ++b) {
+                limited_derivs(b);
+                compute_step(b, io);
+            }
+            for (int k = b0*nkb; k < b1*nkb; ++k)
+                t_[k] += dt_[k];
+        }
+        for (int k = b0*nkb; k < b1*nkb; ++k)
+            if (active_[k] && done_[k]) {
+                active_[k] = false;
+                --nactive;
+            }
+    }
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, Ensemble>::run(real tfinal)
+{
+    std::fill(t_.begin(), t_.end(), real(0));
+    std::fill(done_.begin(), done_.end(), 0);
+    for (int k = 0; k < nblocks*nkb; ++k)
+        active_[k] = k < nk;
+
+    if (shared_dt) {
+        advance(0, nblocks, tfinal);
+        return;
+    }
+    for (int b = 0; b < nblocks; ++b)
+        advance(b, b+1, tfinal);
+}
+
+/**
+ * ### Diagnostics
+ *
+ * The usual checks for the selected member, and the range of $h$ over
+ * the whole ensemble.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter, Ensemble>::solution_check()
+{
+    using namespace std;
+    accum h_sum = 0, hu_sum = 0, hv_sum = 0;
+    real hmin = u_[offset(member, nghost, nghost)];
+    real hmax = hmin;
+    real hmin_all = hmin;
+    real hmax_all = hmin;
+    for (int j = nghost; j < ny+nghost; ++j)
+        for (int i = nghost; i < nx+nghost; ++i) {
+            const real *u_ij = &u_[offset(member, i, j)];
+            real h = u_ij[0];
+            h_sum += h;
+            hu_sum += u_ij[plane];
+            hv_sum += u_ij[2*plane];
+            hmax = max(h, hmax);
+            hmin = min(h, hmin);
+            for (int k = 0; k < nk; ++k) {
+                real hk = u_[offset(k, i, j)];
+                hmax_all = max(hk, hmax_all);
+                hmin_all = min(hk, hmin_all);
+                assert( hk > 0 );
+            }
+        }
+    real cell_area = dx*dy;
+    h_sum *= cell_area;
+    hu_sum *= cell_area;
+    hv_sum *= cell_area;
+    printf("-\n  Volume: %g\n  Momentum: (%g, %g)\n  Range: [%g, %g]\n"
+           "  Ensemble range: [%g, %g]\n",
+           h_sum, hu_sum, hv_sum, hmin, hmax, hmin_all, hmax_all);
+}
+
+//ldoc off
+#endif /* CENTRAL2D_ENSEMBLE_H */
@@ -7,6 +7,7 @@
 #include <cassert>
 #include <vector>
 #include <memory>
+#include <cstdint>
 #include <omp.h>
 
 #include "local_state.h"
@@ -15,6 +16,9 @@
 #ifndef __MIC__
     #include "aligned_allocator.h"// aligned allocator is invalid on the phi :/
 #endif
+#ifndef __INTEL_OFFLOAD
+    #include "offload.h"
+#endif
 
 //ldoc on
 /**
@@ -127,8 +131,9 @@
 template <class Physics, class Limiter>
 class Central2D {
 public:
-    typedef typename Physics::real real;
-    typedef typename Physics::vec  vec;
+    typedef typename Physics::real  real;
+    typedef typename Physics::accum accum;   // Precision of long sums
+    typedef typename Physics::vec   vec;
 
     Central2D(real w, real h,      // Domain width / height
               int nx, int ny,      // Number of cells in x/y (without ghosts)
@@ -137,7 +142,7 @@ public:
               int nbatch = 1,      // Number of timesteps to batch per block
               real cfl = 0.45f) :  // Max allowed CFL number
         nx(nx), ny(ny), nxblocks(nxblocks), nyblocks(nyblocks),
-        nbatch(nbatch), nghost(1+nbatch*2), // Number of ghost cells depend on batch size
+        nbatch(nbatch), nghost(3*nbatch), // Three ghost cells per batched step
         nx_all(nx + 2*nghost),
         ny_all(ny + 2*nghost),
         nthreads(nxblocks*nyblocks),
@@ -145,9 +150,21 @@ public:
         cfl(cfl),
         u_(nx_all * ny_all) {}
 
+    // The device session belongs to exactly one simulator
+    Central2D(const Central2D&) = delete;
+    Central2D& operator=(const Central2D&) = delete;
+
+    ~Central2D() { end_session(); }
+
     // Advance from time 0 to time tfinal
     void run(real tfinal, int iter, int num_iters);
 
+    // Wall time spent moving data to/from the device and computing there;
+    // the exposed part of the transfers is what no kernel ran alongside
+    double transfer_time() const { return transfer_seconds; }
+    double exposed_transfer_time() const { return exposed_seconds; }
+    double compute_time()  const { return compute_seconds; }
+
     // Call f(Uxy, x, y) at each cell center to set initial conditions
     template <typename F>
     void init(F f);
@@ -175,6 +192,7 @@ private:
         int nghost;
         int nx, ny;
         int nxblocks, nyblocks;
+        int nx_block, ny_block;
         int nbatch;
         int nthreads;
         int nx_all, ny_all;
@@ -200,9 +218,41 @@ private:
         aligned_vector u_;
     #endif
 
+    // Everything that stays on the device from the first frame to the
+    // last.  The host only holds its address, as an opaque handle.
+    typedef struct {
+        Parameters params;
+        std::vector<LocalState<Physics>*> locals;
+    } Session;
+
+    uintptr_t session_ = 0;                 // Device address of the Session
+    #ifndef __INTEL_OFFLOAD
+        offload::DeviceBuffer<real> u_dev_;   // Device copy of u_
+        offload::DeviceBuffer<real> u_frame_; // Last frame, on its way back
+        std::thread ahead_;                   // Next frame's kernel, run early
+        real   ahead_tfinal_  = 0;            // Interval it was run for
+        double ahead_seconds_ = 0;            // How long it took
+        double ahead_copy_    = 0;            // Download that ran beside it
+    #endif
+
+    double transfer_seconds = 0;
+    double exposed_seconds  = 0;
+    double compute_seconds  = 0;
+
+    Parameters make_params() const;
+
+    // Host side of the session: set up on the device / tear down
+    void begin_session();
+    void end_session();
+
+    #ifndef __INTEL_OFFLOAD
+        // Run the kernel on the device copy; returns the seconds taken
+        double launch(uintptr_t handle, real *u_device, real tfinal);
+    #endif
+
     // Array accessor function
     TARGET_MIC
-    inline int offset(Parameters &params, int ix, int iy) const {
+    static inline int offset(Parameters &params, int ix, int iy) {
         return iy*params.nx_all+ix;
     }
 
@@ -210,7 +260,7 @@ private:
 
     // Wrapped accessor (periodic BC)
     TARGET_MIC
-    inline int ioffset(Parameters &params, int ix, int iy) {
+    static inline int ioffset(Parameters &params, int ix, int iy) {
         return offset( params,
                        (ix+params.nx-params.nghost) % params.nx + params.nghost,
                        (iy+params.ny-params.nghost) % params.ny + params.nghost );
@@ -218,7 +268,7 @@ private:
 
     // Initialize per-thread local state inside of offloaded kernel
     TARGET_MIC
-    void init_locals(Parameters &params, std::vector<LocalState<Physics>*> &locals);
+    static void init_locals(Parameters &params, std::vector<LocalState<Physics>*> &locals);
 
     // Apply limiter to all components in a vector
     #pragma omp declare simd
@@ -234,16 +284,24 @@ private:
             du[m] = Limiter::limdiff(um[m], u0[m], up[m]);
     }
 
-    // Stages of the main algorithm
-    TARGET_MIC void apply_periodic(Parameters &params, real* u);
-    TARGET_MIC void compute_wave_speeds(Parameters &params, real& cx, real& cy, real *u);
-    TARGET_MIC void compute_flux(Parameters &params, LocalState<Physics> *local);
-    TARGET_MIC void limited_derivs(Parameters &params, LocalState<Physics> *local);
-    TARGET_MIC void compute_step(Parameters &params, LocalState<Physics> *local, int io, real dt);
+    // Stages of the main algorithm.  These only see the parameters and
+    // device pointers, never the host object, so they are static.
+    TARGET_MIC static void apply_periodic(Parameters &params, real* u);
+    TARGET_MIC static void compute_wave_speeds(Parameters &params, real& cx, real& cy, real *u);
+    TARGET_MIC static void compute_flux(Parameters &params, LocalState<Physics> *local);
+    TARGET_MIC static void limited_derivs(Parameters &params, LocalState<Physics> *local);
+    TARGET_MIC static void compute_step(Parameters &params, LocalState<Physics> *local, int io, real dt);
 
     // Copy data to and from local buffers
-    TARGET_MIC void copy_to_local(Parameters &params, LocalState<Physics> *local, int tid, real *u);
-    TARGET_MIC void copy_from_local(Parameters &params, LocalState<Physics> *local, int tid, real *u);
+    TARGET_MIC static void copy_to_local(Parameters &params, LocalState<Physics> *local, int tid, real *u);
+    TARGET_MIC static void copy_from_local(Parameters &params, LocalState<Physics> *local, int tid, real *u);
+
+    // Device side of the session
+    TARGET_MIC static uintptr_t open_session(Parameters &params);
+    TARGET_MIC static void close_session(uintptr_t handle);
+
+    // Advance the device copy of the solution by tfinal
+    TARGET_MIC static void device_run(uintptr_t handle, real *u, real tfinal);
 
 };
 
@@ -274,8 +332,8 @@ template <class Physics, class Limiter>
 void Central2D<Physics, Limiter>::init_locals(Parameters &params, std::vector<LocalState<Physics>*> &locals)
 {
     // Dimensions of block assigned to each thread
-    int nx_per_block = ceil(params.nx / (real)params.nxblocks);
-    int ny_per_block = ceil(params.ny / (real)params.nyblocks);
+    int nx_per_block = params.nx_block;
+    int ny_per_block = params.ny_block;
 
     // Number of elements beyond grid boundary if block dimensions do
     // not evenly divide the grid dimensions.
@@ -479,6 +537,10 @@ void Central2D<Physics, Limiter>::limited_derivs(Parameters &params, LocalState<
  * in each direction.  Every other step, we shift things back by one
  * mesh cell in each direction, essentially resetting to the primary
  * indexing scheme.
+ *
+ * As in the node solver, every cell with a full stencil is advanced,
+ * ghost cells included, so that the ghosts stay valid through a batch;
+ * each full step eats three ghost layers.
  */
 
 template <class Physics, class Limiter>
@@ -517,8 +579,8 @@ void Central2D<Physics, Limiter>::compute_step(Parameters &params, LocalState<Ph
     }
 
     // Corrector (finish the step)
-    for (int iy = params.nghost-io; iy < ny_per_block-params.nghost-io; ++iy) {
-        for (int ix = params.nghost-io; ix < nx_per_block-params.nghost-io; ++ix) {
+    for (int iy = 1; iy < ny_per_block-2; ++iy) {
+        for (int ix = 1; ix < nx_per_block-2; ++ix) {
             /* Nomenclature:
              *     u_x0_y0 <- u(ix  , iy  )
              *     u_x1_y0 <- u(ix+1, iy  )
@@ -561,23 +623,23 @@ void Central2D<Physics, Limiter>::compute_step(Parameters &params, LocalState<Ph
             #pragma simd
             for(int m = 0; m < Physics::vec_size; ++m) {
                 v_ix_iy[m] =
-                    0.2500f * ( u_x0_y0[m]  + u_x1_y0[m]    +
-                                u_x0_y1[m]  + u_x1_y1[m]  ) -
-                    0.0625f * ( ux_x1_y0[m] - ux_x0_y0[m]   +
-                                ux_x1_y1[m] - ux_x0_y1[m]   +
-                                uy_x0_y1[m] - uy_x0_y0[m]   +
-                                uy_x1_y1[m] - uy_x1_y0[m] ) -
-                    dtcdx2  * ( f_x1_y0[m]  - f_x0_y0[m]    +
-                                f_x1_y1[m]  - f_x0_y1[m]  ) -
-                    dtcdy2  * ( g_x0_y1[m]  - g_x0_y0[m]    +
-                                g_x1_y1[m]  - g_x1_y0[m]  );                    
+                    0.2500f * ( accum(u_x0_y0[m])  + u_x1_y0[m]    +
+                                       u_x0_y1[m]  + u_x1_y1[m]  ) -
+                    0.0625f * ( accum(ux_x1_y0[m]) - ux_x0_y0[m]   +
+                                       ux_x1_y1[m] - ux_x0_y1[m]   +
+                                       uy_x0_y1[m] - uy_x0_y0[m]   +
+                                       uy_x1_y1[m] - uy_x1_y0[m] ) -
+                    dtcdx2  * ( accum(f_x1_y0[m])  - f_x0_y0[m]    +
+                                       f_x1_y1[m]  - f_x0_y1[m]  ) -
+                    dtcdy2  * ( accum(g_x0_y1[m])  - g_x0_y0[m]    +
+                                       g_x1_y1[m]  - g_x1_y0[m]  );                    
             }
         }
     }
 
     // Copy from v storage back to main grid
-    for (int j = params.nghost; j < ny_per_block-params.nghost; ++j) {
-        for (int i = params.nghost; i < nx_per_block-params.nghost; ++i) {
+    for (int j = 1+io; j < ny_per_block-2+io; ++j) {
+        for (int i = 1+io; i < nx_per_block-2+io; ++i) {
             real *u_ij    = local->u(i, j).data();       USE_ALIGN(u_ij,     Physics::VEC_ALIGN );
             real *v_ij_io = local->v(i-io, j-io).data(); USE_ALIGN(v_ij_io,  Physics::VEC_ALIGN );
 
@@ -596,6 +658,9 @@ void Central2D<Physics, Limiter>::compute_step(Parameters &params, LocalState<Ph
  * vectors are copied to the per-thread local buffers. Before the next
  * synchronization point, each thread copies its locally updated
  * solutions to the global solution vectors.
+ *
+ * Block offsets are in units of a full block's interior, since the
+ * last block in each direction may be short.
  */
 
 template <class Physics, class Limiter>
@@ -608,8 +673,8 @@ void Central2D<Physics, Limiter>::copy_to_local(Parameters &params, LocalState<P
 
     int biy     = tid / params.nxblocks;
     int bix     = tid % params.nxblocks;
-    int biy_off = biy * (ny_per_block - 2*params.nghost);
-    int bix_off = bix * (nx_per_block - 2*params.nghost);
+    int biy_off = biy * params.ny_block;
+    int bix_off = bix * params.nx_block;
 
     for (int iy = 0; iy < ny_per_block; ++iy) {
         for (int ix = 0; ix < nx_per_block; ++ix) {
@@ -633,8 +698,8 @@ void Central2D<Physics, Limiter>::copy_from_local(Parameters &params, LocalState
 
     int biy     = tid / params.nxblocks;
     int bix     = tid % params.nxblocks;
-    int biy_off = biy * (ny_per_block - 2*params.nghost);
-    int bix_off = bix * (nx_per_block - 2*params.nghost);
+    int biy_off = biy * params.ny_block;
+    int bix_off = bix * params.nx_block;
 
     for (int iy = params.nghost; iy < ny_per_block - params.nghost; ++iy) {
         for (int ix = params.nghost; ix < nx_per_block - params.nghost; ++ix) {
@@ -663,98 +728,265 @@ void Central2D<Physics, Limiter>::copy_from_local(Parameters &params, LocalState
  */
 
 template <class Physics, class Limiter>
-void Central2D<Physics, Limiter>::run(real tfinal, int iter, int num_iters)
+typename Central2D<Physics, Limiter>::Parameters
+Central2D<Physics, Limiter>::make_params() const
 {
-    // Offload computation to MIC
+    Parameters params;
+    params.nghost   = nghost;
+    params.nx       = nx;
+    params.ny       = ny;
+    params.nxblocks = nxblocks;
+    params.nyblocks = nyblocks;
+    params.nx_block = ceil(nx / (real)nxblocks);
+    params.ny_block = ceil(ny / (real)nyblocks);
+    params.nbatch   = nbatch;
+    params.nthreads = nthreads;
+    params.nx_all   = nx_all;
+    params.ny_all   = ny_all;
+    params.dx       = dx;
+    params.dy       = dy;
+    params.cfl      = cfl;
+    return params;
+}
 
+/**
+ * ### Device session
+ *
+ * The block buffers and parameters live on the device for the whole
+ * simulation: `begin_session` copies the initial state over and builds
+ * them on the first frame, and `end_session` frees them after the last
+ * (or when the simulator goes away).  In between, a frame is one kernel
+ * launch plus one copy of the result back to the host; the device copy
+ * of the solution is the master and is never uploaded again.
+ *
+ * With the Intel offload compiler, each step is its own offload region
+ * and the solution buffer is kept alive across regions with
+ * `alloc_if`/`free_if`.  Elsewhere, the offload layer provides the
+ * buffers and the transfers, and the kernels run in OpenMP `target`
+ * regions when that backend is selected.  Transfer and kernel times are
+ * accumulated separately, so the cost of the copies can be read off
+ * next to the compute time.
+ *
+ * The offload layer also lets the copy back overlap with computation.
+ * At the end of a frame the solution is first copied to a second
+ * buffer on the device; the download then reads that snapshot while
+ * the next frame's kernel is already running on the live copy, on the
+ * assumption that the next `run` asks for the same interval (as the
+ * driver does).  The next `run` just collects that kernel, or, if the
+ * interval differs, restores the snapshot and runs the kernel again.
+ * The part of each download that outlasts the kernel running beside it
+ * is exposed; the rest was hidden behind the kernel.
+ */
+
+template <class Physics, class Limiter>
+uintptr_t Central2D<Physics, Limiter>::open_session(Parameters &params)
+{
+    Session *session = new Session;
+    session->params = params;
+    init_locals(session->params, session->locals);
+    return reinterpret_cast<uintptr_t>(session);
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::close_session(uintptr_t handle)
+{
+    Session *session = reinterpret_cast<Session*>(handle);
+    for (auto local : session->locals) delete local;
+    delete session;
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::begin_session()
+{
+    Parameters params = make_params();
     real *u_offload      = reinterpret_cast<real*>(u_.data()); USE_ALIGN(u_offload, Physics::BYTE_ALIGN);
     int   u_offload_size = u_.size() * Physics::vec_size;
+    uintptr_t handle;
+
+#ifdef __INTEL_OFFLOAD
+    double t0 = omp_get_wtime();
+    #pragma offload target(mic:0) in(params) out(handle) \
+                                  in(u_offload : length(u_offload_size) alloc_if(1) free_if(0))
+    handle = open_session(params);
+    transfer_seconds += omp_get_wtime() - t0;
+    exposed_seconds  += omp_get_wtime() - t0;
+#else
+    u_dev_.resize(u_offload_size);
+    u_frame_.resize(u_offload_size);
+    double copy_seconds = u_dev_.upload(u_offload, u_offload_size);
+    transfer_seconds += copy_seconds;
+    exposed_seconds  += copy_seconds;
+
+    #ifdef _OFFLOAD_OMP_TARGET
+        #pragma omp target map(to: params) map(from: handle) device(offload::device())
+    #endif
+    handle = open_session(params);
+#endif
+    session_ = handle;
+}
 
-    bool first_iter = iter == 0;
-    bool last_iter  = iter == num_iters-1;
-    int init  = first_iter ? 1 : 0;
-    int destroy = last_iter ? 1 : 0;
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::end_session()
+{
+    if (!session_)
+        return;
+    uintptr_t handle = session_;
 
-    #pragma offload target(mic:0) in(nghost) in(nx) in(ny) in(nxblocks) in(nyblocks) \
-                                  in(nbatch) in(nthreads) in(nx_all) in(ny_all) \
-                                  in(dx) in(dy) in(cfl) in(tfinal) \
-                                  inout(u_offload : length(u_offload_size) alloc_if(init) free_if(destroy))
-    {
+#ifdef __INTEL_OFFLOAD
+    real *u_offload      = reinterpret_cast<real*>(u_.data());
+    int   u_offload_size = u_.size() * Physics::vec_size;
+    #pragma offload target(mic:0) in(handle) \
+                                  nocopy(u_offload : length(u_offload_size) alloc_if(0) free_if(1))
+    close_session(handle);
+#else
+    if (ahead_.joinable()) {
+        ahead_.join();
+        exposed_seconds += std::max(0.0, ahead_copy_ - ahead_seconds_);
+    }
+    #ifdef _OFFLOAD_OMP_TARGET
+        #pragma omp target map(to: handle) device(offload::device())
+    #endif
+    close_session(handle);
+    u_dev_.release();
+    u_frame_.release();
+#endif
+    session_ = 0;
+}
 
-        // Copy parameters from host to device
-        Parameters params;
-        params.nghost   = nghost;
-        params.nx       = nx;
-        params.ny       = ny;
-        params.nxblocks = nxblocks;
-        params.nyblocks = nyblocks;
-        params.nbatch   = nbatch;
-        params.nthreads = nthreads;
-        params.nx_all   = nx_all;
-        params.ny_all   = ny_all;
-        params.dx       = dx;
-        params.dy       = dy;
-        params.cfl      = cfl;
-
-        // Initialize per-thread local buffers on the device
-        std::vector<LocalState<Physics>*> locals;
-        init_locals(params, locals);
-
-        // Main computation loop
-        bool done = false;
-        real t = 0;
-        while (!done) {
-
-            // We only need to update the ghost cells after all threads have
-            // exhausted valid data in the ghost cells in order to calculate
-            // the number of steps in the batch.
-            apply_periodic(params, u_offload);
-
-            // We only need to calculate the wave speeds at the beginning of
-            // each super-step to determine the dt for both the even/odd
-            // sub-steps.
-            real cx, cy;
-            compute_wave_speeds(params, cx, cy, u_offload);
-
-            // Break out of the loop after this super-step if we have
-            // simulated at least tfinal seconds.
-            real dt = params.cfl / std::max(cx/params.dx, cy/params.dy);
-            int  modified_nbatch = params.nbatch;
-            if (t + 2*params.nbatch*dt >= tfinal) {
-                modified_nbatch = ceil((tfinal-t)/(2*dt));
-                done = true;
-            }
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::run(real tfinal, int iter, int num_iters)
+{
+    real *u_offload      = reinterpret_cast<real*>(u_.data()); USE_ALIGN(u_offload, Physics::BYTE_ALIGN);
+    int   u_offload_size = u_.size() * Physics::vec_size;
+
+    if (!session_)
+        begin_session();
+    uintptr_t handle = session_;
+
+#ifdef __INTEL_OFFLOAD
+    // Kernel and copy-out happen in the same region
+    double t0 = omp_get_wtime();
+    #pragma offload target(mic:0) in(handle) in(tfinal) \
+                                  out(u_offload : length(u_offload_size) alloc_if(0) free_if(0))
+    device_run(handle, u_offload, tfinal);
+    compute_seconds += omp_get_wtime() - t0;
+#else
+    // This frame's kernel: the previous run() started it if it guessed
+    // the interval right; otherwise roll back to its frame and run now
+    real *u_device = u_dev_.data();
+    bool computed = false;
+    if (ahead_.joinable()) {
+        ahead_.join();
+        compute_seconds += ahead_seconds_;
+        exposed_seconds += std::max(0.0, ahead_copy_ - ahead_seconds_);
+        computed = ahead_tfinal_ == tfinal;
+        if (!computed)
+            u_dev_.copy_from(u_frame_, u_offload_size);
+    }
+    if (!computed)
+        compute_seconds += launch(handle, u_device, tfinal);
+
+    // Snapshot the frame on the device and start bringing it back
+    u_frame_.copy_from(u_dev_, u_offload_size);
+    offload::Transfer frame = u_frame_.download_async(u_offload, u_offload_size);
+
+    // Run ahead into the next frame while the copy is in flight
+    if (iter < num_iters-1) {
+        ahead_tfinal_ = tfinal;
+        ahead_ = std::thread([this, handle, u_device, tfinal] {
+            ahead_seconds_ = launch(handle, u_device, tfinal);
+        });
+    }
 
-            // Parallelize computation across partitioned blocks
-            #pragma omp parallel num_threads(params.nthreads)
-            {
-                int tid = omp_get_thread_num();
+    double copy_seconds = frame.wait();
+    transfer_seconds += copy_seconds;
+    if (ahead_.joinable())
+        ahead_copy_ = copy_seconds;
+    else
+        exposed_seconds += copy_seconds;
+#endif
 
-                // Copy global data to local buffers
-                copy_to_local(params, locals[tid], tid, u_offload);
+    if (iter == num_iters-1)
+        end_session();
+}
 
-                // Batch multiple timesteps
-                for (int bi = 0; bi < modified_nbatch; ++bi) {
+#ifndef __INTEL_OFFLOAD
+template <class Physics, class Limiter>
+double Central2D<Physics, Limiter>::launch(uintptr_t handle, real *u_device, real tfinal)
+{
+    double t0 = omp_get_wtime();
+    #ifdef _OFFLOAD_OMP_TARGET
+        #pragma omp target is_device_ptr(u_device) map(to: handle, tfinal) device(offload::device())
+    #endif
+    device_run(handle, u_device, tfinal);
+    return omp_get_wtime() - t0;
+}
+#endif
 
-                    // Execute the even and odd sub-steps for each super-step
-                    for (int io = 0; io < 2; ++io) {
-                        compute_flux(params, locals[tid]);
-                        limited_derivs(params, locals[tid]);
-                        compute_step(params, locals[tid], io, dt);
-                    }
-                }
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::device_run(uintptr_t handle, real *u, real tfinal)
+{
+    Session *session = reinterpret_cast<Session*>(handle);
+    Parameters &params = session->params;
+    std::vector<LocalState<Physics>*> &locals = session->locals;
+
+    // Main computation loop
+    bool done = false;
+    real t = 0;
+    while (!done) {
+
+        // We only need to update the ghost cells after all threads have
+        // exhausted valid data in the ghost cells in order to calculate
+        // the number of steps in the batch.
+        apply_periodic(params, u);
+
+        // We only need to calculate the wave speeds at the beginning of
+        // each super-step to determine the dt for both the even/odd
+        // sub-steps.
+        real cx, cy;
+        compute_wave_speeds(params, cx, cy, u);
+
+        // Break out of the loop after this super-step if we have
+        // simulated at least tfinal seconds; shorten the steps of the
+        // last batch so that we land exactly on tfinal.
+        real dt = params.cfl / std::max(cx/params.dx, cy/params.dy);
+        int  modified_nbatch = params.nbatch;
+        if (t + 2*params.nbatch*dt >= tfinal) {
+            modified_nbatch = ceil((tfinal-t)/(2*dt));
+            dt = (tfinal-t) / (2*modified_nbatch);
+            done = true;
+        }
+
+        // Parallelize computation across partitioned blocks
+        #pragma omp parallel num_threads(params.nthreads)
+        {
+            int tid = omp_get_thread_num();
+
+            // Copy global data to local buffers
+            copy_to_local(params, locals[tid], tid, u);
 
-                // Copy local data to global buffer
-                copy_from_local(params, locals[tid], tid, u_offload);
+            // Batch multiple timesteps
+            for (int bi = 0; bi < modified_nbatch; ++bi) {
+
+                // Execute the even and odd sub-steps for each super-step
+                for (int io = 0; io < 2; ++io) {
+                    compute_flux(params, locals[tid]);
+                    limited_derivs(params, locals[tid]);
+                    compute_step(params, locals[tid], io, dt);
+                }
             }
 
-            // Update simulated time
-            t += 2*modified_nbatch*dt;
+            // Neighbouring blocks read our interior as their ghost
+            // cells, so wait until everybody has copied in.
+            #pragma omp barrier
+
+            // Copy local data to global buffer
+            copy_from_local(params, locals[tid], tid, u);
         }
 
-        // Clean up local state
-        for (auto local : locals) delete local;
-    } // end pragma offload
+        // Update simulated time
+        t += 2*modified_nbatch*dt;
+    }
 }
 
 /**
@@ -773,7 +1005,7 @@ template <class Physics, class Limiter>
 void Central2D<Physics, Limiter>::solution_check()
 {
     using namespace std;
-    real h_sum = 0, hu_sum = 0, hv_sum = 0;
+    accum h_sum = 0, hu_sum = 0, hv_sum = 0;
     real hmin = u(nghost,nghost)[0];
     real hmax = hmin;
     for (int j = nghost; j < ny+nghost; ++j)
@@ -0,0 +1,659 @@
+#ifndef CENTRAL2D_H
+#define CENTRAL2D_H
+
+#include <cstdio>
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <memory>
+#include <new>
+#include <algorithm>
+
+#include "aligned_allocator.h"
+#include "local_state.h"
+#include "stage_timers.h"
+#include "transport.h"
+
+//ldoc on
+/**
+ * # Distributed-memory solver
+ *
+ * This is the batched block scheme of the node solver
+ * (`central2d_pnode.h`) with the blocks spread over ranks that share
+ * nothing.  The grid is split into `nxblocks` by `nyblocks` blocks, one
+ * per rank, exactly as the node solver splits it over threads.  Each
+ * rank keeps its block, with `nghost = 3*nbatch` layers of ghost cells,
+ * for the whole life of the simulator, and takes `nbatch` full steps
+ * at a time without hearing from anyone.  Between batches it swaps
+ * `nghost`-wide halos with its eight neighbours (corners included, so
+ * one round is enough) and joins a global max-reduction of the wave
+ * speeds to agree on the next `dt`.  Messages go through the
+ * `transport` layer, which is MPI or a shared-memory stand-in.
+ *
+ * With the same block layout and batch depth the result is bitwise the
+ * same as the node solver's fork-join schedule.
+ *
+ * ## Interface
+ *
+ * The interface is the node solver's, so the driver needs no changes
+ * beyond starting up the transport.  `init` sets every rank's block
+ * (and on rank 0 the whole grid), and at the end of each `run` the
+ * blocks are gathered to rank 0.  Only rank 0's `operator()` and
+ * `solution_check` see the full solution.
+ */
+
+template <class Physics, class Limiter>
+class Central2D {
+public:
+    typedef typename Physics::real  real;
+    typedef typename Physics::accum accum;   // Precision of long sums
+    typedef typename Physics::vec   vec;
+
+    Central2D(real w, real h,      // Domain width / height
+              int nx, int ny,      // Number of cells in x/y (without ghosts)
+              int nxblocks = 1,    // Number of ranks in x
+              int nyblocks = 1,    // Number of ranks in y
+              int nbatch = 1,      // Timesteps to batch per block
+              real cfl = 0.45f);   // Max allowed CFL number
+
+    // Advance from time 0 to time tfinal
+    void run(real tfinal);
+
+    // Call f(Uxy, x, y) at each cell center to set initial conditions
+    template <typename F>
+    void init(F f);
+
+    // Diagnostics (rank 0 only)
+    void solution_check();
+
+    int get_nbatch() const { return nbatch; }
+    int get_nxblocks() const { return nxblocks; }
+    int get_nyblocks() const { return nyblocks; }
+
+    // Array size accessors
+    int xsize() const { return nx; }
+    int ysize() const { return ny; }
+
+    // Read / write elements of simulation state (rank 0)
+    inline vec&       operator()(int i, int j) {
+        return u_[offset(i,j)];
+    }
+
+    inline const vec& operator()(int i, int j) const {
+        return u_[offset(i,j)];
+    }
+
+private:
+    // Message tags (halo tags are directions 0-7)
+    enum { GATHER_TAG = 8 };
+
+    // A half-open box of local cells [x0,x1) x [y0,y1)
+    struct Box {
+        int x0, x1, y0, y1;
+        bool empty() const { return x0 >= x1 || y0 >= y1; }
+    };
+
+    // LocalState wants more alignment than plain new promises, so it
+    // lives in _mm_malloc storage and is freed to match
+    struct LocalDeleter {
+        void operator()(LocalState<Physics>* p) const {
+            p->~LocalState<Physics>();
+            _mm_free(p);
+        }
+    };
+
+    transport::Comm& comm;
+    const int rank;
+
+    const int nx, ny;             // Number of (non-ghost) cells in x/y
+    int nxblocks, nyblocks;       // Number of ranks in x/y
+    int nx_block, ny_block;       // Interior size of a full block
+    int nbatch;                   // Number of timesteps to batch per block
+    int nghost;                   // Number of ghost cells per block
+    const real dx, dy;            // Cell size in x/y
+    const real cfl;               // Allowed CFL number
+
+    // This rank's block
+    int bx, by;                   // Block coordinates
+    int nx_own, ny_own;           // Interior size
+    std::unique_ptr<LocalState<Physics>, LocalDeleter> local;
+
+    // Halo buffers and neighbour ranks by direction
+    std::vector<vec> send_[8], recv_[8];
+    int neighbour_[8];
+
+    // Global solution values on rank 0 (no ghost cells)
+    typedef DEF_ALIGN(Physics::BYTE_ALIGN) std::vector<vec, aligned_allocator<vec, Physics::BYTE_ALIGN>> aligned_vector;
+    aligned_vector u_;
+
+    inline int offset(int ix, int iy) const { return iy*nx+ix; }
+
+    // Geometry
+    int owned_size(int n, int nblock, int nblocks, int b) const {
+        return b == nblocks-1 ? n - (nblocks-1)*nblock : nblock;
+    }
+    int rank_of(int bx, int by) const {
+        bx = (bx + nxblocks) % nxblocks;
+        by = (by + nyblocks) % nyblocks;
+        return by*nxblocks + bx;
+    }
+    static void direction(int d, int& dx, int& dy) {
+        int k = d < 4 ? d : d+1;    // Skip the centre
+        dx = k%3 - 1;
+        dy = k/3 - 1;
+    }
+    Box ghost_box(int d) const;
+    Box edge_box(int d) const;
+
+    // Stages on a box of local cells
+    void compute_wave_speeds(real& cx, real& cy);
+    void compute_flux(const Box& b);
+    void limited_derivs(const Box& b);
+    void predict(const Box& b, real dtcdx2, real dtcdy2);
+    void correct(const Box& b, real dtcdx2, real dtcdy2);
+    void copy_back(int io);
+
+    // Apply a stage to outer minus inner
+    template <typename K>
+    void on_frame(const Box& outer, const Box& inner, K kernel);
+
+    // Communication
+    void start_halo_exchange(std::vector<transport::RequestPtr>& requests);
+    void finish_halo_exchange();
+    void gather();
+};
+
+
+/**
+ * ## Set-up
+ *
+ * The block layout is the node solver's: blocks of `ceil(nx/nxblocks)`
+ * cells, the last one in each direction taking what is left.  Every
+ * halo has to come from the adjacent block alone, so the ghost layer
+ * may not be deeper than the smallest block; if it would be, we cut
+ * the batch depth down to fit.  Under MPI the rank count is fixed by
+ * the launcher, and if the requested layout does not match it we
+ * choose the most nearly square one that does.
+ */
+
+template <class Physics, class Limiter>
+Central2D<Physics, Limiter>::Central2D(real w, real h, int nx, int ny,
+                                       int nxblocks, int nyblocks,
+                                       int nbatch, real cfl)
+    : comm(transport::world()), rank(comm.rank()),
+      nx(nx), ny(ny),
+      nxblocks(nxblocks), nyblocks(nyblocks),
+      nbatch(std::max(nbatch, 1)),
+      dx(w/nx), dy(h/ny),
+      cfl(cfl)
+{
+    int nranks = comm.size();
+    if (this->nxblocks * this->nyblocks != nranks) {
+        int px = (int) sqrt((double) nranks);
+        while (nranks % px)
+            --px;
+        this->nxblocks = nranks / px;
+        this->nyblocks = px;
+        if (rank == 0)
+            fprintf(stderr, "Using %d x %d blocks for %d ranks\n",
+                    this->nxblocks, this->nyblocks, nranks);
+    }
+
+    nx_block = ceil(nx / (real)this->nxblocks);
+    ny_block = ceil(ny / (real)this->nyblocks);
+    int nmin = std::min(std::min(nx_block, owned_size(nx, nx_block, this->nxblocks, this->nxblocks-1)),
+                        std::min(ny_block, owned_size(ny, ny_block, this->nyblocks, this->nyblocks-1)));
+    if (3*this->nbatch > nmin) {
+        this->nbatch = std::max(nmin/3, 1);
+        if (rank == 0)
+            fprintf(stderr, "Batch depth cut to %d to fit the smallest block\n", this->nbatch);
+    }
+    nghost = 3*this->nbatch;
+
+    bx = rank % this->nxblocks;
+    by = rank / this->nxblocks;
+    nx_own = owned_size(nx, nx_block, this->nxblocks, bx);
+    ny_own = owned_size(ny, ny_block, this->nyblocks, by);
+    void* mem = _mm_malloc(sizeof(LocalState<Physics>), alignof(LocalState<Physics>));
+    if (!mem)
+        throw std::bad_alloc();
+    try {
+        local.reset(new (mem) LocalState<Physics>(nx_own + 2*nghost, ny_own + 2*nghost));
+    } catch (...) {
+        _mm_free(mem);
+        throw;
+    }
+
+    for (int d = 0; d < 8; ++d) {
+        int ddx, ddy;
+        direction(d, ddx, ddy);
+        neighbour_[d] = rank_of(bx+ddx, by+ddy);
+        Box g = ghost_box(d);
+        Box e = edge_box(d);
+        recv_[d].resize((g.x1-g.x0) * (g.y1-g.y0));
+        send_[d].resize((e.x1-e.x0) * (e.y1-e.y0));
+    }
+
+    if (rank == 0)
+        u_.resize(nx * ny);
+}
+
+/**
+ * ### Halo geometry
+ *
+ * Direction `d` runs over the eight neighbours, from the lower left to
+ * the upper right; `7-d` is the opposite direction.  The ghost box in
+ * direction `d` is filled from the edge box that the neighbour there
+ * sends towards us, in direction `7-d` from its side.
+ */
+
+template <class Physics, class Limiter>
+typename Central2D<Physics, Limiter>::Box
+Central2D<Physics, Limiter>::ghost_box(int d) const
+{
+    int ddx, ddy;
+    direction(d, ddx, ddy);
+    int g = nghost;
+    Box b;
+    b.x0 = ddx < 0 ? 0 : ddx == 0 ? g : g + nx_own;
+    b.x1 = ddx < 0 ? g : ddx == 0 ? g + nx_own : 2*g + nx_own;
+    b.y0 = ddy < 0 ? 0 : ddy == 0 ? g : g + ny_own;
+    b.y1 = ddy < 0 ? g : ddy == 0 ? g + ny_own : 2*g + ny_own;
+    return b;
+}
+
+template <class Physics, class Limiter>
+typename Central2D<Physics, Limiter>::Box
+Central2D<Physics, Limiter>::edge_box(int d) const
+{
+    int ddx, ddy;
+    direction(d, ddx, ddy);
+    int g = nghost;
+    Box b;
+    b.x0 = ddx < 0 ? g : ddx == 0 ? g : nx_own;
+    b.x1 = ddx < 0 ? 2*g : ddx == 0 ? g + nx_own : g + nx_own;
+    b.y0 = ddy < 0 ? g : ddy == 0 ? g : ny_own;
+    b.y1 = ddy < 0 ? 2*g : ddy == 0 ? g + ny_own : g + ny_own;
+    return b;
+}
+
+/**
+ * ## Initialization
+ *
+ * Every rank evaluates the initial conditions on its own block; rank 0
+ * also fills in the whole grid, so that output of the initial state
+ * needs no communication.
+ */
+
+template <class Physics, class Limiter>
+template <typename F>
+void Central2D<Physics, Limiter>::init(F f)
+{
+    int x_off = bx*nx_block - nghost;
+    int y_off = by*ny_block - nghost;
+    for (int iy = nghost; iy < nghost + ny_own; ++iy)
+        for (int ix = nghost; ix < nghost + nx_own; ++ix)
+            f(local->u(ix,iy), (x_off+ix+0.5f)*dx, (y_off+iy+0.5f)*dy);
+
+    if (rank == 0)
+        for (int iy = 0; iy < ny; ++iy)
+            for (int ix = 0; ix < nx; ++ix)
+                f(u_[offset(ix,iy)], (ix+0.5f)*dx, (iy+0.5f)*dy);
+}
+
+/**
+ * ## Stages
+ *
+ * These are the node solver's kernels, restricted to a box of local
+ * cells so that a half step can be taken in pieces (see `run`).  Each
+ * cell's update is the same arithmetic as there.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::compute_wave_speeds(real& cx_, real& cy_)
+{
+    using namespace std;
+    STAGE_TIMER(STAGE_WAVE_SPEEDS, nx_own*ny_own);
+    real cx = 1.0e-15;
+    real cy = 1.0e-15;
+    for (int iy = nghost; iy < nghost + ny_own; ++iy) {
+        for (int ix = nghost; ix < nghost + nx_own; ++ix) {
+            real cell_cx, cell_cy;
+            Physics::wave_speed(cell_cx, cell_cy, local->u(ix,iy).data());
+            cx = max(cx, cell_cx);
+            cy = max(cy, cell_cy);
+        }
+    }
+    cx_ = cx;
+    cy_ = cy;
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::compute_flux(const Box& b)
+{
+    STAGE_TIMER(STAGE_FLUX, (b.x1-b.x0)*(b.y1-b.y0));
+    for (int iy = b.y0; iy < b.y1; ++iy)
+        for (int ix = b.x0; ix < b.x1; ++ix)
+            Physics::flux(local->f(ix,iy).data(), local->g(ix,iy).data(),
+                          local->u(ix,iy).data());
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::limited_derivs(const Box& b)
+{
+    STAGE_TIMER(STAGE_LIMITED_DERIVS, (b.x1-b.x0)*(b.y1-b.y0));
+    LocalState<Physics>& L = *local;
+    const int n  = (b.x1-b.x0) * Physics::vec_size;
+    const int sx = Physics::vec_size;
+    const int sy = L.get_nx() * Physics::vec_size;
+    for (int iy = b.y0; iy < b.y1; ++iy) {
+        Limiter::limdiff_row(L.ux(b.x0,iy).data(), L.u(b.x0,iy).data(), n, sx);
+        Limiter::limdiff_row(L.fx(b.x0,iy).data(), L.f(b.x0,iy).data(), n, sx);
+        Limiter::limdiff_row(L.uy(b.x0,iy).data(), L.u(b.x0,iy).data(), n, sy);
+        Limiter::limdiff_row(L.gy(b.x0,iy).data(), L.g(b.x0,iy).data(), n, sy);
+    }
+}
+
+// Predictor (flux values of f and g at half step)
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::predict(const Box& b, real dtcdx2, real dtcdy2)
+{
+    STAGE_TIMER(STAGE_STEP, (b.x1-b.x0)*(b.y1-b.y0));
+    LocalState<Physics>& L = *local;
+    real uh[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int iy = b.y0; iy < b.y1; ++iy) {
+        for (int ix = b.x0; ix < b.x1; ++ix) {
+            const real *u  = L.u(ix,iy).data();
+            const real *fx = L.fx(ix,iy).data();
+            const real *gy = L.gy(ix,iy).data();
+            for (int m = 0; m < Physics::vec_size; ++m) uh[m] = u[m];
+            for (int m = 0; m < Physics::vec_size; ++m) {
+                uh[m] -= dtcdx2 * fx[m];
+                uh[m] -= dtcdy2 * gy[m];
+            }
+            Physics::flux(L.f(ix,iy).data(), L.g(ix,iy).data(), uh);
+        }
+    }
+}
+
+// Corrector (finish the step into v)
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::correct(const Box& b, real dtcdx2, real dtcdy2)
+{
+    STAGE_TIMER(STAGE_STEP, (b.x1-b.x0)*(b.y1-b.y0));
+    LocalState<Physics>& L = *local;
+    for (int iy = b.y0; iy < b.y1; ++iy) {
+        for (int ix = b.x0; ix < b.x1; ++ix) {
+            real *v = L.v(ix,iy).data();
+            const real *u00 = L.u(ix,iy).data(),  *u10 = L.u(ix+1,iy).data();
+            const real *u01 = L.u(ix,iy+1).data(), *u11 = L.u(ix+1,iy+1).data();
+            const real *ux00 = L.ux(ix,iy).data(),  *ux10 = L.ux(ix+1,iy).data();
+            const real *ux01 = L.ux(ix,iy+1).data(), *ux11 = L.ux(ix+1,iy+1).data();
+            const real *uy00 = L.uy(ix,iy).data(),  *uy10 = L.uy(ix+1,iy).data();
+            const real *uy01 = L.uy(ix,iy+1).data(), *uy11 = L.uy(ix+1,iy+1).data();
+            const real *f00 = L.f(ix,iy).data(),  *f10 = L.f(ix+1,iy).data();
+            const real *f01 = L.f(ix,iy+1).data(), *f11 = L.f(ix+1,iy+1).data();
+            const real *g00 = L.g(ix,iy).data(),  *g10 = L.g(ix+1,iy).data();
+            const real *g01 = L.g(ix,iy+1).data(), *g11 = L.g(ix+1,iy+1).data();
+            for (int m = 0; m < Physics::vec_size; ++m) {
+                v[m] =
+                    0.2500f * ( accum(u00[m])  + u10[m]    +
+                                       u01[m]  + u11[m]  ) -
+                    0.0625f * ( accum(ux10[m]) - ux00[m]   +
+                                       ux11[m] - ux01[m]   +
+                                       uy01[m] - uy00[m]   +
+                                       uy11[m] - uy10[m] ) -
+                    dtcdx2  * ( accum(f10[m])  - f00[m]    +
+                                       f11[m]  - f01[m]  ) -
+                    dtcdy2  * ( accum(g01[m])  - g00[m]    +
+                                       g11[m]  - g10[m]  );
+            }
+        }
+    }
+}
+
+// Copy from v storage back to the block (shifting back on odd steps)
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::copy_back(int io)
+{
+    STAGE_TIMER(STAGE_STEP, (local->get_nx()-3)*(local->get_ny()-3));
+    int nxl = local->get_nx();
+    int nyl = local->get_ny();
+    for (int j = 1+io; j < nyl-2+io; ++j)
+        for (int i = 1+io; i < nxl-2+io; ++i)
+            local->u(i,j) = local->v(i-io, j-io);
+}
+
+template <class Physics, class Limiter>
+template <typename K>
+void Central2D<Physics, Limiter>::on_frame(const Box& outer, const Box& inner, K kernel)
+{
+    if (inner.empty()) {
+        kernel(outer);
+        return;
+    }
+    kernel(Box{outer.x0, outer.x1, outer.y0,   inner.y0});   // Bottom
+    kernel(Box{outer.x0, outer.x1, inner.y1,   outer.y1});   // Top
+    kernel(Box{outer.x0, inner.x0, inner.y0,   inner.y1});   // Left
+    kernel(Box{inner.x1, outer.x1, inner.y0,   inner.y1});   // Right
+}
+
+/**
+ * ## Communication
+ *
+ * Halos are packed into one buffer per direction, so that each
+ * exchange is sixteen messages per rank regardless of block shape.
+ * With fewer than three blocks in a direction some neighbours are the
+ * same rank (possibly this one), which the direction tags sort out.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::start_halo_exchange(std::vector<transport::RequestPtr>& requests)
+{
+    STAGE_TIMER(STAGE_EXCHANGE_GHOSTS, 0);
+    for (int d = 0; d < 8; ++d)
+        requests.push_back(comm.irecv(recv_[d].data(), recv_[d].size()*sizeof(vec),
+                                      neighbour_[d], d));
+    for (int d = 0; d < 8; ++d) {
+        Box e = edge_box(d);
+        vec* p = send_[d].data();
+        for (int iy = e.y0; iy < e.y1; ++iy)
+            for (int ix = e.x0; ix < e.x1; ++ix)
+                *p++ = local->u(ix,iy);
+        requests.push_back(comm.isend(send_[d].data(), send_[d].size()*sizeof(vec),
+                                      neighbour_[d], 7-d));
+    }
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::finish_halo_exchange()
+{
+    STAGE_TIMER(STAGE_EXCHANGE_GHOSTS, 0);
+    for (int d = 0; d < 8; ++d) {
+        Box g = ghost_box(d);
+        const vec* p = recv_[d].data();
+        for (int iy = g.y0; iy < g.y1; ++iy)
+            for (int ix = g.x0; ix < g.x1; ++ix)
+                local->u(ix,iy) = *p++;
+    }
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::gather()
+{
+    std::vector<transport::RequestPtr> requests;
+    std::vector<std::vector<vec>> blocks(rank == 0 ? nxblocks*nyblocks : 1);
+
+    // Everyone packs their interior; rank 0 keeps its own
+    std::vector<vec>& mine = blocks[0];
+    mine.resize(nx_own*ny_own);
+    for (int iy = 0; iy < ny_own; ++iy)
+        for (int ix = 0; ix < nx_own; ++ix)
+            mine[iy*nx_own+ix] = local->u(nghost+ix, nghost+iy);
+    if (rank != 0) {
+        requests.push_back(comm.isend(mine.data(), mine.size()*sizeof(vec), 0, GATHER_TAG));
+        comm.wait_all(requests);
+        return;
+    }
+
+    for (int r = 1; r < nxblocks*nyblocks; ++r) {
+        int rx = r % nxblocks, ry = r / nxblocks;
+        blocks[r].resize(owned_size(nx, nx_block, nxblocks, rx) *
+                         owned_size(ny, ny_block, nyblocks, ry));
+        requests.push_back(comm.irecv(blocks[r].data(), blocks[r].size()*sizeof(vec),
+                                      r, GATHER_TAG));
+    }
+    comm.wait_all(requests);
+
+    for (int r = 0; r < nxblocks*nyblocks; ++r) {
+        int rx = r % nxblocks, ry = r / nxblocks;
+        int nxr = owned_size(nx, nx_block, nxblocks, rx);
+        int nyr = owned_size(ny, ny_block, nyblocks, ry);
+        for (int iy = 0; iy < nyr; ++iy)
+            for (int ix = 0; ix < nxr; ++ix)
+                u_[offset(rx*nx_block+ix, ry*ny_block+iy)] = blocks[r][iy*nxr+ix];
+    }
+}
+
+/**
+ * ## Time stepping
+ *
+ * A super-step starts with the block interiors current and the ghosts
+ * stale.  We post the halo exchange and, while it is in flight, join
+ * the reduction for `dt` and then take as much of the first half step
+ * as does not need the ghosts.  For a block of `n` cells per side with
+ * `g` ghost layers (local indices `0..n-1`), that is
+ *
+ *  - fluxes on the interior `[g, n-g)`,
+ *  - limited derivatives one cell further in, on `[g+1, n-g-1)`,
+ *  - the predictor on `[g+2, n-g-2)`, which keeps clear of the fluxes
+ *    that the remaining derivatives will still read, and
+ *  - the corrector on `[g+2, n-g-3)`, where the predicted fluxes it
+ *    reads (one cell up and to the right) are ready.
+ *
+ * Then we wait for the halos, do the same four stages on the frame
+ * that is left, and copy back.  The rest of the batch runs on whole
+ * blocks as usual.  At the end of the batch each rank scans its
+ * interior for the wave speeds that the next reduction needs.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::run(real tfinal)
+{
+    const int nxl = local->get_nx();
+    const int nyl = local->get_ny();
+    const int g = nghost;
+
+    const Box flux_all  = {0, nxl, 0, nyl};
+    const Box deriv_all = {1, nxl-1, 1, nyl-1};
+    const Box corr_all  = {1, nxl-2, 1, nyl-2};
+    const Box flux_in   = {g, nxl-g, g, nyl-g};
+    const Box deriv_in  = {g+1, nxl-g-1, g+1, nyl-g-1};
+    const Box pred_in   = {g+2, nxl-g-2, g+2, nyl-g-2};
+    const Box corr_in   = {g+2, nxl-g-3, g+2, nyl-g-3};
+
+    real cx, cy;
+    compute_wave_speeds(cx, cy);
+
+    bool done = false;
+    real t = 0.0f;
+    while (!done) {
+        std::vector<transport::RequestPtr> halo;
+        start_halo_exchange(halo);
+
+        {
+            STAGE_TIMER(STAGE_BARRIER, 0);
+            double c[2] = {cx, cy};
+            comm.allreduce_max(c, 2);
+            cx = c[0];
+            cy = c[1];
+        }
+
+        // Break out of the loop after this super-step if we have
+        // simulated at least tfinal seconds; shorten the steps of the
+        // last batch so that we land exactly on tfinal.
+        real dt = cfl / std::max(cx/dx, cy/dy);
+        int  modified_nbatch = nbatch;
+        if (t + 2.0f*nbatch*dt >= tfinal) {
+            modified_nbatch = ceil((tfinal-t) / (2.0f*dt));
+            dt = (tfinal-t) / (2.0f*modified_nbatch);
+            done = true;
+        }
+        real dtcdx2 = 0.5 * dt / dx;
+        real dtcdy2 = 0.5 * dt / dy;
+
+        // First half step: interior while the halos are in flight...
+        if (!flux_in.empty())  compute_flux(flux_in);
+        if (!deriv_in.empty()) limited_derivs(deriv_in);
+        if (!pred_in.empty())  predict(pred_in, dtcdx2, dtcdy2);
+        if (!corr_in.empty())  correct(corr_in, dtcdx2, dtcdy2);
+
+        {
+            STAGE_TIMER(STAGE_BARRIER, 0);
+            comm.wait_all(halo);
+        }
+        finish_halo_exchange();
+
+        // ...then the frame around it
+        on_frame(flux_all,  flux_in,  [&](const Box& b) { compute_flux(b); });
+        on_frame(deriv_all, deriv_in, [&](const Box& b) { limited_derivs(b); });
+        on_frame(deriv_all, pred_in,  [&](const Box& b) { predict(b, dtcdx2, dtcdy2); });
+        on_frame(corr_all,  corr_in,  [&](const Box& b) { correct(b, dtcdx2, dtcdy2); });
+        copy_back(0);
+
+        // Rest of the batch
+        for (int step = 0; step < 2*modified_nbatch-1; ++step) {
+            int io = (step+1) % 2;
+            compute_flux(flux_all);
+            limited_derivs(deriv_all);
+            predict(deriv_all, dtcdx2, dtcdy2);
+            correct(corr_all, dtcdx2, dtcdy2);
+            copy_back(io);
+        }
+
+        compute_wave_speeds(cx, cy);
+
+        // Update simulated time
+        t += 2.0f*modified_nbatch*dt;
+    }
+
+    gather();
+}
+
+/**
+ * ### Diagnostics
+ *
+ * Same as the other solvers, on rank 0's gathered copy.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::solution_check()
+{
+    using namespace std;
+    if (rank != 0)
+        return;
+    accum h_sum = 0, hu_sum = 0, hv_sum = 0;
+    real hmin = u_[0][0];
+    real hmax = hmin;
+    for (int j = 0; j < ny; ++j) {
+        for (int i = 0; i < nx; ++i) {
+            vec &uij = u_[offset(i,j)];
+            real h  = uij[0];
+            h_sum  += h;
+            hu_sum += uij[1];
+            hv_sum += uij[2];
+            hmax    = max(h, hmax);
+            hmin    = min(h, hmin);
+            assert( h > 0) ;
+        }
+    }
+    real cell_area = dx*dy;
+    h_sum *= cell_area;
+    hu_sum *= cell_area;
+    hv_sum *= cell_area;
+    printf("-\n  Volume: %g\n  Momentum: (%g, %g)\n  Range: [%g, %g]\n",
+           h_sum, hu_sum, hv_sum, hmin, hmax);
+}
+
+//ldoc off
+#endif /* CENTRAL2D_H */
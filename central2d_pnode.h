@@ -6,10 +6,14 @@
 #include <cassert>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <array>
+#include <climits>
 #include <omp.h>
 
 #include "aligned_allocator.h"
 #include "local_state.h"
+#include "stage_timers.h"
 
 //ldoc on
 /**
@@ -112,60 +116,54 @@
 template <class Physics, class Limiter>
 class Central2D {
 public:
-    typedef typename Physics::real real;
-    typedef typename Physics::vec  vec;
+    typedef typename Physics::real  real;
+    typedef typename Physics::accum accum;   // Precision of long sums
+    typedef typename Physics::vec   vec;
 
     Central2D(real w, real h,      // Domain width / height
               int nx, int ny,      // Number of cells in x/y (without ghosts)
               int nxblocks = 1,    // Number of blocks in x for batching
               int nyblocks = 1,    // Number of blocks in y for batching
-              int nbatch = 1,      // Number of timesteps to batch per block
+              int nbatch = 1,      // Timesteps to batch per block (0 = tune)
               real cfl = 0.45f)    // Max allowed CFL number
-        : nx(nx), ny(ny), nxblocks(nxblocks), nyblocks(nyblocks),
-          nbatch(nbatch), nghost(1+nbatch*2), // Number of ghost cells depend on batch size
-          nx_all(nx + 2*nghost),
-          ny_all(ny + 2*nghost),
-          nthreads(nxblocks*nyblocks),
+        : nx(nx), ny(ny),
+          nbatch(nbatch > 0 ? nbatch : 1),
+          nghost(3*this->nbatch),
           dx(w/nx), dy(h/ny),
           cfl(cfl),
-          u_(nx_all * ny_all) {
-
-        // Dimensions of block assigned to each thread
-        int nx_per_block = ceil(nx / (real)nxblocks);
-        int ny_per_block = ceil(ny / (real)nyblocks);
-
-        // Number of elements beyond grid boundary if block dimensions do
-        // not evenly divide the grid dimensions.
-        int nx_overhang = (nx_per_block * nxblocks) - nx;
-        int ny_overhang = (ny_per_block * nyblocks) - ny;
-
-        assert( nx_overhang >= 0 && ny_overhang >= 0 );
-
-        // Dimensions of block with ghost cells
-        int nx_per_block_padded = nx_per_block + 2*nghost;
-        int ny_per_block_padded = ny_per_block + 2*nghost;
-
-        // Set dimensions of each block. Block dimensions are only
-        // different if they do not evenly divide the grid dimensions at
-        // the boundaries. In such cases, we need to subtract the
-        // overhang count from the corresponding dimension for the
-        // boundary blocks.
-        for (int j = 0; j < nyblocks; ++j) {
-            int ny_local = (j == nyblocks - 1) ? ny_per_block_padded - ny_overhang
-                         :                       ny_per_block_padded;
-            for (int i = 0; i < nxblocks; ++i) {
-                int nx_local = (i == nxblocks - 1) ? nx_per_block_padded - nx_overhang
-                             :                       nx_per_block_padded;
-                locals_.push_back(
-                            std::make_unique< LocalState<Physics> >(nx_local, ny_local) // waddup c++14
-                        );
-            }
-        }
+          u_(nx * ny) {
+        tuner.enabled = (nbatch == 0);
+        set_blocks(nxblocks, nyblocks);
     }
 
+    // How the thread team is organized across super-steps
+    enum Schedule {
+        FORK_JOIN,  // New parallel region per super-step, blocks synced via u_
+        PERSISTENT, // One parallel region per run, blocks swap ghost strips
+        TASKS       // Like PERSISTENT, but blocks are tasks for any team size
+    };
+
+    void set_schedule(Schedule s) { schedule = s; }
+
+    // Repartition into nxblocks-by-nyblocks blocks (one thread each,
+    // except in the TASKS schedule)
+    void set_blocks(int nxblocks, int nyblocks);
+
+    // Fix the batch depth, or pass 0 to pick it by timing
+    void set_nbatch(int nbatch);
+    int  get_nbatch() const { return nbatch; }
+
+    // Let blocks take up to max_ratio (a power of two) local steps per
+    // step of the slowest block, or 1 for one global step
+    void set_local_steps(int max_ratio);
+    int  get_local_steps() const { return max_ratio; }
+
     // Advance from time 0 to time tfinal
     void run(real tfinal);
 
+    // Full time steps taken over the life of the simulator
+    long get_steps() const { return steps; }
+
     // Call f(Uxy, x, y) at each cell center to set initial conditions
     template <typename F>
     void init(F f);
@@ -179,71 +177,233 @@ public:
 
     // Read / write elements of simulation state
     inline vec&       operator()(int i, int j) {
-        return u_[offset(i+nghost,j+nghost)];
+        return u_[offset(i,j)];
     }
 
     inline const vec& operator()(int i, int j) const {
-        return u_[offset(i+nghost,j+nghost)];
+        return u_[offset(i,j)];
     }
 
 private:
 
-    const int nghost;             // Number of ghost cells
     const int nx, ny;             // Number of (non-ghost) cells in x/y
-    const int nxblocks, nyblocks; // Number of blocks for batching in x/y
-    const int nbatch;             // Number of timesteps to batch per block
-    const int nthreads;           // Number of threads
-    const int nx_all, ny_all;     // Total cells in x/y (including ghost)
+    int nxblocks, nyblocks;       // Number of blocks for batching in x/y
+    int nx_block, ny_block;       // Interior size of a full block
+    int nbatch;                   // Number of timesteps to batch per block
+    int nghost;                   // Number of ghost cells per block
+    int nblocks;                  // Number of blocks (tiles)
     const real dx, dy;            // Cell size in x/y
     const real cfl;               // Allowed CFL number
+    Schedule schedule = FORK_JOIN;
+    long steps = 0;               // Full time steps taken so far
+    int max_ratio = 1;            // Largest local step ratio (1 = global dt)
 
-    // Global solution values
+    // Global solution values (no ghost cells; see copy_to_local)
     typedef DEF_ALIGN(Physics::BYTE_ALIGN) std::vector<vec, aligned_allocator<vec, Physics::BYTE_ALIGN>> aligned_vector;
     aligned_vector u_;
 
     // Local state (per-thread)
     std::vector<std::unique_ptr<LocalState<Physics>>> locals_;
 
+    // Source of each local row/column of a block in the persistent
+    // schedule: which block owns it and where it lives in that block.
+    struct HaloMap {
+        std::vector<int> xblock, xlocal;
+        std::vector<int> yblock, ylocal;
+    };
+    std::vector<HaloMap> halos_;
+
+    // Per-block wave speed bounds (persistent schedule)
+    std::vector<real> cx_block_, cy_block_;
+
+    // Local time stepping: each block's stable dt and full steps per
+    // coarse step.  A block's padded footprint reaches into strips
+    // along its neighbours' edges, so their speed bounds are kept for a
+    // 3x3 grid of regions (edge strips as wide as the widest ghost
+    // zone).  Blocks too small for that are bound by every block their
+    // footprint touches.
+    std::vector<real> dt_block_;
+    std::vector<int>  rate_;
+    std::vector<std::array<real,9>> cx_region_, cy_region_;
+    bool use_regions;
+    std::vector<std::vector<int>> reach_;
+
+    // Flow through the faces of a block's interior summed over a
+    // super-step, in +x (west/east) or +y (south/north), and the even
+    // sub-step's share for each dual cell straddling the boundary
+    struct FluxRegister {
+        std::vector<vec> west, east, south, north;
+        std::vector<vec> part;
+    };
+    std::vector<FluxRegister> registers_;
+
+    // Batch depth auto-tuning: time a few super-steps at each candidate
+    // depth, then keep the cheapest per step.
+    struct BatchTuner {
+        static constexpr int trials = 3; // Super-steps timed per depth
+        bool enabled = false;            // Pick nbatch by timing?
+        bool active  = false;            // Still timing candidates?
+        std::vector<int>    depth;       // Candidate depths
+        std::vector<double> cost;        // Seconds per step at each depth
+    } tuner;
+
     // Array accessor function
-    inline int offset(int ix, int iy) const { return iy*nx_all+ix; }
+    inline int offset(int ix, int iy) const { return iy*nx+ix; }
 
     inline vec& u(int ix, int iy) { return u_[offset(ix,iy)]; }
 
-    // Wrapped accessor (periodic BC)
-    inline int ioffset(int ix, int iy) {
-        return offset( (ix+nx-nghost) % nx + nghost,
-                       (iy+ny-nghost) % ny + nghost );
-    }
-
-    inline vec& uwrap(int ix, int iy)  { return u_[ioffset(ix,iy)]; }
-
-    // Apply limiter to all components in a vector
-    #pragma omp declare simd
-    static inline void limdiff(real *du, const real *um, const real *u0, const real *up) {
-        USE_ALIGN(du, Physics::VEC_ALIGN);
-        USE_ALIGN(um, Physics::VEC_ALIGN);
-        USE_ALIGN(u0, Physics::VEC_ALIGN);
-        USE_ALIGN(up, Physics::VEC_ALIGN);
-
-        #pragma ivdep
-        for (int m = 0; m < Physics::vec_size; ++m)
-            du[m] = Limiter::limdiff(um[m], u0[m], up[m]);
-    }
-
-    // Stages of the main algorithm
-    void apply_periodic();
-    void compute_wave_speeds(real& cx, real& cy);
+    // Stages of the main algorithm (tid names a block)
+    void compute_wave_speeds(int tid, real& cx, real& cy);
     void compute_flux(int tid);
     void limited_derivs(int tid);
     void compute_step(int tid, int io, real dt);
+    void advance_block(int tid, int nsteps, real dt);
 
     // Copy data to and from local buffers
     void copy_to_local(int tid);
     void copy_from_local(int tid);
 
+    // Block geometry for the current nbatch and block counts
+    void use_depth(int nbatch);
+    void init_blocks();
+
+    // Direct block-to-block ghost exchange (persistent schedule)
+    void init_halos();
+    void exchange_ghosts(int tid);
+
+    // Drivers for each schedule; each advances t by at most
+    // max_supersteps super-steps, and returns true on reaching tfinal
+    bool run_fork_join(real& t, real tfinal, int max_supersteps, int& nsteps);
+    bool run_persistent(real& t, real tfinal, int max_supersteps, int& nsteps);
+    bool run_tasks(real& t, real tfinal, int max_supersteps, int& nsteps);
+
+    bool run_local(real& t, real tfinal, int max_supersteps, int& nsteps);
+
+    // Batch depth tuning
+    void start_tuning();
+    void record_trial(double seconds, int nsteps);
+
+    // Local time stepping
+    void init_reach();
+    void set_ghost(int tid, int ghost);
+    void region_speeds(int tid);
+    real coarse_dt();
+    void assign_rates(real dt);
+    void record_fluxes(int tid, int io, real dt);
+    void correct_fluxes(int tid);
+
+    // Global coordinates of a block's first interior cell
+    inline int block_xoff(int tid) const { return (tid % nxblocks) * nx_block; }
+    inline int block_yoff(int tid) const { return (tid / nxblocks) * ny_block; }
+
+    // Interior size of a block (the last in each direction may be short)
+    inline int block_nx(int tid) const { return std::min(nx_block, nx - block_xoff(tid)); }
+    inline int block_ny(int tid) const { return std::min(ny_block, ny - block_yoff(tid)); }
+
+    // Ghost layers a block currently carries
+    inline int ghost_of(int tid) const { return (locals_[tid]->get_nx() - block_nx(tid)) / 2; }
+
 };
 
 
+/**
+ * ## Block geometry
+ *
+ * The grid is split into `nxblocks` by `nyblocks` blocks, one per
+ * thread.  Each block carries `nghost` layers of ghost cells, enough
+ * to take `nbatch` full steps without hearing from its neighbours:
+ * as noted above, one full step widens the domain of dependence by
+ * three cells in each direction, so `nghost = 3*nbatch`.
+ *
+ * Both the batch depth and the block counts can change between calls
+ * to `run`.  The global grid holds no ghost cells, so only the local
+ * buffers (and the ghost exchange tables) need to be rebuilt; the
+ * `LocalState` objects are resized in place when the number of blocks
+ * stays the same.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::set_blocks(int nxblocks, int nyblocks)
+{
+    this->nxblocks = nxblocks;
+    this->nyblocks = nyblocks;
+    nblocks = nxblocks*nyblocks;
+
+    // Dimensions of block assigned to each thread
+    nx_block = ceil(nx / (real)nxblocks);
+    ny_block = ceil(ny / (real)nyblocks);
+
+    init_blocks();
+
+    // The best depth depends on the block shape, so look again
+    if (tuner.enabled)
+        start_tuning();
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::set_nbatch(int nbatch)
+{
+    tuner.enabled = (nbatch == 0);
+    tuner.active  = false;
+    if (tuner.enabled)
+        start_tuning();
+    else
+        use_depth(nbatch);
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::use_depth(int nbatch)
+{
+    if (nbatch == this->nbatch)
+        return;
+    this->nbatch = nbatch;
+    nghost = 3*nbatch;
+    init_blocks();
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::init_blocks()
+{
+    // Number of elements beyond grid boundary if block dimensions do
+    // not evenly divide the grid dimensions.
+    int nx_overhang = (nx_block * nxblocks) - nx;
+    int ny_overhang = (ny_block * nyblocks) - ny;
+
+    assert( nx_overhang >= 0 && ny_overhang >= 0 );
+
+    // Dimensions of block with ghost cells
+    int nx_per_block_padded = nx_block + 2*nghost;
+    int ny_per_block_padded = ny_block + 2*nghost;
+
+    if ((int) locals_.size() != nblocks)
+        locals_.clear();
+
+    // Set dimensions of each block. Block dimensions are only
+    // different if they do not evenly divide the grid dimensions at
+    // the boundaries. In such cases, we need to subtract the
+    // overhang count from the corresponding dimension for the
+    // boundary blocks.
+    for (int j = 0; j < nyblocks; ++j) {
+        int ny_local = (j == nyblocks - 1) ? ny_per_block_padded - ny_overhang
+                     :                       ny_per_block_padded;
+        for (int i = 0; i < nxblocks; ++i) {
+            int nx_local = (i == nxblocks - 1) ? nx_per_block_padded - nx_overhang
+                         :                       nx_per_block_padded;
+            int tid = j*nxblocks + i;
+            if (tid < (int) locals_.size())
+                locals_[tid]->resize(nx_local, ny_local);
+            else
+                locals_.push_back(
+                            std::make_unique< LocalState<Physics> >(nx_local, ny_local) // waddup c++14
+                        );
+        }
+    }
+
+    init_halos();
+    init_reach();
+}
+
+
 /**
  * ## Initialization
  *
@@ -261,7 +421,7 @@ void Central2D<Physics, Limiter>::init(F f)
 {
     for (int iy = 0; iy < ny; ++iy)
         for (int ix = 0; ix < nx; ++ix)
-            f(u(nghost+ix,nghost+iy), (ix+0.5f)*dx, (iy+0.5f)*dy);
+            f(u(ix,iy), (ix+0.5f)*dx, (iy+0.5f)*dy);
 }
 
 /**
@@ -279,45 +439,13 @@ void Central2D<Physics, Limiter>::init(F f)
  * "canonical", and setting the values for all other cells `(ix,iy)`
  * to the corresponding canonical values `(ix+p*nx,iy+q*ny)` for some
  * integers `p` and `q`.
+ *
+ * In the node-parallel solver nothing ever reads ghost cells of the
+ * global grid, only those of the per-thread blocks.  So the global grid
+ * holds just the canonical cells, and each thread reads its block
+ * (ghosts included) with the indices wrapped around in `copy_to_local`.
  */
 
-template <class Physics, class Limiter>
-void Central2D<Physics, Limiter>::apply_periodic()
-{
-    // Copy data between right and left boundaries
-    for (int iy = 0; iy < ny_all; ++iy) {
-        for (int ix = 0; ix < nghost; ++ix) {
-            real *u_xy        = u(ix, iy).data();              USE_ALIGN(u_xy,        Physics::VEC_ALIGN);
-            real *uwrap_xy    = uwrap(ix, iy).data();          USE_ALIGN(uwrap_xy,    Physics::VEC_ALIGN);
-            real *u_ghost     = u(nx+nghost+ix,iy).data();     USE_ALIGN(u_ghost,     Physics::VEC_ALIGN);
-            real *uwrap_ghost = uwrap(nx+nghost+ix,iy).data(); USE_ALIGN(uwrap_ghost, Physics::VEC_ALIGN);
-
-            #pragma unroll
-            for(int m = 0; m < Physics::vec_size; ++m) {
-                u_xy[m]    = uwrap_xy[m];
-                u_ghost[m] = uwrap_ghost[m];
-            }
-        }
-    }
-
-    // Copy data between top and bottom boundaries
-    for (int ix = 0; ix < nx_all; ++ix) {
-        for (int iy = 0; iy < nghost; ++iy) {
-            real *u_xy        = u(ix, iy).data();              USE_ALIGN(u_xy,        Physics::VEC_ALIGN);
-            real *uwrap_xy    = uwrap(ix, iy).data();          USE_ALIGN(uwrap_xy,    Physics::VEC_ALIGN);
-            real *u_ghost     = u(ix,ny+nghost+iy).data();     USE_ALIGN(u_ghost,     Physics::VEC_ALIGN);
-            real *uwrap_ghost = uwrap(ix,ny+nghost+iy).data(); USE_ALIGN(uwrap_ghost, Physics::VEC_ALIGN);
-
-            #pragma unroll
-            for(int m = 0; m < Physics::vec_size; ++m) {
-                u_xy[m]    = uwrap_xy[m];
-                u_ghost[m] = uwrap_ghost[m];
-            }
-        }
-    }
-}
-
-
 /**
  * ### Initial flux and speed computations
  *
@@ -329,16 +457,24 @@ void Central2D<Physics, Limiter>::apply_periodic()
  */
 
 template <class Physics, class Limiter>
-void Central2D<Physics, Limiter>::compute_wave_speeds(real& cx_, real& cy_)
+void Central2D<Physics, Limiter>::compute_wave_speeds(int tid, real& cx_, real& cy_)
 {
     using namespace std;
+
+    // Each thread scans the interior of its own block; the per-thread
+    // bounds are then combined across blocks in run().
+    int ny_per_block  = locals_[tid]->get_ny();
+    int nx_per_block  = locals_[tid]->get_nx();
+    int nghost        = ghost_of(tid);
+    STAGE_TIMER(STAGE_WAVE_SPEEDS, (nx_per_block-2*nghost)*(ny_per_block-2*nghost));
+
     real cx = 1.0e-15;
     real cy = 1.0e-15;
-    for (int iy = 0; iy < ny_all; ++iy) {
+    for (int iy = nghost; iy < ny_per_block - nghost; ++iy) {
         #pragma ivdep
-        for (int ix = 0; ix < nx_all; ++ix) {
+        for (int ix = nghost; ix < nx_per_block - nghost; ++ix) {
             real cell_cx, cell_cy;
-            real *u_xy = u(ix, iy).data(); USE_ALIGN(u_xy, Physics::VEC_ALIGN);
+            real *u_xy = locals_[tid]->u(ix, iy).data(); USE_ALIGN(u_xy, Physics::VEC_ALIGN);
             Physics::wave_speed(cell_cx, cell_cy, u_xy);
             cx = max(cx, cell_cx);
             cy = max(cy, cell_cy);
@@ -353,6 +489,7 @@ void Central2D<Physics, Limiter>::compute_flux(int tid)
 {
     int ny_per_block  = locals_[tid]->get_ny();
     int nx_per_block  = locals_[tid]->get_nx();
+    STAGE_TIMER(STAGE_FLUX, nx_per_block*ny_per_block);
 
     for (int iy = 0; iy < ny_per_block; ++iy) {
         #pragma ivdep
@@ -379,39 +516,18 @@ void Central2D<Physics, Limiter>::limited_derivs(int tid)
 {
     int ny_per_block  = locals_[tid]->get_ny();
     int nx_per_block  = locals_[tid]->get_nx();
+    STAGE_TIMER(STAGE_LIMITED_DERIVS, (nx_per_block-2)*(ny_per_block-2));
 
+    // Each row of cells is one run of values, so a neighbour in x is
+    // one vec away and a neighbour in y one row of vecs away
+    const int n  = (nx_per_block-2) * Physics::vec_size;
+    const int sx = Physics::vec_size;
+    const int sy = nx_per_block * Physics::vec_size;
     for (int iy = 1; iy < ny_per_block-1; ++iy) {
-        for (int ix = 1; ix < nx_per_block-1; ++ix) {
-            //
-            // x derivs
-            //
-            real *ux_x0_y0 = locals_[tid]->ux(ix, iy).data();  USE_ALIGN(ux_x0_y0, Physics::VEC_ALIGN);
-            real *u_xM1_y0 = locals_[tid]->u(ix-1, iy).data(); USE_ALIGN(u_xM1_y0, Physics::VEC_ALIGN);
-            real *u_x0_y0  = locals_[tid]->u(ix, iy).data();   USE_ALIGN(u_x0_y0,  Physics::VEC_ALIGN);
-            real *u_xP1_y0 = locals_[tid]->u(ix+1, iy).data(); USE_ALIGN(u_xP1_y0, Physics::VEC_ALIGN);
-
-            real *fx_x0_y0 = locals_[tid]->fx(ix, iy).data();  USE_ALIGN(fx_x0_y0, Physics::VEC_ALIGN);
-            real *f_xM1_y0 = locals_[tid]->f(ix-1, iy).data(); USE_ALIGN(f_xM1_y0, Physics::VEC_ALIGN);
-            real *f_x0_y0  = locals_[tid]->f(ix, iy).data();   USE_ALIGN(f_x0_y0,  Physics::VEC_ALIGN);
-            real *f_xP1_y0 = locals_[tid]->f(ix+1, iy).data(); USE_ALIGN(f_xP1_y0, Physics::VEC_ALIGN);
-
-            //
-            // y derivs
-            //
-            real *uy_x0_y0 = locals_[tid]->uy(ix, iy).data();  USE_ALIGN(uy_x0_y0, Physics::VEC_ALIGN);
-            real *u_x0_yM1 = locals_[tid]->u(ix, iy-1).data(); USE_ALIGN(u_x0_yM1, Physics::VEC_ALIGN);
-            real *u_x0_yP1 = locals_[tid]->u(ix, iy+1).data(); USE_ALIGN(u_x0_yP1, Physics::VEC_ALIGN);
-
-            real *gy_x0_y0 = locals_[tid]->gy(ix, iy).data();  USE_ALIGN(gy_x0_y0, Physics::VEC_ALIGN);
-            real *g_x0_yM1 = locals_[tid]->g(ix, iy-1).data(); USE_ALIGN(g_x0_yM1, Physics::VEC_ALIGN);
-            real *g_x0_y0  = locals_[tid]->g(ix, iy).data();   USE_ALIGN(g_x0_y0,  Physics::VEC_ALIGN);
-            real *g_x0_yP1 = locals_[tid]->g(ix, iy+1).data(); USE_ALIGN(g_x0_yP1, Physics::VEC_ALIGN);
-
-            limdiff( ux_x0_y0, u_xM1_y0, u_x0_y0, u_xP1_y0 );
-            limdiff( fx_x0_y0, f_xM1_y0, f_x0_y0, f_xP1_y0 );
-            limdiff( uy_x0_y0, u_x0_yM1, u_x0_y0, u_x0_yP1 );
-            limdiff( gy_x0_y0, g_x0_yM1, g_x0_y0, g_x0_yP1 );
-        }
+        Limiter::limdiff_row(locals_[tid]->ux(1, iy).data(), locals_[tid]->u(1, iy).data(), n, sx);
+        Limiter::limdiff_row(locals_[tid]->fx(1, iy).data(), locals_[tid]->f(1, iy).data(), n, sx);
+        Limiter::limdiff_row(locals_[tid]->uy(1, iy).data(), locals_[tid]->u(1, iy).data(), n, sy);
+        Limiter::limdiff_row(locals_[tid]->gy(1, iy).data(), locals_[tid]->g(1, iy).data(), n, sy);
     }
 }
 
@@ -436,6 +552,14 @@ void Central2D<Physics, Limiter>::limited_derivs(int tid)
  * in each direction.  Every other step, we shift things back by one
  * mesh cell in each direction, essentially resetting to the primary
  * indexing scheme.
+ *
+ * A block advances every cell it has a stencil for, ghost cells
+ * included, so that the ghosts stay current through the batch.  The
+ * band of valid cells shrinks from the outside in: one cell on the
+ * low side and two on the high side for an even step, the other way
+ * around for an odd step.  After `nbatch` full steps the valid region
+ * has lost `3*nbatch = nghost` cells on each side, which is exactly
+ * the interior.
  */
 
 template <class Physics, class Limiter>
@@ -443,6 +567,7 @@ void Central2D<Physics, Limiter>::compute_step(int tid, int io, real dt)
 {
     int ny_per_block  = locals_[tid]->get_ny();
     int nx_per_block  = locals_[tid]->get_nx();
+    STAGE_TIMER(STAGE_STEP, (nx_per_block-3)*(ny_per_block-3));
 
     real dtcdx2 = 0.5 * dt / dx;
     real dtcdy2 = 0.5 * dt / dy;
@@ -474,8 +599,8 @@ void Central2D<Physics, Limiter>::compute_step(int tid, int io, real dt)
     }
 
     // Corrector (finish the step)
-    for (int iy = nghost-io; iy < ny_per_block-nghost-io; ++iy) {
-        for (int ix = nghost-io; ix < nx_per_block-nghost-io; ++ix) {
+    for (int iy = 1; iy < ny_per_block-2; ++iy) {
+        for (int ix = 1; ix < nx_per_block-2; ++ix) {
             /* Nomenclature:
              *     u_x0_y0 <- u(ix  , iy  )
              *     u_x1_y0 <- u(ix+1, iy  )
@@ -518,23 +643,28 @@ void Central2D<Physics, Limiter>::compute_step(int tid, int io, real dt)
             #pragma simd
             for(int m = 0; m < Physics::vec_size; ++m) {
                 v_ix_iy[m] =
-                    0.2500f * ( u_x0_y0[m]  + u_x1_y0[m]    +
-                                u_x0_y1[m]  + u_x1_y1[m]  ) -
-                    0.0625f * ( ux_x1_y0[m] - ux_x0_y0[m]   +
-                                ux_x1_y1[m] - ux_x0_y1[m]   +
-                                uy_x0_y1[m] - uy_x0_y0[m]   +
-                                uy_x1_y1[m] - uy_x1_y0[m] ) -
-                    dtcdx2  * ( f_x1_y0[m]  - f_x0_y0[m]    +
-                                f_x1_y1[m]  - f_x0_y1[m]  ) -
-                    dtcdy2  * ( g_x0_y1[m]  - g_x0_y0[m]    +
-                                g_x1_y1[m]  - g_x1_y0[m]  );                    
+                    0.2500f * ( accum(u_x0_y0[m])  + u_x1_y0[m]    +
+                                       u_x0_y1[m]  + u_x1_y1[m]  ) -
+                    0.0625f * ( accum(ux_x1_y0[m]) - ux_x0_y0[m]   +
+                                       ux_x1_y1[m] - ux_x0_y1[m]   +
+                                       uy_x0_y1[m] - uy_x0_y0[m]   +
+                                       uy_x1_y1[m] - uy_x1_y0[m] ) -
+                    dtcdx2  * ( accum(f_x1_y0[m])  - f_x0_y0[m]    +
+                                       f_x1_y1[m]  - f_x0_y1[m]  ) -
+                    dtcdy2  * ( accum(g_x0_y1[m])  - g_x0_y0[m]    +
+                                       g_x1_y1[m]  - g_x1_y0[m]  );                    
             }
         }
     }
 
+    // Local time stepping needs this sub-step's flow through the
+    // block's edges before u is overwritten
+    if (max_ratio > 1)
+        record_fluxes(tid, io, dt);
+
     // Copy from v storage back to main grid
-    for (int j = nghost; j < ny_per_block-nghost; ++j) {
-        for (int i = nghost; i < nx_per_block-nghost; ++i) {
+    for (int j = 1+io; j < ny_per_block-2+io; ++j) {
+        for (int i = 1+io; i < nx_per_block-2+io; ++i) {
             real *u_ij    = locals_[tid]->u(i, j).data();       USE_ALIGN(u_ij,     Physics::VEC_ALIGN );
             real *v_ij_io = locals_[tid]->v(i-io, j-io).data(); USE_ALIGN(v_ij_io,  Physics::VEC_ALIGN );
 
@@ -545,6 +675,23 @@ void Central2D<Physics, Limiter>::compute_step(int tid, int io, real dt)
 
 }
 
+/**
+ * A batch is just `nsteps` full steps of a single block, each made of
+ * an even and an odd sub-step.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::advance_block(int tid, int nsteps, real dt)
+{
+    for (int bi = 0; bi < nsteps; ++bi) {
+        for (int io = 0; io < 2; ++io) {
+            compute_flux(tid);
+            limited_derivs(tid);
+            compute_step(tid, io, dt);
+        }
+    }
+}
+
 /**
  * ### Copy to/from local buffers
  *
@@ -554,6 +701,11 @@ void Central2D<Physics, Limiter>::compute_step(int tid, int io, real dt)
  * vectors are copied to the per-thread local buffers. Before the next
  * synchronization point, each thread copies its locally updated
  * solutions to the global solution vectors.
+ *
+ * Block offsets are measured in units of a full block's interior,
+ * since the last block in each direction may be short.  Local cell
+ * `(ix,iy)` of a block is global cell `(ix,iy)` shifted by the block
+ * offset less `nghost`.
  */
 
 template <class Physics, class Limiter>
@@ -561,19 +713,21 @@ void Central2D<Physics, Limiter>::copy_to_local(int tid)
 {
     int ny_per_block  = locals_[tid]->get_ny();
     int nx_per_block  = locals_[tid]->get_nx();
+    int nghost        = ghost_of(tid);
+    STAGE_TIMER(STAGE_COPY_TO_LOCAL, nx_per_block*ny_per_block);
 
-    int biy     = tid / nxblocks;
-    int bix     = tid % nxblocks;
-    int biy_off = biy * (ny_per_block - 2*nghost);
-    int bix_off = bix * (nx_per_block - 2*nghost);
+    int biy_off = block_yoff(tid);
+    int bix_off = block_xoff(tid);
 
+    // Each row is at most three runs of the global row, split where
+    // it wraps around
     for (int iy = 0; iy < ny_per_block; ++iy) {
-        for (int ix = 0; ix < nx_per_block; ++ix) {
-            real *locals_u_xy = locals_[tid]->u(ix, iy).data();   USE_ALIGN(locals_u_xy, Physics::VEC_ALIGN);
-            real *global_u_xy = u(bix_off+ix, biy_off+iy).data(); USE_ALIGN(global_u_xy, Physics::VEC_ALIGN);
-
-            #pragma unroll
-            for(int m = 0; m < Physics::vec_size; ++m) locals_u_xy[m] = global_u_xy[m];
+        int gy = ((biy_off+iy-nghost) % ny + ny) % ny;
+        for (int ix = 0; ix < nx_per_block; ) {
+            int gx  = ((bix_off+ix-nghost) % nx + nx) % nx;
+            int run = std::min(nx_per_block - ix, nx - gx);
+            std::copy(&u(gx, gy), &u(gx, gy) + run, &locals_[tid]->u(ix, iy));
+            ix += run;
         }
     }
 }
@@ -583,16 +737,16 @@ void Central2D<Physics, Limiter>::copy_from_local(int tid)
 {
     int ny_per_block  = locals_[tid]->get_ny();
     int nx_per_block  = locals_[tid]->get_nx();
+    int nghost        = ghost_of(tid);
+    STAGE_TIMER(STAGE_COPY_FROM_LOCAL, (nx_per_block-2*nghost)*(ny_per_block-2*nghost));
 
-    int biy     = tid / nxblocks;
-    int bix     = tid % nxblocks;
-    int biy_off = biy * (ny_per_block - 2*nghost);
-    int bix_off = bix * (nx_per_block - 2*nghost);
+    int biy_off = block_yoff(tid);
+    int bix_off = block_xoff(tid);
 
     for (int iy = nghost; iy < ny_per_block - nghost; ++iy) {
         for (int ix = nghost; ix < nx_per_block - nghost; ++ix) {
             real *locals_u_xy = locals_[tid]->u(ix, iy).data();   USE_ALIGN(locals_u_xy, Physics::VEC_ALIGN);
-            real *global_u_xy = u(bix_off+ix, biy_off+iy).data(); USE_ALIGN(global_u_xy, Physics::VEC_ALIGN);
+            real *global_u_xy = u(bix_off+ix-nghost, biy_off+iy-nghost).data(); USE_ALIGN(global_u_xy, Physics::VEC_ALIGN);
 
             #pragma unroll
             for(int m = 0; m < Physics::vec_size; ++m) global_u_xy[m] = locals_u_xy[m];
@@ -600,6 +754,79 @@ void Central2D<Physics, Limiter>::copy_from_local(int tid)
     }
 }
 
+/**
+ * ### Direct ghost exchange
+ *
+ * In the persistent schedule the blocks stay in their local buffers for
+ * the whole `run`, and a block fills its ghost cells straight from the
+ * interiors of the blocks that own them.  Which block that is (and where
+ * the cell sits inside it) only depends on the local row and column, so
+ * we tabulate it once per block.  The tables already account for the
+ * periodic wrap-around and for short blocks at the right/top edges.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::init_halos()
+{
+    halos_.resize(nblocks);
+    for (int tid = 0; tid < nblocks; ++tid) {
+        HaloMap& halo = halos_[tid];
+        int nx_per_block = locals_[tid]->get_nx();
+        int ny_per_block = locals_[tid]->get_ny();
+        int bix_off = block_xoff(tid);
+        int biy_off = block_yoff(tid);
+
+        halo.xblock.resize(nx_per_block);
+        halo.xlocal.resize(nx_per_block);
+        for (int ix = 0; ix < nx_per_block; ++ix) {
+            int gx = ((bix_off + ix - nghost) % nx + nx) % nx;
+            int bx = std::min(gx / nx_block, nxblocks-1);
+            halo.xblock[ix] = bx;
+            halo.xlocal[ix] = gx - bx*nx_block + nghost;
+        }
+
+        halo.yblock.resize(ny_per_block);
+        halo.ylocal.resize(ny_per_block);
+        for (int iy = 0; iy < ny_per_block; ++iy) {
+            int gy = ((biy_off + iy - nghost) % ny + ny) % ny;
+            int by = std::min(gy / ny_block, nyblocks-1);
+            halo.yblock[iy] = by;
+            halo.ylocal[iy] = gy - by*ny_block + nghost;
+        }
+    }
+
+    cx_block_.resize(nblocks);
+    cy_block_.resize(nblocks);
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::exchange_ghosts(int tid)
+{
+    const HaloMap& halo = halos_[tid];
+    int ny_per_block = locals_[tid]->get_ny();
+    int nx_per_block = locals_[tid]->get_nx();
+    STAGE_TIMER(STAGE_EXCHANGE_GHOSTS, nx_per_block*ny_per_block -
+                (nx_per_block-2*nghost)*(ny_per_block-2*nghost));
+
+    for (int iy = 0; iy < ny_per_block; ++iy) {
+        bool ghost_row = iy < nghost || iy >= ny_per_block - nghost;
+        const int src_row = halo.yblock[iy] * nxblocks;
+        for (int ix = 0; ix < nx_per_block; ++ix) {
+
+            // Skip over the interior of interior rows
+            if (!ghost_row && ix == nghost)
+                ix = nx_per_block - nghost;
+
+            LocalState<Physics> *src = locals_[src_row + halo.xblock[ix]].get();
+            real *local_u_xy = locals_[tid]->u(ix, iy).data();                  USE_ALIGN(local_u_xy, Physics::VEC_ALIGN);
+            real *src_u_xy   = src->u(halo.xlocal[ix], halo.ylocal[iy]).data(); USE_ALIGN(src_u_xy,   Physics::VEC_ALIGN);
+
+            #pragma unroll
+            for(int m = 0; m < Physics::vec_size; ++m) local_u_xy[m] = src_u_xy[m];
+        }
+    }
+}
+
 /**
  * ### Advance time
  *
@@ -621,52 +848,757 @@ void Central2D<Physics, Limiter>::run(real tfinal)
     real t = 0.0f;
     while (!done) {
 
-        // We only need to update the ghost cells after all threads have
-        // exhausted valid data in the ghost cells in order to calculate
-        // the number of steps in the batch.
-        apply_periodic();
+        // While tuning, run a short trial at the next candidate depth
+        int max_supersteps = INT_MAX;
+        if (tuner.active) {
+            use_depth(tuner.depth[tuner.cost.size()]);
+            max_supersteps = tuner.trials;
+        }
+
+        int nsteps = 0;
+        double t0 = omp_get_wtime();
+        if (max_ratio > 1)
+            done = run_local(t, tfinal, max_supersteps, nsteps);
+        else switch (schedule) {
+        case PERSISTENT: done = run_persistent(t, tfinal, max_supersteps, nsteps); break;
+        case TASKS:      done = run_tasks     (t, tfinal, max_supersteps, nsteps); break;
+        default:         done = run_fork_join (t, tfinal, max_supersteps, nsteps); break;
+        }
+
+        steps += nsteps;
+        if (tuner.active)
+            record_trial(omp_get_wtime() - t0, nsteps);
+    }
+}
+
+/**
+ * #### Choosing the batch depth
+ *
+ * Deeper batches synchronize less often but redo more work in the
+ * ghost layers, and where the balance lies depends on the block size
+ * and on how expensive a barrier is on the machine at hand.  So when
+ * asked to, we simply measure.  The candidates are powers of two, as
+ * long as a padded block holds at most twice as many cells as its
+ * interior (beyond that, redundant work is bound to dominate).
+ * Each candidate gets a trial of a few super-steps inside an ordinary
+ * `run` (the trials are part of the simulation, not extra work), and
+ * we keep the depth with the lowest wall time per step.  The trial
+ * includes gathering and scattering the blocks, so the persistent
+ * schedule is charged a little more than it pays in a long run; with
+ * several super-steps per trial this is a small bias.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::start_tuning()
+{
+    int nmin = std::min(nx_block, ny_block);
+
+    tuner.depth.clear();
+    tuner.cost.clear();
+    for (int depth = 1; depth == 1 || (nmin+6*depth)*(nmin+6*depth) <= 2*nmin*nmin; depth *= 2)
+        tuner.depth.push_back(depth);
+    tuner.active = true;
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::record_trial(double seconds, int nsteps)
+{
+    tuner.cost.push_back(seconds / std::max(nsteps, 1));
+    if (tuner.cost.size() < tuner.depth.size())
+        return;
+
+    size_t best = 0;
+    for (size_t k = 1; k < tuner.cost.size(); ++k)
+        if (tuner.cost[k] < tuner.cost[best])
+            best = k;
+
+    tuner.active = false;
+    use_depth(tuner.depth[best]);
+}
+
+/**
+ * #### Fork/join schedule
+ *
+ * Each super-step is its own parallel region: every block is gathered
+ * from the global grid, advanced, and scattered back.
+ */
+
+template <class Physics, class Limiter>
+bool Central2D<Physics, Limiter>::run_fork_join(real& t, real tfinal,
+                                                int max_supersteps, int& nsteps)
+{
+    bool done = false;
+
+    // Wave speeds for the first super-step. After that, each super-step
+    // produces the speeds for the next one as a by-product.
+    real cx = 1.0e-15;
+    real cy = 1.0e-15;
+    #pragma omp parallel num_threads(nblocks) reduction(max:cx,cy)
+    {
+        int tid = omp_get_thread_num();
+        copy_to_local(tid);
+        compute_wave_speeds(tid, cx, cy);
+    }
+
+    // The first super-step can use the blocks we just loaded
+    bool fresh = true;
 
-        // We only need to calculate the wave speeds at the beginning of
-        // each super-step to determine the dt for both the even/odd
-        // sub-steps.
-        real cx, cy;
-        compute_wave_speeds(cx, cy);
+    for (int step = 0; step < max_supersteps && !done; ++step) {
 
         // Break out of the loop after this super-step if we have
-        // simulated at least tfinal seconds.
+        // simulated at least tfinal seconds; shorten the steps of the
+        // last batch so that we land exactly on tfinal.
         real dt = cfl / std::max(cx/dx, cy/dy);
         int  modified_nbatch = nbatch;
         if (t + 2.0f*nbatch*dt >= tfinal) {
             modified_nbatch = ceil((tfinal-t) / (2.0f*dt));
+            dt = (tfinal-t) / (2.0f*modified_nbatch);
             done = true;
         }
 
         // Parallelize computation across partitioned blocks
-        #pragma omp parallel num_threads(nthreads)
+        real cx_next = 1.0e-15;
+        real cy_next = 1.0e-15;
+        #pragma omp parallel num_threads(nblocks) reduction(max:cx_next,cy_next)
         {
             int tid = omp_get_thread_num();
 
-            // Copy global data to local buffers
-            copy_to_local(tid);
+            // Copy global data (with periodic wrap-around) to local buffers
+            if (!fresh)
+                copy_to_local(tid);
 
             // Batch multiple timesteps
-            for (int bi = 0; bi < modified_nbatch; ++bi) {
+            advance_block(tid, modified_nbatch, dt);
 
-                // Execute the even and odd sub-steps for each super-step
-                for (int io = 0; io < 2; ++io) {
-                    compute_flux(tid);
-                    limited_derivs(tid);
-                    compute_step(tid, io, dt);
-                }
+            // This block's contribution to the next super-step's speeds
+            compute_wave_speeds(tid, cx_next, cy_next);
+
+            // Neighbouring blocks read our interior as their ghost
+            // cells, so wait until everybody has copied in.
+            {
+                STAGE_TIMER(STAGE_BARRIER, 0);
+                #pragma omp barrier
             }
 
-          // Copy local data to global buffer
-          copy_from_local(tid);
+            // Copy local data to global buffer
+            copy_from_local(tid);
+
+#ifdef _STAGE_TIMERS
+            // Make the wait at the end of the region visible
+            {
+                STAGE_TIMER(STAGE_BARRIER, 0);
+                #pragma omp barrier
+            }
+#endif
         }
+        cx = cx_next;
+        cy = cy_next;
+        fresh = false;
 
         // Update simulated time
         t += 2.0f*modified_nbatch*dt;
+        nsteps += modified_nbatch;
+    }
+    return done;
+}
+
+/**
+ * #### Persistent schedule
+ *
+ * One parallel region covers the whole call.  The blocks are gathered
+ * from the global grid once at the start and scattered back once at
+ * the end; in between, each super-step only swaps ghost strips between
+ * neighbouring blocks.  Every thread runs the same time-step logic on
+ * the same per-block speed bounds, so they all agree on `dt` and on
+ * when to stop without any extra communication.  Two barriers per
+ * super-step are enough: one after the batch (interiors and speed
+ * bounds are final, so ghosts can be read) and one after the exchange
+ * (ghosts are filled and bounds have been read, so blocks may move on).
+ */
+
+template <class Physics, class Limiter>
+bool Central2D<Physics, Limiter>::run_persistent(real& t, real tfinal,
+                                                 int max_supersteps, int& nsteps)
+{
+    bool done = false;
+    real t0 = t;
+
+    #pragma omp parallel num_threads(nblocks)
+    {
+        int tid = omp_get_thread_num();
+
+        copy_to_local(tid);
+        compute_wave_speeds(tid, cx_block_[tid], cy_block_[tid]);
+        {
+            STAGE_TIMER(STAGE_BARRIER, 0);
+            #pragma omp barrier
+        }
+
+        bool my_done = false;
+        real my_t = t0;
+        int  my_nsteps = 0;
+        for (int step = 0; step < max_supersteps && !my_done; ++step) {
+
+            // Combine the per-block speed bounds
+            real cx = 1.0e-15;
+            real cy = 1.0e-15;
+            for (int b = 0; b < nblocks; ++b) {
+                cx = std::max(cx, cx_block_[b]);
+                cy = std::max(cy, cy_block_[b]);
+            }
+
+            // Break out of the loop after this super-step if we have
+            // simulated at least tfinal seconds; shorten the steps of
+            // the last batch so that we land exactly on tfinal.
+            real dt = cfl / std::max(cx/dx, cy/dy);
+            int  modified_nbatch = nbatch;
+            if (my_t + 2.0f*nbatch*dt >= tfinal) {
+                modified_nbatch = ceil((tfinal-my_t) / (2.0f*dt));
+                dt = (tfinal-my_t) / (2.0f*modified_nbatch);
+                my_done = true;
+            }
+
+            // Ghosts are filled and everyone has read the bounds
+            {
+                STAGE_TIMER(STAGE_BARRIER, 0);
+                #pragma omp barrier
+            }
+
+            // Batch multiple timesteps
+            advance_block(tid, modified_nbatch, dt);
+            compute_wave_speeds(tid, cx_block_[tid], cy_block_[tid]);
+
+            // Interiors and bounds are final
+            {
+                STAGE_TIMER(STAGE_BARRIER, 0);
+                #pragma omp barrier
+            }
+
+            if (!my_done && step+1 < max_supersteps)
+                exchange_ghosts(tid);
+
+            // Update simulated time
+            my_t += 2.0f*modified_nbatch*dt;
+            my_nsteps += modified_nbatch;
+        }
+
+        copy_from_local(tid);
+
+        // Every thread holds the same values; publish one copy
+        if (tid == 0) {
+            t = my_t;
+            done = my_done;
+            nsteps = my_nsteps;
+        }
+    }
+    return done;
+}
+
+/**
+ * #### Task schedule
+ *
+ * With one block per thread, a super-step takes as long as its slowest
+ * block: the short blocks at the right and top edges finish early, and
+ * a thread that gets descheduled holds up everyone else.  In the task
+ * schedule the blocks are tiles, and we ask for many more of them than
+ * there are threads.  Each phase of a super-step is a `taskloop` over
+ * the tiles, and idle threads pick up whatever tiles are left, so the
+ * load evens out on its own and the team can be any size (it is set by
+ * `OMP_NUM_THREADS` as usual).  The phases follow the persistent
+ * schedule: tiles stay in their local buffers and swap ghost strips
+ * between super-steps.  The implicit task group at the end of each
+ * `taskloop` takes the place of the barriers there, and since only one
+ * thread runs the time-step logic there is nothing to agree on.
+ */
+
+template <class Physics, class Limiter>
+bool Central2D<Physics, Limiter>::run_tasks(real& t, real tfinal,
+                                            int max_supersteps, int& nsteps)
+{
+    bool done = false;
+
+    #pragma omp parallel
+    #pragma omp single
+    {
+        #pragma omp taskloop grainsize(1)
+        for (int b = 0; b < nblocks; ++b) {
+            copy_to_local(b);
+            compute_wave_speeds(b, cx_block_[b], cy_block_[b]);
+        }
+
+        for (int step = 0; step < max_supersteps && !done; ++step) {
+
+            // Combine the per-block speed bounds
+            real cx = 1.0e-15;
+            real cy = 1.0e-15;
+            for (int b = 0; b < nblocks; ++b) {
+                cx = std::max(cx, cx_block_[b]);
+                cy = std::max(cy, cy_block_[b]);
+            }
+
+            // Break out of the loop after this super-step if we have
+            // simulated at least tfinal seconds; shorten the steps of
+            // the last batch so that we land exactly on tfinal.
+            real dt = cfl / std::max(cx/dx, cy/dy);
+            int  modified_nbatch = nbatch;
+            if (t + 2.0f*nbatch*dt >= tfinal) {
+                modified_nbatch = ceil((tfinal-t) / (2.0f*dt));
+                dt = (tfinal-t) / (2.0f*modified_nbatch);
+                done = true;
+            }
+
+            // Batch multiple timesteps
+            #pragma omp taskloop grainsize(1)
+            for (int b = 0; b < nblocks; ++b) {
+                advance_block(b, modified_nbatch, dt);
+                compute_wave_speeds(b, cx_block_[b], cy_block_[b]);
+            }
+
+            if (!done && step+1 < max_supersteps) {
+                #pragma omp taskloop grainsize(1)
+                for (int b = 0; b < nblocks; ++b)
+                    exchange_ghosts(b);
+            }
+
+            // Update simulated time
+            t += 2.0f*modified_nbatch*dt;
+            nsteps += modified_nbatch;
+        }
+
+        #pragma omp taskloop grainsize(1)
+        for (int b = 0; b < nblocks; ++b)
+            copy_from_local(b);
+    }
+    return done;
+}
+
+/**
+ * ### Local time stepping
+ *
+ * With one global `dt`, the fastest cell anywhere sets the step for
+ * every block.  With local time stepping, each block takes `rate` full
+ * steps of `dt/rate` per coarse step of length `2*dt`.  `rate` is a
+ * power of two up to `max_ratio`, as small as the wave speeds under
+ * the block's padded footprint allow.  A block that takes
+ * `nbatch*rate` steps in one go needs `3*nbatch*rate` ghost layers,
+ * and slow blocks should not pay for the ghosts of fast ones.  So each
+ * super-step gathers every block from the global grid with just the
+ * layers its own rate needs, and the ghost exchange of the persistent
+ * and task schedules is not used.  The blocks are tasks, as in the
+ * task schedule, so the team can be any size.
+ *
+ * A longer coarse step lets more blocks coast, but makes the fastest
+ * ones take more, and more deeply padded, steps.  We try as the coarse
+ * step each block's own stable step, and the power-of-two multiples of
+ * the smallest one.  We keep the one that updates the fewest padded
+ * cells per unit of simulated time.  If every block has rate 1, this
+ * is exactly the fork/join schedule.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::set_local_steps(int max_ratio)
+{
+    int ratio = 1;
+    while (ratio < max_ratio)
+        ratio *= 2;
+    this->max_ratio = ratio;
+    init_reach();
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::init_reach()
+{
+    // Widest footprint a block can have at the current depth
+    int G = 3*nbatch*max_ratio;
+
+    reach_.resize(nblocks);
+    registers_.resize(nblocks);
+    dt_block_.resize(nblocks);
+    rate_.assign(nblocks, 1);
+    cx_region_.resize(nblocks);
+    cy_region_.resize(nblocks);
+
+    use_regions = true;
+    for (int tid = 0; tid < nblocks; ++tid)
+        if (std::min(block_nx(tid), block_ny(tid)) < 2*G)
+            use_regions = false;
+    std::vector<char> xhit(nxblocks), yhit(nyblocks);
+    for (int tid = 0; tid < nblocks; ++tid) {
+        std::fill(xhit.begin(), xhit.end(), 0);
+        std::fill(yhit.begin(), yhit.end(), 0);
+        for (int ix = -G; ix < block_nx(tid) + G; ++ix) {
+            int gx = ((block_xoff(tid) + ix) % nx + nx) % nx;
+            xhit[std::min(gx / nx_block, nxblocks-1)] = 1;
+        }
+        for (int iy = -G; iy < block_ny(tid) + G; ++iy) {
+            int gy = ((block_yoff(tid) + iy) % ny + ny) % ny;
+            yhit[std::min(gy / ny_block, nyblocks-1)] = 1;
+        }
+        reach_[tid].clear();
+        for (int by = 0; by < nyblocks; ++by)
+            for (int bx = 0; bx < nxblocks; ++bx)
+                if (xhit[bx] && yhit[by])
+                    reach_[tid].push_back(by*nxblocks + bx);
+    }
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::set_ghost(int tid, int ghost)
+{
+    int nx_interior = block_nx(tid);
+    int ny_interior = block_ny(tid);
+    locals_[tid]->resize(nx_interior + 2*ghost, ny_interior + 2*ghost);
+
+    FluxRegister& reg = registers_[tid];
+    reg.west .assign(ny_interior, vec());
+    reg.east .assign(ny_interior, vec());
+    reg.south.assign(nx_interior, vec());
+    reg.north.assign(nx_interior, vec());
+    reg.part.resize(4 * 2*(nx_interior + ny_interior + 2));
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::region_speeds(int tid)
+{
+    using namespace std;
+    LocalState<Physics>& L = *locals_[tid];
+    const int g   = ghost_of(tid);
+    const int nxi = block_nx(tid);
+    const int nyi = block_ny(tid);
+    const int G   = use_regions ? 3*nbatch*max_ratio : 0;
+    STAGE_TIMER(STAGE_WAVE_SPEEDS, nxi*nyi);
+
+    array<real,9>& cxr = cx_region_[tid];
+    array<real,9>& cyr = cy_region_[tid];
+    cxr.fill(1.0e-15);
+    cyr.fill(1.0e-15);
+    const int xcut[4] = { 0, G, nxi-G, nxi };
+    for (int iy = 0; iy < nyi; ++iy) {
+        int ry = (iy < G) ? 0 : (iy < nyi-G) ? 1 : 2;
+        for (int rx = 0; rx < 3; ++rx) {
+            real cx = cxr[3*ry+rx];
+            real cy = cyr[3*ry+rx];
+            for (int ix = xcut[rx]; ix < xcut[rx+1]; ++ix) {
+                real cell_cx, cell_cy;
+                Physics::wave_speed(cell_cx, cell_cy, L.u(g+ix, g+iy).data());
+                cx = max(cx, cell_cx);
+                cy = max(cy, cell_cy);
+            }
+            cxr[3*ry+rx] = cx;
+            cyr[3*ry+rx] = cy;
+        }
+    }
+    cx_block_[tid] = *max_element(cxr.begin(), cxr.end());
+    cy_block_[tid] = *max_element(cyr.begin(), cyr.end());
+}
+
+template <class Physics, class Limiter>
+typename Central2D<Physics, Limiter>::real Central2D<Physics, Limiter>::coarse_dt()
+{
+    using namespace std;
+
+    // Each block is bound by the fastest cells under its footprint
+    for (int b = 0; b < nblocks; ++b) {
+        real cx = 1.0e-15;
+        real cy = 1.0e-15;
+        auto bound = [&](int nb, int rx0, int rx1, int ry0, int ry1) {
+            for (int ry = ry0; ry <= ry1; ++ry)
+                for (int rx = rx0; rx <= rx1; ++rx) {
+                    cx = max(cx, cx_region_[nb][3*ry+rx]);
+                    cy = max(cy, cy_region_[nb][3*ry+rx]);
+                }
+        };
+        if (use_regions) {
+            int bx = b % nxblocks;
+            int by = b / nxblocks;
+            int xm = (bx + nxblocks-1) % nxblocks, xp = (bx + 1) % nxblocks;
+            int ym = (by + nyblocks-1) % nyblocks, yp = (by + 1) % nyblocks;
+            bound(b,                 0, 2, 0, 2);
+            bound(by*nxblocks + xm,  2, 2, 0, 2);
+            bound(by*nxblocks + xp,  0, 0, 0, 2);
+            bound(ym*nxblocks + bx,  0, 2, 2, 2);
+            bound(yp*nxblocks + bx,  0, 2, 0, 0);
+            bound(ym*nxblocks + xm,  2, 2, 2, 2);
+            bound(ym*nxblocks + xp,  0, 0, 2, 2);
+            bound(yp*nxblocks + xm,  2, 2, 0, 0);
+            bound(yp*nxblocks + xp,  0, 0, 0, 0);
+        } else {
+            for (int r : reach_[b])
+                bound(r, 0, 2, 0, 2);
+        }
+        dt_block_[b] = cfl / max(cx/dx, cy/dy);
+    }
+    real dt_min = *min_element(dt_block_.begin(), dt_block_.end());
+
+    // Padded cell updates per unit of simulated time
+    auto cost = [&](real dt) {
+        assign_rates(dt);
+        double cells = 0;
+        for (int b = 0; b < nblocks; ++b) {
+            int ghost = 3*nbatch*rate_[b];
+            cells += (double) rate_[b] * (block_nx(b) + 2*ghost) * (block_ny(b) + 2*ghost);
+        }
+        return cells / dt;
+    };
+
+    real   best = dt_min;
+    double best_cost = cost(dt_min);
+    auto consider = [&](real dt) {
+        if (dt <= dt_min || dt > max_ratio*dt_min)
+            return;
+        double c = cost(dt);
+        if (c < best_cost) {
+            best = dt;
+            best_cost = c;
+        }
+    };
+    for (int b = 0; b < nblocks; ++b)
+        consider(dt_block_[b]);
+    for (int ratio = 2; ratio <= max_ratio; ratio *= 2)
+        consider(ratio*dt_min);
+    return best;
+}
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::assign_rates(real dt)
+{
+    for (int b = 0; b < nblocks; ++b) {
+        int rate = 1;
+        while (rate < max_ratio && dt/rate > dt_block_[b])
+            rate *= 2;
+        rate_[b] = rate;
+    }
+}
+
+/**
+ * #### Flux registers
+ *
+ * Where two blocks step at different rates, each one moves mass through
+ * their shared edge at its own rate, and the two amounts disagree.  As
+ * in Berger and Colella's refluxing, the coarser block adopts the finer
+ * one's flow through the edge.  So each block records, for every face
+ * on the edge of its interior, the flow across it over the super-step.
+ *
+ * The staggered scheme has no flux form, but a full step can be put
+ * into one.  Split every cell into quarters.  In the even sub-step the
+ * four quarters that meet at a primal corner form a dual cell, with
+ * fluxes through its outer edges.  In the odd sub-step the dual cell is
+ * split back into quarters, and fluxes cross the primal edges.  Fluxes
+ * of the even sub-step run along the lines through primal centers, so
+ * they never leave a primal cell.  Whatever a quarter gained between
+ * the two splits, less what came through the dual cell's outer edges,
+ * crossed one of the two primal edges inside the dual cell.  Those
+ * four flows are fixed by the four gains up to a circulation around
+ * the corner, and we take the least one.  Their sum with the odd
+ * sub-step's fluxes is the flow through the primal face, and a cell's
+ * change over a full step is exactly the net flow through its faces.
+ *
+ * Only the ring of dual cells straddling the interior's edge matters.
+ * In the even sub-step we record each quarter's share from before the
+ * step, and what came in through the dual cell's outer edges.  The odd
+ * sub-step completes the flows and adds them into the registers.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::record_fluxes(int tid, int io, real dt)
+{
+    LocalState<Physics>& L = *locals_[tid];
+    FluxRegister& reg = registers_[tid];
+    const int g   = ghost_of(tid);
+    const int nxi = block_nx(tid);
+    const int nyi = block_ny(tid);
+    const int nring = 2*(nxi + nyi + 2);
+    STAGE_TIMER(STAGE_FLUX_REGISTER, nring);
+
+    real dtcdx2 = 0.5 * dt / dx;
+    real dtcdy2 = 0.5 * dt / dy;
+
+    // Dual cell (i,j) has its center at the corner of primal cells
+    // (i,j) and (i+1,j+1).  Slots on the ring: west and east columns,
+    // then south and north rows.
+    auto ring = [&](int k, int& i, int& j) {
+        if (k < 2*(nyi+1)) {
+            i = (k < nyi+1) ? g-1 : g+nxi-1;
+            j = g-1 + k % (nyi+1);
+        } else {
+            k -= 2*(nyi+1);
+            j = (k < nxi+1) ? g-1 : g+nyi-1;
+            i = g-1 + k % (nxi+1);
+        }
+    };
+
+    if (io == 0) {
+        for (int k = 0; k < nring; ++k) {
+            int i, j;
+            ring(k, i, j);
+            vec* part = &reg.part[4*k];
+            for (int m = 0; m < Physics::vec_size; ++m) {
+                part[0][m] = -(0.25f*L.u(i,j)[m]     + 0.0625f*( L.ux(i,j)[m]     + L.uy(i,j)[m]))
+                             - (dtcdx2*L.f(i,j)[m]     + dtcdy2*L.g(i,j)[m]);
+                part[1][m] = -(0.25f*L.u(i+1,j)[m]   + 0.0625f*(-L.ux(i+1,j)[m]   + L.uy(i+1,j)[m]))
+                             - (-dtcdx2*L.f(i+1,j)[m]  + dtcdy2*L.g(i+1,j)[m]);
+                part[2][m] = -(0.25f*L.u(i,j+1)[m]   + 0.0625f*( L.ux(i,j+1)[m]   - L.uy(i,j+1)[m]))
+                             - (dtcdx2*L.f(i,j+1)[m]   - dtcdy2*L.g(i,j+1)[m]);
+            }
+        }
+        return;
+    }
+
+    // Flows out of the lower left quarter in x (a) and y (c), and into
+    // the upper right one in x (b) and y (e)
+    for (int k = 0; k < nring; ++k) {
+        int i, j;
+        ring(k, i, j);
+        vec* part = &reg.part[4*k];
+        const real *d    = L.u(i,j).data();
+        const real *d_dx = L.ux(i,j).data();
+        const real *d_dy = L.uy(i,j).data();
+        for (int m = 0; m < Physics::vec_size; ++m) {
+            real gain_mm = part[0][m] + 0.25f*d[m] - 0.0625f*(d_dx[m] + d_dy[m]);
+            real gain_pm = part[1][m] + 0.25f*d[m] + 0.0625f*(d_dx[m] - d_dy[m]);
+            real gain_mp = part[2][m] + 0.25f*d[m] - 0.0625f*(d_dx[m] - d_dy[m]);
+            real a = -gain_mm;
+            real b = -gain_mp;
+            real e = -gain_mm - gain_pm;
+            real s = -0.25f*(a - b + e);
+            part[0][m] = a + s;
+            part[1][m] = b - s;
+            part[2][m] = -s;
+            part[3][m] = e + s;
+        }
+    }
+
+    // Each face is half in the dual cell below (left) and half in the
+    // one above (right), plus the odd sub-step's flux through it
+    const vec* west  = &reg.part[0];
+    const vec* east  = &reg.part[4*(nyi+1)];
+    const vec* south = &reg.part[4*2*(nyi+1)];
+    const vec* north = &reg.part[4*(2*(nyi+1) + nxi+1)];
+    for (int r = 0; r < nyi; ++r) {
+        int j = g + r;
+        for (int m = 0; m < Physics::vec_size; ++m) {
+            reg.west[r][m] += west[4*r+1][m] + west[4*(r+1)][m]
+                            + dtcdx2*(L.f(g-1, j-1)[m] + L.f(g-1, j)[m]);
+            reg.east[r][m] += east[4*r+1][m] + east[4*(r+1)][m]
+                            + dtcdx2*(L.f(g+nxi-1, j-1)[m] + L.f(g+nxi-1, j)[m]);
+        }
+    }
+    for (int c = 0; c < nxi; ++c) {
+        int i = g + c;
+        for (int m = 0; m < Physics::vec_size; ++m) {
+            reg.south[c][m] += south[4*c+3][m] + south[4*(c+1)+2][m]
+                             + dtcdy2*(L.g(i-1, g-1)[m] + L.g(i, g-1)[m]);
+            reg.north[c][m] += north[4*c+3][m] + north[4*(c+1)+2][m]
+                             + dtcdy2*(L.g(i-1, g+nyi-1)[m] + L.g(i, g+nyi-1)[m]);
+        }
+    }
+}
+
+/**
+ * Once every block is through the super-step, a block takes the flow
+ * through each of its edges from the neighbour across it, if that
+ * neighbour stepped faster.  Both sides of every edge then agree, so
+ * mass and momentum are conserved.  Blocks with equal rates already
+ * agree.
+ */
+
+template <class Physics, class Limiter>
+void Central2D<Physics, Limiter>::correct_fluxes(int tid)
+{
+    LocalState<Physics>& L = *locals_[tid];
+    const FluxRegister& reg = registers_[tid];
+    const int g   = ghost_of(tid);
+    const int nxi = block_nx(tid);
+    const int nyi = block_ny(tid);
+    STAGE_TIMER(STAGE_FLUX_REGISTER, 2*(nxi + nyi));
+
+    int bx = tid % nxblocks;
+    int by = tid / nxblocks;
+    int west  = by*nxblocks + (bx + nxblocks-1) % nxblocks;
+    int east  = by*nxblocks + (bx + 1) % nxblocks;
+    int south = ((by + nyblocks-1) % nyblocks)*nxblocks + bx;
+    int north = ((by + 1) % nyblocks)*nxblocks + bx;
+
+    for (int r = 0; r < nyi; ++r)
+        for (int m = 0; m < Physics::vec_size; ++m) {
+            if (rate_[west] > rate_[tid])
+                L.u(g, g+r)[m]       += registers_[west].east[r][m] - reg.west[r][m];
+            if (rate_[east] > rate_[tid])
+                L.u(g+nxi-1, g+r)[m] -= registers_[east].west[r][m] - reg.east[r][m];
+        }
+    for (int c = 0; c < nxi; ++c)
+        for (int m = 0; m < Physics::vec_size; ++m) {
+            if (rate_[south] > rate_[tid])
+                L.u(g+c, g)[m]       += registers_[south].north[c][m] - reg.south[c][m];
+            if (rate_[north] > rate_[tid])
+                L.u(g+c, g+nyi-1)[m] -= registers_[north].south[c][m] - reg.north[c][m];
+        }
+}
+
+/**
+ * #### Local time stepping driver
+ *
+ * Each super-step, every block gathers itself from the global grid and
+ * takes its own steps.  Once all of them are through, each one corrects
+ * its edges and scatters back.  Blocks only ever read the global grid
+ * in the first phase and write it in the second, so nothing needs to
+ * be double buffered.
+ */
+
+template <class Physics, class Limiter>
+bool Central2D<Physics, Limiter>::run_local(real& t, real tfinal,
+                                            int max_supersteps, int& nsteps)
+{
+    bool done = false;
+
+    #pragma omp parallel
+    #pragma omp single
+    {
+        #pragma omp taskloop grainsize(1)
+        for (int b = 0; b < nblocks; ++b) {
+            set_ghost(b, nghost);
+            copy_to_local(b);
+            region_speeds(b);
+        }
+
+        for (int step = 0; step < max_supersteps && !done; ++step) {
+
+            // Break out of the loop after this super-step if we have
+            // simulated at least tfinal seconds; shorten the steps of
+            // the last batch so that we land exactly on tfinal.
+            real dt = coarse_dt();
+            int  modified_nbatch = nbatch;
+            if (t + 2.0f*nbatch*dt >= tfinal) {
+                modified_nbatch = ceil((tfinal-t) / (2.0f*dt));
+                dt = (tfinal-t) / (2.0f*modified_nbatch);
+                done = true;
+            }
+            assign_rates(dt);
+
+            #pragma omp taskloop grainsize(1)
+            for (int b = 0; b < nblocks; ++b) {
+                set_ghost(b, 3*modified_nbatch*rate_[b]);
+                copy_to_local(b);
+                advance_block(b, modified_nbatch*rate_[b], dt/rate_[b]);
+            }
+
+            #pragma omp taskloop grainsize(1)
+            for (int b = 0; b < nblocks; ++b) {
+                correct_fluxes(b);
+                region_speeds(b);
+                copy_from_local(b);
+            }
+
+            // Update simulated time
+            t += 2.0f*modified_nbatch*dt;
+            nsteps += modified_nbatch;
+        }
+
+        // Leave the blocks as the other schedules expect them
+        for (int b = 0; b < nblocks; ++b)
+            set_ghost(b, nghost);
     }
+    return done;
 }
 
 /**
@@ -685,11 +1617,11 @@ template <class Physics, class Limiter>
 void Central2D<Physics, Limiter>::solution_check()
 {
     using namespace std;
-    real h_sum = 0, hu_sum = 0, hv_sum = 0;
-    real hmin = u(nghost,nghost)[0];
+    accum h_sum = 0, hu_sum = 0, hv_sum = 0;
+    real hmin = u(0,0)[0];
     real hmax = hmin;
-    for (int j = nghost; j < ny+nghost; ++j) {
-        for (int i = nghost; i < nx+nghost; ++i) {
+    for (int j = 0; j < ny; ++j) {
+        for (int i = 0; i < nx; ++i) {
             vec &uij = u(i,j);
             real h  = uij[0];
             h_sum  += h;
@@ -0,0 +1,246 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+//ldoc on
+/**
+ * ## Checkpoints
+ *
+ * A checkpoint holds everything needed to pick a run back up: the
+ * solution, the simulated time, how many frames have been written, and
+ * the parameters that the rest of the run has to agree with.  We only
+ * go through the public interface of the simulator (`operator()` to
+ * read, `init` to write back), and we store the solution in canonical
+ * order -- component by component, each an `nx*ny` raster with `x`
+ * varying fastest -- so a checkpoint written by any solver variant,
+ * with any block decomposition or storage layout, can be loaded by any
+ * other.
+ *
+ * The file is a 64-byte header followed by the raster data.  The
+ * header records the element size, so a reader can refuse data of the
+ * wrong precision, and a CRC-32 of the data, so a torn or corrupted
+ * file is caught before it is loaded.
+ */
+
+struct CheckpointHeader {
+    char     magic[8];      // "SHALLOWC"
+    uint32_t version;       // Checkpoint version (1)
+    uint32_t nx, ny;        // Grid size
+    uint32_t nfields;       // Components stored per cell
+    uint32_t elem_bytes;    // Size of one stored value
+    uint32_t frame;         // Frames completed
+    double   time;          // Simulated time
+    double   width;         // Domain width
+    double   ftime;         // Time between frames
+    uint32_t crc;           // CRC-32 of the data
+    uint32_t reserved;
+};
+
+static_assert(sizeof(CheckpointHeader) == 64, "CheckpointHeader layout");
+
+/**
+ * ### Writing
+ *
+ * `save` copies the solution into a snapshot and returns; a background
+ * thread writes it out while the simulation continues.  The data is
+ * split into slabs that are written (and checksummed) by several
+ * threads at once with `pwrite`, and the slab checksums are merged with
+ * `crc32_combine`.  The file is written under a temporary name and only
+ * renamed into place once it is complete and synced, so a job killed
+ * mid-write leaves the previous checkpoint intact.  A `save` that
+ * arrives while the last one is still in flight waits for it.
+ */
+
+template <class Sim>
+class Checkpointer {
+public:
+    typedef typename Sim::real real;
+
+    Checkpointer(const char* fname, int nfields, double width, double ftime) :
+        fname(fname), nfields(nfields), width(width), ftime(ftime) {}
+
+    ~Checkpointer() { wait(); }
+
+    void save(const Sim& sim, int frame, double time) {
+        wait();
+
+        int nx = sim.xsize();
+        int ny = sim.ysize();
+        data.resize((size_t) nfields * nx * ny);
+        real *p = data.data();
+        for (int m = 0; m < nfields; ++m)
+            for (int j = 0; j < ny; ++j)
+                for (int i = 0; i < nx; ++i)
+                    *p++ = sim(i,j)[m];
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "SHALLOWC", 8);
+        header.version    = 1;
+        header.nx         = nx;
+        header.ny         = ny;
+        header.nfields    = nfields;
+        header.elem_bytes = sizeof(real);
+        header.frame      = frame;
+        header.time       = time;
+        header.width      = width;
+        header.ftime      = ftime;
+
+        writer = std::thread(&Checkpointer::write, this);
+    }
+
+    // Block until the last checkpoint is on disk
+    void wait() {
+        if (writer.joinable())
+            writer.join();
+    }
+
+private:
+    const std::string fname;
+    const int nfields;
+    const double width, ftime;
+
+    CheckpointHeader header;
+    std::vector<real> data;
+    std::thread writer;
+
+    void write() {
+        std::string tmpname = fname + ".tmp";
+        int fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror("checkpoint");
+            return;
+        }
+
+        // Write and checksum slabs in parallel
+        const char* bytes = reinterpret_cast<const char*>(data.data());
+        size_t nbytes = data.size() * sizeof(real);
+        int nslabs = std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+        size_t slab = (nbytes + nslabs-1) / nslabs;
+
+        std::vector<uLong> crcs(nslabs);
+        std::vector<size_t> lens(nslabs);
+        std::vector<int> ok(nslabs, 1);
+        std::vector<std::thread> workers;
+        for (int s = 0; s < nslabs; ++s) {
+            size_t begin = std::min(nbytes, s*slab);
+            lens[s] = std::min(nbytes, begin+slab) - begin;
+            workers.emplace_back([&, s, begin] {
+                crcs[s] = crc32(0L, reinterpret_cast<const Bytef*>(bytes+begin), lens[s]);
+                ok[s] = pwrite_all(fd, bytes+begin, lens[s], sizeof(header)+begin);
+            });
+        }
+        for (auto& w : workers)
+            w.join();
+
+        uLong crc = crcs[0];
+        for (int s = 1; s < nslabs; ++s)
+            crc = crc32_combine(crc, crcs[s], lens[s]);
+        header.crc = crc;
+
+        bool good = pwrite_all(fd, &header, sizeof(header), 0) &&
+                    std::all_of(ok.begin(), ok.end(), [](int k) { return k; }) &&
+                    fsync(fd) == 0;
+        close(fd);
+        if (!good || rename(tmpname.c_str(), fname.c_str()) != 0)
+            fprintf(stderr, "Could not write checkpoint %s\n", fname.c_str());
+    }
+
+    static bool pwrite_all(int fd, const void* buf, size_t bytes, uint64_t offset) {
+        const char* p = static_cast<const char*>(buf);
+        while (bytes > 0) {
+            ssize_t n = pwrite(fd, p, bytes, offset);
+            if (n < 0)
+                return false;
+            p += n;
+            bytes  -= n;
+            offset += n;
+        }
+        return true;
+    }
+};
+
+/**
+ * ### Reading
+ *
+ * `load_checkpoint` checks that the file matches the simulator (grid
+ * size, number of fields, precision, domain width) and that the data
+ * checksum is right, and then feeds the stored values to `sim.init`.
+ * (A different width would keep the cells but change `dx`, which is a
+ * different problem, so it is refused like the rest.)  The callback
+ * gets cell centers, so we turn the coordinates back into indices.  On
+ * success the header is returned in `info` so the caller can restore
+ * the time and frame counter; on failure the simulator is untouched.
+ */
+
+template <class Sim>
+bool load_checkpoint(const char* fname, Sim& sim, int nfields,
+                     double width, CheckpointHeader& info)
+{
+    typedef typename Sim::real real;
+
+    FILE* fp = fopen(fname, "rb");
+    if (!fp) {
+        perror(fname);
+        return false;
+    }
+
+    CheckpointHeader header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+              std::memcmp(header.magic, "SHALLOWC", 8) == 0 &&
+              header.version == 1;
+    if (!ok) {
+        fprintf(stderr, "%s: not a checkpoint\n", fname);
+        fclose(fp);
+        return false;
+    }
+    if ((int) header.nx != sim.xsize() || (int) header.ny != sim.ysize() ||
+        (int) header.nfields != nfields || header.elem_bytes != sizeof(real)) {
+        fprintf(stderr, "%s: saved for a %ux%u grid with %u fields of %u bytes\n",
+                fname, header.nx, header.ny, header.nfields, header.elem_bytes);
+        fclose(fp);
+        return false;
+    }
+    if (header.width != width) {
+        fprintf(stderr, "%s: saved with domain width %g\n", fname, header.width);
+        fclose(fp);
+        return false;
+    }
+
+    std::vector<real> data((size_t) header.nfields * header.nx * header.ny);
+    ok = fread(data.data(), sizeof(real), data.size(), fp) == data.size();
+    fclose(fp);
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(data.data()),
+                      data.size() * sizeof(real));
+    if (!ok || crc != header.crc) {
+        fprintf(stderr, "%s: checksum mismatch\n", fname);
+        return false;
+    }
+
+    const int nx = header.nx;
+    const int ny = header.ny;
+    const double dx = width / nx;
+    const double dy = width / ny;
+    const size_t plane = (size_t) nx * ny;
+    sim.init([&](typename Sim::vec& u, double x, double y) {
+        int i = std::min(nx-1, (int) (x/dx));
+        int j = std::min(ny-1, (int) (y/dy));
+        for (int m = 0; m < nfields; ++m)
+            u[m] = data[m*plane + (size_t) j*nx + i];
+    });
+
+    info = header;
+    return true;
+}
+
+//ldoc off
+#endif /* CHECKPOINT_H */
@@ -1,19 +1,27 @@
 #if defined _SERIAL
     #include "central2d.h"
+    #include "central2d_soa.h"
+    #include "central2d_amr.h"
+    #include "central2d_ensemble.h"
 #elif defined _PARALLEL_NODE
     #include "central2d_pnode.h"
 #elif defined _PARALLEL_DEVICE
     #include "central2d_pdevice.h"
+#elif defined _PARALLEL_DIST
+    #include "central2d_pdist.h"
 #endif
 #include "shallow2d.h"
 #include "minmod.h"
 #include "meshio.h"
+#include "checkpoint.h"
+#include "initial_conditions.h"
 
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
 #include <string>
+#include <memory>
 #include <cmath>
 #include <cstring>
 #include <cstdlib>
@@ -36,54 +44,15 @@
  * limiter:
  */
 
+#if defined _SERIAL && defined _SOA
+typedef Central2D< Shallow2D, MinMod<Shallow2D::real>, SoA > Sim;
+#elif defined _SERIAL && defined _AMR
+typedef Central2D< Shallow2D, MinMod<Shallow2D::real>, AMR > Sim;
+#elif defined _SERIAL && defined _ENSEMBLE
+typedef Central2D< Shallow2D, MinMod<Shallow2D::real>, Ensemble > Sim;
+#else
 typedef Central2D< Shallow2D, MinMod<Shallow2D::real> > Sim;
-
-/**
- * ## Initial states
- *
- * Our default problem is a circular dam break problem; the other
- * interesting problem is the wave problem (a wave on a constant
- * flow, starting off smooth and developing a shock in finite time).
- * The pond and river examples should do nothing interesting at all
- * if the numerical method is coded right.
- */
-
-// Circular dam break problem
-void dam_break(Sim::vec& u, double x, double y)
-{
-    x -= 1;
-    y -= 1;
-    u[0] = 1.0 + 0.5*(x*x + y*y < 0.25+1e-5);
-    u[1] = 0;
-    u[2] = 0;
-}
-
-// Still pond (ideally, nothing should move here!)
-void pond(Sim::vec& u, double x, double y)
-{
-    u[0] = 1.0;
-    u[1] = 0;
-    u[2] = 0;
-}
-
-// River (ideally, the solver shouldn't do much with this, either)
-void river(Sim::vec& u, double x, double y)
-{
-    u[0] = 1.0;
-    u[1] = 1.0;
-    u[2] = 0;
-}
-
-
-// Wave on a river -- develops a shock in finite time!
-void wave(Sim::vec& u, double x, double y)
-{
-    using namespace std;
-    u[0] = 1.0 + 0.2 * sin(M_PI*x);
-    u[1] = 1.0;
-    u[2] = 0;
-}
-
+#endif
 
 /**
  * ## Main driver
@@ -96,7 +65,8 @@ void wave(Sim::vec& u, double x, double y)
 int main(int argc, char** argv)
 {
     double start_time = omp_get_wtime();
-#if defined _PARALLEL_DEVICE
+#if defined _PARALLEL_DEVICE && defined __INTEL_OFFLOAD
+    // Bring up the coprocessor before the clock matters
     #pragma offload_transfer target(mic:0)
 #endif
     std::string fname = "waves.out";
@@ -108,10 +78,26 @@ int main(int argc, char** argv)
     int    nxblocks = 1;
     int    nyblocks = 1;
     int    nbatch   = 1;
+    int    lts      = 1;
+    int    tile     = 0;
+    int    ratio    = 2;
+    double refine   = 0.05;
+    double cull     = -1;
+    int    members  = 1;
+    double spread   = 0.1;
+    int    member   = 0;
+    bool   shared_dt = false;
+    std::string kernel = "staged";
+    std::string schedule = "fork";
+    std::string fields = "h";
+    OutCodec codec;
+    std::string ckpt_name = "waves.ckpt";
+    std::string restart_name;
+    int    ckpt_every = 0;
 
     int c;
     extern char* optarg;
-    while ((c = getopt(argc, argv, "hi:o:n:w:F:f:x:y:b:")) != -1) {
+    while ((c = getopt(argc, argv, "hi:o:n:w:F:f:x:y:b:l:t:a:A:q:k:s:u:ze:c:C:r:E:S:m:d")) != -1) {
         switch (c) {
         case 'h':
             fprintf(stderr,
@@ -125,9 +111,28 @@ int main(int argc, char** argv)
                     "\t-F: number of frames (%d)\n"
                     "\t-x: number of blocks in x (%d)\n"
                     "\t-y: number of blocks in y (%d)\n"
-                    "\t-b: timesteps to batch per block (%d)\n",
+                    "\t-b: timesteps to batch per block, 0 to tune (%d)\n"
+                    "\t-l: max ratio of local to coarse steps per block (%d)\n"
+                    "\t-t: tile or AMR block edge in cells, 0 for default (%d)\n"
+                    "\t-a: AMR refinement ratio (%d)\n"
+                    "\t-A: AMR threshold on |jump in h|/h (%g)\n"
+                    "\t-q: tiled kernel skips tiles uniform to this, -1 for never (%g)\n"
+                    "\t-k: kernel, staged, fused or tiled (%s)\n"
+                    "\t-s: thread schedule, fork, persistent or tasks (%s)\n"
+                    "\t-u: fields to write, comma-separated h,hu,hv (%s)\n"
+                    "\t-z: compress output frames\n"
+                    "\t-e: compress output frames lossily, to this max error in h (lossless)\n"
+                    "\t-c: checkpoint every this many frames, 0 for never (%d)\n"
+                    "\t-C: checkpoint file name (%s)\n"
+                    "\t-r: restart from a checkpoint file\n"
+                    "\t-E: ensemble members (%d)\n"
+                    "\t-S: step in disturbance amplitude between members (%g)\n"
+                    "\t-m: member to write and check (%d)\n"
+                    "\t-d: advance all members with one shared time step\n",
                     argv[0], ic.c_str(), fname.c_str(),
-                    nx, width, ftime, frames, nxblocks, nyblocks, nbatch);
+                    nx, width, ftime, frames, nxblocks, nyblocks, nbatch, lts,
+                    tile, ratio, refine, cull, kernel.c_str(), schedule.c_str(), fields.c_str(),
+                    ckpt_every, ckpt_name.c_str(), members, spread, member);
             return -1;
         case 'i':  ic       = optarg;       break;
         case 'o':  fname    = optarg;       break;
@@ -138,35 +143,172 @@ int main(int argc, char** argv)
         case 'x':  nxblocks = atoi(optarg); break;
         case 'y':  nyblocks = atoi(optarg); break;
         case 'b':  nbatch   = atoi(optarg); break;
+        case 'l':  lts      = atoi(optarg); break;
+        case 't':  tile     = atoi(optarg); break;
+        case 'a':  ratio    = atoi(optarg); break;
+        case 'A':  refine   = atof(optarg); break;
+        case 'q':  cull     = atof(optarg); break;
+        case 'k':  kernel   = optarg;       break;
+        case 's':  schedule = optarg;       break;
+        case 'u':  fields   = optarg;       break;
+        case 'z':  codec.compress  = true;  break;
+        case 'e':  codec.compress  = true;
+                   codec.tolerance = atof(optarg); break;
+        case 'c':  ckpt_every   = atoi(optarg); break;
+        case 'C':  ckpt_name    = optarg;       break;
+        case 'r':  restart_name = optarg;       break;
+        case 'E':  members  = atoi(optarg); break;
+        case 'S':  spread   = atof(optarg); break;
+        case 'm':  member   = atoi(optarg); break;
+        case 'd':  shared_dt = true;        break;
         default:
             fprintf(stderr, "Unknown option (-%c)\n", c);
             return -1;
         }
     }
 
-    void (*icfun)(Sim::vec& u, double x, double y) = dam_break;
-    if (ic == "dam_break") {
-        icfun = dam_break;
-    } else if (ic == "pond") {
-        icfun = pond;
-    } else if (ic == "river") {
-        icfun = river;
-    } else if (ic == "wave") {
-        icfun = wave;
-    } else {
+#if defined _PARALLEL_DIST
+    // One rank per block; start them before any threads exist
+    transport::Comm& comm = transport::init(&argc, &argv, nxblocks*nyblocks);
+    const bool root = comm.rank() == 0;
+#else
+    const bool root = true;
+#endif
+
+    void (*icfun)(Sim::vec& u, double x, double y) = initial_condition<Sim::vec>(ic);
+    if (!icfun) {
         fprintf(stderr, "Unknown initial conditions\n");
+        icfun = dam_break<Sim::vec>;
     }
 
-#if defined _SERIAL
+#if defined _SERIAL && defined _ENSEMBLE
+    if (members < 1 || member < 0 || member >= members) {
+        fprintf(stderr, "Member %d is not in an ensemble of %d\n", member, members);
+        return -1;
+    }
+    Sim sim(width,width, nx,nx, members);
+    sim.set_member(member);
+    sim.set_shared_dt(shared_dt);
+#elif defined _SERIAL
     Sim sim(width,width, nx,nx);
-#elif defined _PARALLEL_NODE || _PARALLEL_DEVICE
+#if defined _AMR
+    sim.set_refinement(ratio, tile > 0 ? tile : 16, refine);
+#endif
+#elif defined _PARALLEL_NODE
     Sim sim(width,width, nx,nx, nxblocks,nyblocks, nbatch);
+#elif defined _PARALLEL_DEVICE || defined _PARALLEL_DIST
+    if (nbatch < 1) {
+        fprintf(stderr, "Batch tuning is only available in the node build\n");
+        nbatch = 1;
+    }
+    Sim sim(width,width, nx,nx, nxblocks,nyblocks, nbatch);
+#endif
+    if (kernel == "fused") {
+#if defined _SERIAL && !defined _SOA && !defined _AMR && !defined _ENSEMBLE
+        sim.set_fused(true);
+#else
+        fprintf(stderr, "Fused kernel is only available in the serial build\n");
+#endif
+    } else if (kernel == "tiled") {
+#if defined _SERIAL && !defined _SOA && !defined _AMR && !defined _ENSEMBLE
+        if (nbatch < 1) {
+            fprintf(stderr, "Batch tuning is only available in the node build\n");
+            nbatch = 1;
+        }
+        sim.set_tiled(tile > 0 ? tile : 64, nbatch);
+        sim.set_culling(cull);
+#else
+        fprintf(stderr, "Tiled kernel is only available in the serial build\n");
+#endif
+    } else if (kernel != "staged") {
+        fprintf(stderr, "Unknown kernel\n");
+    }
+    if (cull >= 0 && kernel != "tiled")
+        fprintf(stderr, "Tile culling is only available with the tiled kernel\n");
+
+    if (schedule == "persistent" || schedule == "tasks") {
+#if defined _PARALLEL_NODE
+        sim.set_schedule(schedule == "tasks" ? Sim::TASKS : Sim::PERSISTENT);
+#else
+        fprintf(stderr, "Persistent and task schedules are only available in the node build\n");
+#endif
+    } else if (schedule != "fork") {
+        fprintf(stderr, "Unknown schedule\n");
+    }
+
+#if !defined _ENSEMBLE
+    if (members > 1 || shared_dt)
+        fprintf(stderr, "Ensembles are only available in the ensemble build\n");
+#else
+    if (ckpt_every > 0 || !restart_name.empty()) {
+        fprintf(stderr, "Checkpoints are not available in the ensemble build\n");
+        ckpt_every = 0;
+        restart_name.clear();
+    }
+#endif
+
+    if (lts > 1) {
+#if defined _PARALLEL_NODE
+        sim.set_local_steps(lts);
+#else
+        fprintf(stderr, "Local time stepping is only available in the node build\n");
 #endif
-    SimViz<Sim> viz(fname.c_str(), sim);
-    sim.init(icfun);
+    }
+
+    // Components of the solution vector to write out
+    unsigned field_mask = 0;
+    for (size_t start = 0; start <= fields.size(); ) {
+        size_t end = fields.find(',', start);
+        if (end == std::string::npos)
+            end = fields.size();
+        std::string name = fields.substr(start, end-start);
+        if      (name == "h")  field_mask |= 1;
+        else if (name == "hu") field_mask |= 2;
+        else if (name == "hv") field_mask |= 4;
+        else fprintf(stderr, "Unknown field (%s)\n", name.c_str());
+        start = end+1;
+    }
+    if (!field_mask)
+        field_mask = 1;
+
+    // Start from the initial conditions or pick up where a checkpoint left off
+    int    first_frame = 0;
+    double t_start     = 0;
+    if (restart_name.empty()) {
+#if defined _ENSEMBLE
+        // Member k scales the departure from a still pond by 1 + k*spread
+        for (int k = 0; k < members; ++k)
+            sim.init_member(k, [&](Sim::vec& u, double x, double y) {
+                icfun(u, x, y);
+                double a = 1 + k*spread;
+                u[0] = 1 + a*(u[0]-1);
+                u[1] = a*u[1];
+                u[2] = a*u[2];
+            });
+#else
+        sim.init(icfun);
+#endif
+    } else {
+        CheckpointHeader info;
+        if (!load_checkpoint(restart_name.c_str(), sim, Shallow2D::nfields, width, info))
+            return -1;
+        first_frame = info.frame;
+        t_start     = info.time;
+        if (first_frame > frames) {
+            fprintf(stderr, "Checkpoint is already at frame %d\n", first_frame);
+            return -1;
+        }
+    }
+
+    // Only the first rank holds the whole solution between runs
+    Checkpointer<Sim> ckpt(ckpt_name.c_str(), Shallow2D::nfields, width, ftime);
+    std::unique_ptr< SimViz<Sim> > viz;
+    if (root)
+        viz.reset(new SimViz<Sim>(fname.c_str(), sim, frames-first_frame+1, field_mask, codec));
     sim.solution_check();
-    viz.write_frame();
-    for (int i = 0; i < frames; ++i) {
+    if (root)
+        viz->write_frame(t_start);
+    for (int i = first_frame; i < frames; ++i) {
 #ifdef _OPENMP
         double t0 = omp_get_wtime();
 
@@ -176,25 +318,65 @@ int main(int argc, char** argv)
             sim.run(ftime);
         #endif
         double t1 = omp_get_wtime();
-        printf("Time: %e\n", t1-t0);
+        if (root)
+            printf("Time: %e\n", t1-t0);
 #else
         sim.run(ftime);
 #endif
         sim.solution_check();
-        viz.write_frame();
+        double t = t_start + (i+1-first_frame)*ftime;
+        if (!root)
+            continue;
+        viz->write_frame(t);
+        if (ckpt_every > 0 && (i+1) % ckpt_every == 0)
+            ckpt.save(sim, i+1, t);
     }
+    ckpt.wait();
+    viz.reset();
 
     double end_time = omp_get_wtime();
-    #if defined _SERIAL
+#if defined _PARALLEL_DIST
+    if (!root)
+        return transport::finalize();
+#endif
+    #if defined _SERIAL && defined _SOA
+        printf("#\n# [Serial SoA]\n");
+    #elif defined _SERIAL && defined _AMR
+        printf("#\n# [Serial AMR]\n");
+    #elif defined _SERIAL && defined _ENSEMBLE
+        printf("#\n# [Serial Ensemble]: %d Members%s\n", members, shared_dt ? ", shared step" : "");
+    #elif defined _SERIAL
         printf("#\n# [Serial]\n");
+        if (kernel == "tiled" && cull >= 0)
+            printf("# Culled:     %.1f%% of tile visits\n", 100*sim.culled_fraction());
     #else
         #if defined _PARALLEL_NODE
-            printf("#\n# [Node]: Thread X [%d] * Thread Y [%d] = %d Threads\n", nxblocks, nyblocks, (nxblocks*nyblocks));
+            if (schedule == "tasks" || sim.get_local_steps() > 1)
+                printf("#\n# [Node]: Tile X [%d] * Tile Y [%d] = %d Tiles on %d Threads\n", nxblocks, nyblocks, (nxblocks*nyblocks), omp_get_max_threads());
+            else
+                printf("#\n# [Node]: Thread X [%d] * Thread Y [%d] = %d Threads\n", nxblocks, nyblocks, (nxblocks*nyblocks));
+            printf("# Batch:      %d%s\n", sim.get_nbatch(), nbatch ? "" : " (tuned)");
+            if (sim.get_local_steps() > 1)
+                printf("# Local steps: up to %d per coarse step\n", sim.get_local_steps());
+        #elif defined _PARALLEL_DIST
+            printf("#\n# [Dist]: Rank X [%d] * Rank Y [%d] = %d Ranks\n", sim.get_nxblocks(), sim.get_nyblocks(), comm.size());
+            printf("# Batch:      %d\n", sim.get_nbatch());
         #else // _PARALLEL_DEVICE
             printf("#\n# [Device]: Thread X [%d] * Thread Y [%d] = %d Threads\n", nxblocks, nyblocks, (nxblocks*nyblocks));
+            printf("# Transfer:   %.16g seconds (%.16g overlapped, %.16g exposed)\n",
+                   sim.transfer_time(),
+                   std::max(0.0, sim.transfer_time() - sim.exposed_transfer_time()),
+                   sim.exposed_transfer_time());
+            printf("# Compute:    %.16g seconds\n", sim.compute_time());
         #endif
     #endif
     printf("# Sim Type:   %s\n", ic.c_str());
     printf("# Size:       %d\n", nx);
     printf("# Total Time: %.16g seconds\n#\n", end_time-start_time);
+#ifdef _STAGE_TIMERS
+    stage_report(stdout, sizeof(Sim::vec));
+#endif
+#if defined _PARALLEL_DIST
+    return transport::finalize();
+#endif
 }
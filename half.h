@@ -0,0 +1,98 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include <cstdint>
+
+//ldoc on
+/**
+ * # 16-bit storage types
+ *
+ * The solver is memory bound on large grids, so one way to make it
+ * faster is to move fewer bytes.  The two types here store a value in
+ * 16 bits and convert to and from `float` implicitly; arithmetic on
+ * them happens in `float` (the conversion to `float` is the only one
+ * defined, so `a + b` converts both sides and adds in single).  They
+ * are meant only as an array element type.
+ *
+ * `fp16` is IEEE binary16: 11 bits of significand, range up to 65504.
+ * The solver's row kernels (`simd.h`) load and store `fp16` with the
+ * F16C or AVX-512 conversion instructions where the CPU has them.  The
+ * conversions here are the fallback (the SSE kernels run them four
+ * lanes at a time) and serve element access outside the kernels.  They
+ * are done by hand in branch-free integer and float code, correctly
+ * rounded to nearest even like the hardware, so that they vectorize
+ * where GCC 12 would not vectorize `_Float16` conversions.
+ *
+ * `bf16` is bfloat16: the top half of a `float`, so the full `float`
+ * range but only 8 bits of significand.  Conversion is a shift one way
+ * and round-to-nearest-even the other, which vectorizes as integer
+ * code anywhere.  NaNs are not preserved (the solver has failed by
+ * then anyway).
+ */
+
+struct fp16 {
+    uint16_t bits;
+
+    fp16() = default;
+    fp16(float x) : bits(from_float(x)) {}
+    fp16& operator=(float x) { bits = from_float(x); return *this; }
+    operator float() const { return to_float(bits); }
+
+    // Normal numbers: shift into place with the exponent offset by
+    // 224 and scale by 2^-112, which rebiases it (Inf/NaN land on
+    // exponent 255, where the scale leaves them).
+    // Subnormals: put the significand under a float exponent of -1 and
+    // subtract 0.5.  Neither path ever touches a denormal float.
+    static inline float to_float(uint16_t h) {
+        uint32_t w = (uint32_t) h << 17;           // Drop the sign
+        union { uint32_t u; float x; } n, d, r;
+        n.u = (w >> 4) + (0xe0u << 23);
+        n.x *= 1.925929944387236e-34f;             // 2^-112
+        d.u = (w >> 17) | (126u << 23);
+        d.x -= 0.5f;
+        r.u = (w < (1u << 27) ? d.u : n.u) | ((uint32_t) (h & 0x8000) << 16);
+        return r.x;
+    }
+
+    // Round to nearest even.  Results in the subnormal range are
+    // rounded by adding 0.5f, which lines the bits we keep up with the
+    // bottom of the significand; the rest rebias and round by hand.
+    static inline uint16_t from_float(float x) {
+        union { float x; uint32_t u; } v, d;
+        v.x = x;
+        uint32_t sign = v.u & 0x80000000u;
+        v.u ^= sign;
+        d.x = v.x + 0.5f;
+        uint32_t sub = d.u - 0x3f000000u;
+        uint32_t odd = (v.u >> 13) & 1;
+        uint32_t nrm = (v.u + 0xc8000fffu + odd) >> 13;
+        uint32_t o = v.u >= 0x47800000u ? (v.u > 0x7f800000u ? 0x7e00u : 0x7c00u)
+                   : v.u <  0x38800000u ? sub : nrm;
+        return (uint16_t) (o | (sign >> 16));
+    }
+};
+
+struct bf16 {
+    uint16_t bits;
+
+    bf16() = default;
+    bf16(float x) : bits(from_float(x)) {}
+    bf16& operator=(float x) { bits = from_float(x); return *this; }
+    operator float() const {
+        union { uint32_t u; float x; } v;
+        v.u = (uint32_t) bits << 16;
+        return v.x;
+    }
+
+    // Bit copies go through a union rather than memcpy so that the
+    // conversions still vectorize inside simd loops
+    static inline uint16_t from_float(float x) {
+        union { float x; uint32_t u; } v;
+        v.x = x;
+        v.u += 0x7fff + ((v.u >> 16) & 1);
+        return (uint16_t) (v.u >> 16);
+    }
+};
+
+//ldoc off
+#endif /* HALF_H */
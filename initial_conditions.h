@@ -0,0 +1,73 @@
+#ifndef INITIAL_CONDITIONS_H
+#define INITIAL_CONDITIONS_H
+
+#include <cmath>
+#include <string>
+
+//ldoc on
+/**
+ * ## Initial states
+ *
+ * Our default problem is a circular dam break problem; the other
+ * interesting problem is the wave problem (a wave on a constant
+ * flow, starting off smooth and developing a shock in finite time).
+ * The pond and river examples should do nothing interesting at all
+ * if the numerical method is coded right.
+ *
+ * These are shared by the driver and the benchmark harness, so they
+ * are templated on the solution vector type of the simulator.
+ */
+
+// Circular dam break problem
+template <class vec>
+void dam_break(vec& u, double x, double y)
+{
+    x -= 1;
+    y -= 1;
+    u[0] = 1.0 + 0.5*(x*x + y*y < 0.25+1e-5);
+    u[1] = 0;
+    u[2] = 0;
+}
+
+// Still pond (ideally, nothing should move here!)
+template <class vec>
+void pond(vec& u, double x, double y)
+{
+    u[0] = 1.0;
+    u[1] = 0;
+    u[2] = 0;
+}
+
+// River (ideally, the solver shouldn't do much with this, either)
+template <class vec>
+void river(vec& u, double x, double y)
+{
+    u[0] = 1.0;
+    u[1] = 1.0;
+    u[2] = 0;
+}
+
+
+// Wave on a river -- develops a shock in finite time!
+template <class vec>
+void wave(vec& u, double x, double y)
+{
+    using namespace std;
+    u[0] = 1.0 + 0.2 * sin(M_PI*x);
+    u[1] = 1.0;
+    u[2] = 0;
+}
+
+// Look up an initial condition by name (nullptr if there is none)
+template <class vec>
+void (*initial_condition(const std::string& name))(vec&, double, double)
+{
+    if (name == "dam_break") return dam_break<vec>;
+    if (name == "pond")      return pond<vec>;
+    if (name == "river")     return river<vec>;
+    if (name == "wave")      return wave<vec>;
+    return nullptr;
+}
+
+//ldoc off
+#endif /* INITIAL_CONDITIONS_H */
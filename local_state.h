@@ -44,6 +44,20 @@ public:
     inline vec& fx(int ix, int iy) { return fx_[offset(ix,iy)]; }
     inline vec& gy(int ix, int iy) { return gy_[offset(ix,iy)]; }
 
+    // Change the block dimensions (the contents are not preserved)
+    void resize(int nx, int ny) {
+        this->nx = nx;
+        this->ny = ny;
+        u_.resize(nx * ny);
+        v_.resize(nx * ny);
+        f_.resize(nx * ny);
+        g_.resize(nx * ny);
+        ux_.resize(nx * ny);
+        uy_.resize(nx * ny);
+        fx_.resize(nx * ny);
+        gy_.resize(nx * ny);
+    }
+
     // Miscellaneous accessors
     inline int get_nx() { return nx; }
     inline int get_ny() { return ny; }
@@ -52,7 +66,7 @@ private:
     // Helper to calculate 1D offset from 2D coordinates
     inline int offset(int ix, int iy) const { return iy*nx+ix; }
 
-    const int nx, ny;
+    int nx, ny;
 
     #ifdef _PARALLEL_DEVICE
         typedef std::vector<vec> aligned_vector; // :'(
@@ -1,6 +1,19 @@
 #ifndef MESHIO_H
 #define MESHIO_H
 
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
 //ldoc on
 
 /**
@@ -35,42 +48,346 @@ void write_pgm(const char* fname, const Sim& u, F f)
  * 
  * An alternative to writing an image file is to write a data file for
  * further processing by some other program -- in this case, a Python
- * visualizer.  The visualizer takes the number of pixels in x and y
- * in the first two entries, then raw single-precision raster pictures.
- * 
+ * visualizer.
+ *
+ * ### Output container
+ *
+ * The file is self-describing, so that readers can find any frame
+ * without scanning the ones before it, and can memory-map a single
+ * frame out of a run too large to load.  All values are little-endian.
+ *
+ *  - A 64-byte header (`OutHeader`): the magic string `SHALLOW`, the
+ *    format version, the grid size, a mask of the stored solution
+ *    components (bit `m` for component `m`; for shallow water, bit 0
+ *    is `h`, bit 1 `hu`, bit 2 `hv`), the capacity and fill of the
+ *    frame table, and where the table starts.
+ *  - The frame table: one `OutFrame` per frame, giving the byte offset
+ *    of the frame and its simulated time.
+ *  - The frames.  Each holds the stored components one after the
+ *    other, each an `nx*ny` raster of `float`s with `x` varying
+ *    fastest.  Frames start on 4 KiB boundaries so that each can be
+ *    mapped on its own.
+ *
+ * The header's frame count is only bumped after a frame and its table
+ * entry are on disk, so a file cut short by a crash still reads back
+ * as the frames completed so far.  (Version 0, the original format,
+ * was just `nx` and `ny` as two `float`s followed by raw `h` frames;
+ * the visualizer still reads it.)
+ *
+ * ### Compressed frames
+ *
+ * Raw frames are big (a 4000-by-4000 grid is 64 MB per field per
+ * frame), and consecutive frames are very similar.  Version 2 files
+ * (`codec` 1) store each frame as a small frame header -- a flag word
+ * (bit 0 marks a keyframe, bit 1 a lossless `h`), the number of stored
+ * fields, and the compressed size of each field -- followed by the
+ * compressed fields.  Each field is coded as follows:
+ *
+ *  1. Map the values to 32-bit words.  For `h` with a positive
+ *     `tolerance`, the word is `h` rounded to a multiple of
+ *     `2*tolerance` (as a count of those steps), so the decoded `h` is
+ *     within `tolerance` of the simulated value.  Everything else is
+ *     kept losslessly as the raw `float` bits.  If some `h` is too big
+ *     for its count to fit in 32 bits, that frame keeps `h` losslessly
+ *     too and sets bit 1; it and the frame after it are keyframes, so
+ *     no prediction crosses between the two kinds of word.
+ *  2. Predict each word and keep the residual.  In a keyframe the
+ *     prediction is the previous cell in memory order; otherwise it is
+ *     the same cell in the previous frame.  Quantized words use integer
+ *     differences (modulo 2^32) and float bits use XOR, so that
+ *     unchanged cells give zero either way.
+ *  3. Shuffle the bytes, so all the low bytes come first, then all the
+ *     next bytes, and so on: the high bytes of small residuals are
+ *     long runs of zeros.
+ *  4. Deflate (zlib, fastest level).
+ *
+ * Every `keyframe`-th frame is a keyframe, so a reader only has to
+ * decode back to the last keyframe to reach any frame.  The encoding
+ * runs on the writer thread, off the solver's critical path.  A frame
+ * that fails to compress is dropped with a message, and the next frame
+ * is a keyframe so that nothing is predicted from the lost one.
+ */
+
+struct OutHeader {
+    char     magic[8];      // "SHALLOW\0"
+    uint32_t version;       // Container version (1 raw, 2 compressed)
+    uint32_t nx, ny;        // Grid size
+    uint32_t fields;        // Mask of stored components
+    uint32_t nfields;       // Number of stored components
+    uint32_t max_frames;    // Entries in the frame table
+    uint32_t nframes;       // Frames written so far
+    uint32_t codec;         // 0 raw, 1 compressed (version 2)
+    uint64_t table_offset;  // Byte offset of the frame table
+    uint64_t frame_bytes;   // Size of one raw frame's data
+    double   tolerance;     // Max error in h (0 for lossless)
+};
+
+struct OutFrame {
+    uint64_t offset;        // Byte offset of the frame data
+    double   time;          // Simulated time of the frame
+};
+
+static_assert(sizeof(OutHeader) == 64, "OutHeader layout");
+static_assert(sizeof(OutFrame)  == 16, "OutFrame layout");
+
+struct OutCodec {
+    bool   compress  = false;  // Write compressed frames?
+    double tolerance = 0;      // Max error in h (0 for lossless)
+    int    keyframe  = 16;     // Frames from one keyframe to the next
+};
+
+/**
+ * ### Writer
+ *
+ * Writing a frame should not hold up the solver.  `write_frame` only
+ * copies the selected fields into a snapshot buffer; a background
+ * thread then writes the snapshot with `pwrite` at its place in the
+ * file while the next `run` is already under way.  There are two
+ * buffers, so the next snapshot can be taken while the previous one is
+ * still being written; only if the writer is more than a frame behind
+ * does `write_frame` wait for it.  Frames beyond the table capacity
+ * given to the constructor are dropped with a warning.
  */
 
 template <class Sim>
 class SimViz {
 public:
-    
-    SimViz(const char* fname, const Sim& sim) : sim(sim) {
-        fp = fopen(fname, "w");
-        if (fp) {
-            float xy[2];
-            xy[0] = sim.xsize();
-            xy[1] = sim.ysize();
-            fwrite(xy, sizeof(float), 2, fp);
+
+    SimViz(const char* fname, const Sim& sim,
+           int max_frames,                   // Capacity of the frame table
+           unsigned fields = 1,              // Mask of components to store
+           const OutCodec& codec = OutCodec()) :
+        sim(sim),
+        npixels(sim.xsize() * sim.ysize()),
+        nfields(count_fields(fields)),
+        codec(codec),
+        fill(nfields * npixels), drain(nfields * npixels) {
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "SHALLOW", 8);
+        header.version      = 1;
+        header.nx           = sim.xsize();
+        header.ny           = sim.ysize();
+        header.fields       = fields;
+        header.nfields      = nfields;
+        header.max_frames   = max_frames;
+        header.table_offset = sizeof(OutHeader);
+        header.frame_bytes  = sizeof(float) * nfields * npixels;
+        if (codec.compress) {
+            header.version   = 2;
+            header.codec     = 1;
+            header.tolerance = codec.tolerance;
+            previous.resize(nfields * npixels);
+            residual.resize(npixels);
+            shuffled.resize(sizeof(uint32_t) * npixels);
+            packed.resize(sizeof(uint64_t) * (nfields+1) +
+                          nfields * compressBound(shuffled.size()));
+        }
+        next_offset = align(header.table_offset + sizeof(OutFrame) * max_frames);
+
+        fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            pwrite_all(&header, sizeof(header), 0);
+            writer = std::thread(&SimViz::write_loop, this);
         }
     }
 
-    void write_frame() {
-        if (fp)
+    void write_frame(double t) {
+        if (fd < 0)
+            return;
+        if (nqueued == header.max_frames) {
+            fprintf(stderr, "Frame table full; frame at t=%g dropped\n", t);
+            return;
+        }
+        ++nqueued;
+
+        // Snapshot the selected fields
+        float *frame = fill.data();
+        for (int m = 0; m < 32; ++m) {
+            if (!(header.fields & (1u << m)))
+                continue;
             for (int j = 0; j < sim.ysize(); ++j)
-                for (int i = 0; i < sim.xsize(); ++i) {
-                    float uij = sim(i,j)[0];
-                    fwrite(&uij, sizeof(float), 1, fp);
-                }
+                for (int i = 0; i < sim.xsize(); ++i)
+                    *frame++ = sim(i,j)[m];
+        }
+
+        // Hand the snapshot to the writer once it is done with the last
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return !pending; });
+        fill.swap(drain);
+        drain_time = t;
+        pending = true;
+        ready.notify_one();
     }
-    
+
     ~SimViz() {
-        if (fp)
-            fclose(fp);
+        if (fd >= 0) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closing = true;
+                ready.notify_one();
+            }
+            writer.join();
+            close(fd);
+        }
     }
-    
+
 private:
     const Sim& sim;
-    FILE* fp;
+    const int npixels;
+    const int nfields;
+    const OutCodec codec;
+    int fd;
+
+    OutHeader header;      // Owned by the writer once it is running
+    uint64_t next_offset;  // Where the next frame goes
+    uint32_t nqueued = 0;  // Frames handed to the writer
+
+    // Double buffer: the solver fills one while the writer drains the other
+    std::vector<float> fill, drain;
+    double drain_time;
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable ready;  // A snapshot is waiting (or closing)
+    std::condition_variable idle;   // The writer has finished a snapshot
+    bool pending = false;
+    bool closing = false;
+
+    // Encoder state (writer thread only)
+    std::vector<uint32_t> previous;  // Last frame's words, for prediction
+    std::vector<uint32_t> residual;
+    std::vector<uint8_t>  shuffled;
+    std::vector<uint8_t>  packed;    // Encoded frame
+    bool force_key = false;          // Next frame must be a keyframe
+
+    static int count_fields(unsigned fields) {
+        int n = 0;
+        for (; fields; fields >>= 1)
+            n += fields & 1;
+        return n;
+    }
+
+    static uint64_t align(uint64_t offset) {
+        return (offset + 4095) & ~uint64_t(4095);
+    }
+
+    void pwrite_all(const void* buf, size_t bytes, uint64_t offset) {
+        const char* p = static_cast<const char*>(buf);
+        while (bytes > 0) {
+            ssize_t n = pwrite(fd, p, bytes, offset);
+            if (n < 0) {
+                perror("SimViz");
+                return;
+            }
+            p += n;
+            bytes  -= n;
+            offset += n;
+        }
+    }
+
+    // Do all of h fit in 32-bit counts of step?  (NaNs do not.)
+    bool fits_quantized(const float* values, double step) const {
+        for (int k = 0; k < npixels; ++k)
+            if (!(std::fabs(values[k] / step) < 2147483647.0))
+                return false;
+        return true;
+    }
+
+    // Encode drain into packed; returns the encoded size, or 0 on failure
+    uint64_t encode_frame(bool key) {
+        const double step = 2*codec.tolerance;
+        bool quantize_h = codec.tolerance > 0 && (header.fields & 1);
+        bool lossless_h = quantize_h && !fits_quantized(drain.data(), step);
+        if (lossless_h) {
+            fprintf(stderr, "h too large for tolerance %g at t=%g; "
+                    "frame kept lossless\n", codec.tolerance, drain_time);
+            quantize_h = false;
+        }
+        key = key || force_key || lossless_h;
+        force_key = lossless_h;
+
+        uint32_t *frame_header = reinterpret_cast<uint32_t*>(packed.data());
+        uint64_t *sizes = reinterpret_cast<uint64_t*>(packed.data()) + 1;
+        frame_header[0] = (key ? 1 : 0) | (lossless_h ? 2 : 0);
+        frame_header[1] = nfields;
+        uint64_t used = sizeof(uint64_t) * (nfields+1);
+
+        for (int f = 0; f < nfields; ++f) {
+            const float *values = drain.data() + f*npixels;
+            uint32_t *prev = previous.data() + f*npixels;
+
+            // Words and residuals
+            if (f == 0 && quantize_h) {
+                uint32_t last = 0;
+                for (int k = 0; k < npixels; ++k) {
+                    uint32_t word = (uint32_t) (int32_t) lrint(values[k] / step);
+                    residual[k] = word - (key ? last : prev[k]);
+                    prev[k] = last = word;
+                }
+            } else {
+                uint32_t last = 0;
+                for (int k = 0; k < npixels; ++k) {
+                    uint32_t word;
+                    std::memcpy(&word, values+k, sizeof(word));
+                    residual[k] = word ^ (key ? last : prev[k]);
+                    prev[k] = last = word;
+                }
+            }
+
+            // Byte shuffle
+            for (int b = 0; b < 4; ++b) {
+                uint8_t *plane = shuffled.data() + b*npixels;
+                for (int k = 0; k < npixels; ++k)
+                    plane[k] = residual[k] >> (8*b);
+            }
+
+            uLongf zbytes = packed.size() - used;
+            int status = compress2(packed.data() + used, &zbytes,
+                                   shuffled.data(), shuffled.size(), Z_BEST_SPEED);
+            if (status != Z_OK) {
+                fprintf(stderr, "Could not compress frame at t=%g (zlib error %d); "
+                        "frame dropped\n", drain_time, status);
+                force_key = true;
+                return 0;
+            }
+            sizes[f] = zbytes;
+            used += zbytes;
+        }
+        return used;
+    }
+
+    void write_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            ready.wait(lock, [this] { return pending || closing; });
+            if (!pending)
+                return;
+
+            // Nobody touches drain while pending is set
+            lock.unlock();
+            OutFrame entry = { next_offset, drain_time };
+            const void* data  = drain.data();
+            uint64_t    bytes = header.frame_bytes;
+            if (codec.compress) {
+                bytes = encode_frame(header.nframes % codec.keyframe == 0);
+                data  = packed.data();
+            }
+            if (bytes > 0) {
+                pwrite_all(data, bytes, entry.offset);
+                pwrite_all(&entry, sizeof(entry),
+                           header.table_offset + sizeof(OutFrame) * header.nframes);
+                ++header.nframes;
+                pwrite_all(&header.nframes, sizeof(header.nframes),
+                           offsetof(OutHeader, nframes));
+                next_offset = align(next_offset + bytes);
+            }
+            lock.lock();
+
+            pending = false;
+            idle.notify_one();
+        }
+    }
 };
 
 
@@ -1,6 +1,8 @@
 #ifndef MINMOD_H
 #define MINMOD_H
 
+#include "simd.h"
+
 #ifdef _PARALLEL_DEVICE
     #pragma offload_attribute(push,target(mic))
 #endif
@@ -55,6 +57,11 @@
  * for floating point arguments (translating them to branch-free
  * intrinsic operations), this implementation should be relatively fast.
  * 
+ * Compilers other than icc often don't, so the solvers take their
+ * slopes a row at a time from `limdiff_row`, which for `float` and
+ * `double` runs the hand-vectorized copy of the same function in
+ * `simd.h`.
+ * 
  * There are many other potential choices of limiters as well.  We'll
  * stick with this one for the code, but you should feel free to
  * experiment with others if you know what you're doing and think it
@@ -68,10 +75,10 @@ struct MinMod {
     // Branch-free computation of minmod of two numbers
     #pragma omp declare simd
     static inline real xmin2s(real s, real a, real b) {
-        real sa = copysignf(s, a);
-        real sb = copysignf(s, b);
-        real abs_a = fabsf(a);
-        real abs_b = fabsf(b);
+        real sa = std::copysign(s, a);
+        real sb = std::copysign(s, b);
+        real abs_a = std::fabs(a);
+        real abs_b = std::fabs(b);
         real min_abs = (abs_a < abs_b ? abs_a : abs_b);
         return (sa+sb) * min_abs;
     }
@@ -85,6 +92,24 @@ struct MinMod {
         return xmin2s( 0.25f, xmin2s(theta, du1, du2), duc );
     }
 
+    // Limited slopes along a run of n values: du[i] from u[i-s], u[i]
+    // and u[i+s], with the vector kernel for the running CPU
+    static inline void limdiff_row(real *du, const real *u, int n, int s) {
+        simd::kernels<real>().minmod(du, u, n, s, theta);
+    }
+
+    // IEEE half storage: the kernels convert in registers
+    static inline void limdiff_row(fp16 *du, const fp16 *u, int n, int s) {
+        simd::kernels<real, fp16>().minmod(du, u, n, s, theta);
+    }
+
+    // The same for other element types (bfloat16 storage)
+    template <class T>
+    static inline void limdiff_row(T *du, const T *u, int n, int s) {
+        #pragma omp simd
+        for (int i = 0; i < n; ++i)
+            du[i] = limdiff(u[i-s], u[i], u[i+s]);
+    }
 
 };
 
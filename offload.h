@@ -0,0 +1,227 @@
+#ifndef OFFLOAD_H
+#define OFFLOAD_H
+
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <omp.h>
+
+//ldoc on
+/**
+ * # Offload layer
+ *
+ * The device solver in `central2d_pdevice.h` was written for a Xeon Phi
+ * coprocessor: the host stages the solution into device memory, a
+ * kernel runs there on raw pointers and a `Parameters` struct, and the
+ * result is copied back.  With the Intel offload compiler those steps
+ * are `#pragma offload` clauses.  Everywhere else, this header supplies
+ * the same steps as ordinary calls, so that the accelerator-style code
+ * path still runs (and can be timed) on a plain host.
+ *
+ * There are two backends:
+ *
+ *  - `_OFFLOAD_OMP_TARGET`: device memory comes from the OpenMP 4.5
+ *    device API (`omp_target_alloc`, `omp_target_memcpy`) and the
+ *    kernel is launched with `#pragma omp target`.  If no device is
+ *    available, the OpenMP runtime falls back to the host.
+ *  - Otherwise, host emulation: the "device" is a separate aligned
+ *    allocation, and transfers are real copies between the two.
+ *
+ * Transfers are either synchronous or started asynchronously, in which
+ * case the copy runs on a helper thread and is finished with `wait`;
+ * the device solver uses the latter to bring a frame back while the
+ * next frame's kernel runs.  To study how well transfers overlap with
+ * computation on a machine where copies are nearly free, the
+ * environment variable `OFFLOAD_EMULATE_GBPS` caps the emulated link at
+ * the given bandwidth (in GB/s) by stretching every host-device
+ * transfer to the time it would take on such a link.  Copies within
+ * device memory do not cross the link and are not stretched.
+ */
+
+namespace offload {
+
+// Device to run on (the host in the emulation backend)
+inline int device()
+{
+#ifdef _OFFLOAD_OMP_TARGET
+    return omp_get_default_device();
+#else
+    return 0;
+#endif
+}
+
+// Emulated link bandwidth in bytes per second (0 for unlimited)
+inline double link_bandwidth()
+{
+    static const double bw = [] {
+        const char* s = getenv("OFFLOAD_EMULATE_GBPS");
+        return s ? atof(s) * 1e9 : 0.0;
+    }();
+    return bw;
+}
+
+inline void* device_alloc(size_t bytes)
+{
+#ifdef _OFFLOAD_OMP_TARGET
+    return omp_target_alloc(bytes, device());
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, 64, bytes))
+        return nullptr;
+    return p;
+#endif
+}
+
+inline void device_free(void* p)
+{
+#ifdef _OFFLOAD_OMP_TARGET
+    omp_target_free(p, device());
+#else
+    free(p);
+#endif
+}
+
+// Copy between host and device memory (to_device picks the direction)
+inline void copy(void* dst, const void* src, size_t bytes, bool to_device)
+{
+    double t0 = omp_get_wtime();
+#ifdef _OFFLOAD_OMP_TARGET
+    int host = omp_get_initial_device();
+    omp_target_memcpy(dst, const_cast<void*>(src), bytes, 0, 0,
+                      to_device ? device() : host,
+                      to_device ? host : device());
+#else
+    (void) to_device;
+    memcpy(dst, src, bytes);
+#endif
+    double bw = link_bandwidth();
+    if (bw > 0) {
+        double left = bytes/bw - (omp_get_wtime()-t0);
+        if (left > 0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(left));
+    }
+}
+
+// Copy within device memory
+inline void copy_on_device(void* dst, const void* src, size_t bytes)
+{
+#ifdef _OFFLOAD_OMP_TARGET
+    omp_target_memcpy(dst, const_cast<void*>(src), bytes, 0, 0,
+                      device(), device());
+#else
+    memcpy(dst, src, bytes);
+#endif
+}
+
+// Timed synchronous copy between host and device; returns the seconds taken
+inline double timed_copy(void* dst, const void* src, size_t bytes, bool to_device)
+{
+    double t0 = omp_get_wtime();
+    copy(dst, src, bytes, to_device);
+    return omp_get_wtime() - t0;
+}
+
+/**
+ * ## Transfers
+ *
+ * A `Transfer` is a copy in flight.  It must be waited on before
+ * either buffer is touched again; the destructor waits if nobody did.
+ * `seconds` is the wall time the copy itself took.
+ */
+
+class Transfer {
+public:
+    Transfer() = default;
+    Transfer(void* dst, const void* src, size_t bytes, bool to_device)
+        : seconds(std::make_shared<double>(0)) {
+        std::shared_ptr<double> elapsed = seconds;
+        worker = std::thread([=] {
+            *elapsed = timed_copy(dst, src, bytes, to_device);
+        });
+    }
+
+    Transfer(Transfer&& other) = default;
+    Transfer& operator=(Transfer&& other) {
+        wait();
+        worker  = std::move(other.worker);
+        seconds = std::move(other.seconds);
+        return *this;
+    }
+
+    ~Transfer() { wait(); }
+
+    // Block until the copy is done; returns how long it took
+    double wait() {
+        if (worker.joinable())
+            worker.join();
+        return seconds ? *seconds : 0;
+    }
+
+private:
+    std::thread worker;
+    std::shared_ptr<double> seconds;
+};
+
+/**
+ * ## Device buffers
+ *
+ * A `DeviceBuffer<T>` owns `n` elements of device memory.  `data()` is
+ * a device pointer, only to be dereferenced inside a kernel.
+ */
+
+template <class T>
+class DeviceBuffer {
+public:
+    DeviceBuffer() = default;
+    DeviceBuffer(const DeviceBuffer&) = delete;
+    DeviceBuffer& operator=(const DeviceBuffer&) = delete;
+    ~DeviceBuffer() { release(); }
+
+    void resize(size_t n) {
+        if (n == n_)
+            return;
+        release();
+        p_ = static_cast<T*>(device_alloc(n * sizeof(T)));
+        n_ = n;
+    }
+
+    void release() {
+        if (p_)
+            device_free(p_);
+        p_ = nullptr;
+        n_ = 0;
+    }
+
+    T*     data()       { return p_; }
+    size_t size() const { return n_; }
+
+    // Copy n elements in or out, starting at element offset
+    Transfer upload_async(const T* src, size_t n, size_t offset = 0) {
+        return Transfer(p_ + offset, src, n * sizeof(T), true);
+    }
+    Transfer download_async(T* dst, size_t n, size_t offset = 0) {
+        return Transfer(dst, p_ + offset, n * sizeof(T), false);
+    }
+    double upload(const T* src, size_t n, size_t offset = 0) {
+        return timed_copy(p_ + offset, src, n * sizeof(T), true);
+    }
+    double download(T* dst, size_t n, size_t offset = 0) {
+        return timed_copy(dst, p_ + offset, n * sizeof(T), false);
+    }
+
+    // Copy the first n elements of another device buffer
+    void copy_from(const DeviceBuffer& src, size_t n) {
+        copy_on_device(p_, src.p_, n * sizeof(T));
+    }
+
+private:
+    T*     p_ = nullptr;
+    size_t n_ = 0;
+};
+
+} // namespace offload
+
+//ldoc off
+#endif /* OFFLOAD_H */
@@ -0,0 +1,183 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+//ldoc on
+/**
+ * # Hardware counters
+ *
+ * With `-D_STAGE_PERF`, the stage timers also read hardware counters
+ * through Linux `perf_event_open`, so no external profiler is needed.
+ * Each thread opens one counter group for itself (user space only, so
+ * the default `perf_event_paranoid` setting allows it) and reads the
+ * whole group with a single `read` at each end of a timed stage.
+ *
+ * The group counts cycles, instructions, last-level cache misses and,
+ * where we know the raw event, retired packed floating point
+ * instructions.  The last one is model specific: on Intel parts it is
+ * `FP_ARITH_INST_RETIRED` with all the packed umasks (raw `0xfcc7`);
+ * elsewhere set `STAGE_PERF_VECTOR_EVENT` to the raw event code (in
+ * hex), or go without.  Events that cannot be opened are dropped from
+ * the group, and if none can (no PMU in a VM, say) the counters simply
+ * read zero.
+ */
+
+namespace perf {
+
+enum Event { CYCLES, INSTRUCTIONS, LLC_MISSES, VECTOR_OPS, NEVENTS };
+
+static const char* const event_names[NEVENTS] = {
+    "cycles", "instructions", "llc_misses", "vector_ops"
+};
+
+// Raw code for packed FP instructions on this machine (0 if unknown)
+inline uint64_t vector_event()
+{
+    if (const char* s = getenv("STAGE_PERF_VECTOR_EVENT"))
+        return strtoull(s, nullptr, 16);
+
+    FILE* fp = fopen("/proc/cpuinfo", "r");
+    if (!fp)
+        return 0;
+    char line[256];
+    bool intel = false;
+    while (fgets(line, sizeof(line), fp))
+        if (strncmp(line, "vendor_id", 9) == 0) {
+            intel = strstr(line, "GenuineIntel") != nullptr;
+            break;
+        }
+    fclose(fp);
+    return intel ? 0xfcc7 : 0;
+}
+
+class CounterGroup {
+public:
+    CounterGroup() {}
+    CounterGroup(const CounterGroup&) = delete;
+    ~CounterGroup() {
+        for (int fd : fds)
+            close(fd);
+    }
+
+    // Open the group for the calling thread (once)
+    void open() {
+        if (opened)
+            return;
+        opened = true;
+
+        uint32_t types[NEVENTS]  = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                     PERF_TYPE_HARDWARE, PERF_TYPE_RAW };
+        uint64_t configs[NEVENTS] = { PERF_COUNT_HW_CPU_CYCLES,
+                                      PERF_COUNT_HW_INSTRUCTIONS,
+                                      PERF_COUNT_HW_CACHE_MISSES,
+                                      vector_event() };
+        int leader = -1;
+        for (int e = 0; e < NEVENTS; ++e) {
+            if (types[e] == PERF_TYPE_RAW && !configs[e])
+                continue;
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size           = sizeof(attr);
+            attr.type           = types[e];
+            attr.config         = configs[e];
+            attr.disabled       = (leader < 0);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.read_format    = PERF_FORMAT_GROUP;
+            int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fd < 0)
+                continue;
+            if (leader < 0)
+                leader = fd;
+            fds.push_back(fd);
+            events.push_back(e);
+        }
+        if (leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    bool active() const { return !fds.empty(); }
+
+    // Which events made it into the group
+    bool has(Event e) const {
+        for (int k : events)
+            if (k == e)
+                return true;
+        return false;
+    }
+
+    // Current counts (zero for events not in the group)
+    void read(uint64_t counts[NEVENTS]) const {
+        for (int e = 0; e < NEVENTS; ++e)
+            counts[e] = 0;
+        if (fds.empty())
+            return;
+        uint64_t buf[1+NEVENTS];
+        if (::read(fds[0], buf, sizeof(buf)) < (ssize_t) sizeof(uint64_t))
+            return;
+        for (uint64_t k = 0; k < buf[0] && k < events.size(); ++k)
+            counts[events[k]] = buf[1+k];
+    }
+
+private:
+    bool opened = false;
+    std::vector<int> fds;     // Leader first
+    std::vector<int> events;  // Event counted by each fd
+};
+
+/**
+ * ## Memory bandwidth
+ *
+ * The roofline needs the bandwidth this machine can actually sustain,
+ * which we measure with the STREAM triad `a = b + s*c` on the full
+ * thread team.  The arrays are sized well past the last-level cache,
+ * first-touched in parallel, and we keep the best of a few passes.
+ * Bytes are counted the STREAM way (three arrays per pass).
+ */
+
+inline double stream_bandwidth()
+{
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    size_t n = std::max<size_t>(8 << 20, llc > 0 ? 4*llc/sizeof(double) : 0);
+    double *a = new double[n], *b = new double[n], *c = new double[n];
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = 0;
+        b[i] = 1;
+        c[i] = 2;
+    }
+
+    double best = 0;
+    for (int pass = 0; pass < 5; ++pass) {
+        double t0 = omp_get_wtime();
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i)
+            a[i] = b[i] + 3.0*c[i];
+        double t1 = omp_get_wtime();
+        best = std::max(best, 3*n*sizeof(double) / (t1-t0));
+    }
+
+    delete[] a;
+    delete[] b;
+    delete[] c;
+    return best;
+}
+
+} // namespace perf
+
+//ldoc off
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,139 @@
+#!/usr/bin/env python
+
+"""
+Run the shallow water solver in-process.
+
+Loads libshallow.so (or the library named by $SHALLOW_LIB, e.g. the
+node build libshallow-pnode.so) through its C interface (shallow_api.h).
+The solution is exposed as numpy arrays that view the solver's own
+storage, so analysis code can look at (and change) the state between
+calls to run() without copying it or writing output files:
+
+    import shallow
+    sim = shallow.Sim(200)
+    sim.init("dam_break")
+    for frame in range(50):
+        sim.run(0.01)
+        print(sim.time, sim.h.max())
+"""
+
+import ctypes
+import os
+import numpy as np
+
+
+class View(ctypes.Structure):
+    """Mirror of shallow_view in shallow_api.h."""
+    _fields_ = [('data', ctypes.c_void_p),
+                ('nx', ctypes.c_int), ('ny', ctypes.c_int),
+                ('nfields', ctypes.c_int), ('elsize', ctypes.c_int),
+                ('strides', ctypes.c_long * 3)]
+
+
+def load_library(path=None):
+    """Load the solver library and declare the C interface."""
+    if path is None:
+        path = os.environ.get('SHALLOW_LIB',
+                              os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                           'libshallow.so'))
+    lib = ctypes.CDLL(path)
+    sim_p = ctypes.c_void_p
+    lib.shallow_new.restype = sim_p
+    lib.shallow_new.argtypes = [ctypes.c_double, ctypes.c_double,
+                                ctypes.c_int, ctypes.c_int,
+                                ctypes.c_int, ctypes.c_int, ctypes.c_int]
+    lib.shallow_free.argtypes = [sim_p]
+    lib.shallow_init.argtypes = [sim_p, ctypes.c_char_p]
+    lib.shallow_set_kernel.argtypes = [sim_p, ctypes.c_char_p, ctypes.c_int]
+    lib.shallow_set_schedule.argtypes = [sim_p, ctypes.c_char_p]
+    lib.shallow_run.argtypes = [sim_p, ctypes.c_double]
+    lib.shallow_view_state.argtypes = [sim_p, ctypes.POINTER(View)]
+    lib.shallow_check.argtypes = [sim_p]
+    return lib
+
+
+class Sim(object):
+    """A simulator living in the solver library.
+
+    Attributes:
+        nx, ny: Grid size
+        time: Simulated time so far (the sum of the run() intervals)
+        u: Solution as an (ny, nx, 3) array of (h, hu, hv), indexed
+           [j, i, m] like the solver's sim(i,j)[m]
+        h, hu, hv: The components of u
+
+    The arrays are views of the solver's storage: writing to them
+    changes the state the next run() starts from.  Some kernels swap
+    storage at the end of a run, so get fresh views after each run()
+    rather than holding on to old ones.
+    """
+
+    def __init__(self, nx, ny=None, width=2.0, height=None,
+                 blocks=(1, 1), nbatch=1, lib=None):
+        self.lib = lib if lib is not None else load_library()
+        self.nx = nx
+        self.ny = ny if ny is not None else nx
+        height = height if height is not None else width * self.ny / nx
+        self.sim = self.lib.shallow_new(width, height, self.nx, self.ny,
+                                        blocks[0], blocks[1], nbatch)
+        if not self.sim:
+            raise RuntimeError("Could not create the simulator")
+        self.time = 0.0
+
+    def __del__(self):
+        if getattr(self, 'sim', None):
+            self.lib.shallow_free(self.sim)
+            self.sim = None
+
+    def _check(self, status, what):
+        if status != 0:
+            raise ValueError("Could not set %s" % what)
+
+    def init(self, ic):
+        """Set named initial conditions (dam_break, pond, river, wave)."""
+        self._check(self.lib.shallow_init(self.sim, ic.encode()),
+                    "initial conditions %s" % ic)
+        self.time = 0.0
+
+    def set_kernel(self, kernel, tile=0):
+        """Serial library: 'staged', 'fused' or 'tiled'."""
+        self._check(self.lib.shallow_set_kernel(self.sim, kernel.encode(), tile),
+                    "kernel %s" % kernel)
+
+    def set_schedule(self, schedule):
+        """Node library: 'fork', 'persistent' or 'tasks'."""
+        self._check(self.lib.shallow_set_schedule(self.sim, schedule.encode()),
+                    "schedule %s" % schedule)
+
+    def run(self, t):
+        """Advance by time t."""
+        self.lib.shallow_run(self.sim, t)
+        self.time += t
+
+    def check(self):
+        """Print volume, momentum and the range of h."""
+        self.lib.shallow_check(self.sim)
+
+    @property
+    def u(self):
+        view = View()
+        self.lib.shallow_view_state(self.sim, ctypes.byref(view))
+        dtype = np.float32 if view.elsize == 4 else np.float64
+        shape = (view.ny, view.nx, view.nfields)
+        strides = tuple(view.strides)
+        span = sum((n-1)*s for n, s in zip(shape, strides)) + view.elsize
+        buf = (ctypes.c_char * span).from_address(view.data)
+        buf.owner = self  # Keep the solver alive as long as the view
+        return np.ndarray(shape, dtype=dtype, buffer=buf, strides=strides)
+
+    @property
+    def h(self):
+        return self.u[:, :, 0]
+
+    @property
+    def hu(self):
+        return self.u[:, :, 1]
+
+    @property
+    def hv(self):
+        return self.u[:, :, 2]
@@ -9,6 +9,8 @@
 #if defined _PARALLEL_DEVICE
     #pragma offload_attribute(pop)
 #endif
+#include "half.h"
+#include "simd.h"
 
 //ldoc on
 /**
@@ -55,13 +57,40 @@
  * Our solver takes advantage of C++ templates to get (potentially)
  * good performance while keeping a clean abstraction between the
  * solver code and the details of the physics.  The `Shallow2D`
- * class specifies the precision of the comptutation (single precision),
+ * class specifies the precision of the comptutation,
  * the data type used to represent vectors of unknowns and fluxes
  * (the C++ `std::array`).  We are really only using the class as 
  * name space; we never create an instance of type `Shallow2D`,
  * and the `flux` and `wave_speed` functions needed by the solver are
  * declared as static (and inline, in the hopes of getting the compiler
  * to optimize for us).
+ *
+ * ## Precision
+ *
+ * The physics is a template on two types: `real`, in which the state
+ * is stored and the fluxes are computed, and `accum`, in which the
+ * solvers accumulate the long sums that decide how well mass and
+ * momentum are conserved (the corrector update and the totals in
+ * `solution_check`).  `Shallow2D` is the instance the build asks for:
+ *
+ *  - single precision (the default): `float` throughout;
+ *  - `-D_DOUBLE`: `double` throughout, at twice the memory traffic;
+ *  - `-D_MIXED`: `float` storage with `double` accumulation, so the
+ *    traffic stays that of single precision;
+ *  - `-D_HALF` or `-D_BFLOAT16`: `float` arithmetic on 16-bit storage
+ *    (see `half.h`), at half the traffic of single precision.
+ *
+ * The storage type is a third parameter, `store`.  Only the planar
+ * (`SoA`) solver keeps its arrays in `store`; the strided `flux` and
+ * `wave_speed` below take pointers to whatever the arrays hold and
+ * convert as they load and store.  The other solvers ignore it.
+ *
+ * The `_row` variants apply the strided functions to `n` consecutive
+ * cells.  When the arrays hold `real` or `fp16` they run the
+ * hand-vectorized kernels of `simd.h` (chosen for the CPU at run time);
+ * otherwise they fall back to a loop over the cell functions.
+ *
+ * Output files are written in single precision in every mode.
  */
 
 /* The following allows for minimal SIMD vectorization using GCC,
@@ -86,13 +115,14 @@
     #define TARGET_MIC /* n/a */
 #endif
 
-struct Shallow2D {
+template <class real_t, class accum_t = real_t, class store_t = real_t>
+struct BasicShallow2D {
 
     // global constants for alignment
     TARGET_MIC
     static constexpr int vec_size  = 4;
     TARGET_MIC
-    static constexpr int VEC_ALIGN = 16;
+    static constexpr int VEC_ALIGN = vec_size * sizeof(real_t);
     #if defined _PARALLEL_DEVICE
         TARGET_MIC
         static constexpr int BYTE_ALIGN = 64;
@@ -100,13 +130,19 @@ struct Shallow2D {
         static constexpr int BYTE_ALIGN = 32;
     #endif
 
+    // Number of meaningful entries in a vec (the rest is padding)
+    TARGET_MIC
+    static constexpr int nfields = 3;
+
     // Type parameters for solver
-    typedef float real;
+    typedef real_t  real;
+    typedef accum_t accum;
+    typedef store_t store;
     typedef std::array<real, vec_size> vec;
 
     // Gravitational force (compile time constant)
     TARGET_MIC
-    static constexpr real g = 9.8f;
+    static constexpr real g = 9.8;
 
     // Compute shallow water fluxes F(U), G(U)
     TARGET_MIC
@@ -137,7 +173,87 @@ struct Shallow2D {
         cx = fabs(hu/h) + root_gh;
         cy = fabs(hv/h) + root_gh;
     }
+
+    // Strided variants for planar (SoA) storage: component m of the
+    // cell lives at U[m*stride] rather than U[m], and T may be a
+    // narrower storage type than real.
+    template <class T>
+    TARGET_MIC
+    static inline void flux(T *FU, T *GU, const T *U, int stride) {
+        real h = U[0], hu = U[stride], hv = U[2*stride];
+
+        FU[0]        = hu;
+        FU[stride]   = hu*hu/h + (0.5f*g)*h*h;
+        FU[2*stride] = hu*hv/h;
+
+        GU[0]        = hv;
+        GU[stride]   = hu*hv/h;
+        GU[2*stride] = hv*hv/h + (0.5f*g)*h*h;
+    }
+
+    template <class T>
+    TARGET_MIC
+    static inline void wave_speed(real& cx, real& cy, const T *U, int stride) {
+        using namespace std;
+        real h = U[0], hu = U[stride], hv = U[2*stride];
+        real root_gh = sqrt(g * h);  // NB: Don't let h go negative!
+        cx = fabs(hu/h) + root_gh;
+        cy = fabs(hv/h) + root_gh;
+    }
+
+    // Fluxes of n consecutive planar cells
+    static inline void flux_row(real *FU, real *GU, const real *U, int n, int stride) {
+        simd::kernels<real>().flux(FU, GU, U, n, stride, g);
+    }
+
+    // IEEE half storage converts in the kernels, with F16C where there is one
+    static inline void flux_row(fp16 *FU, fp16 *GU, const fp16 *U, int n, int stride) {
+        simd::kernels<real, fp16>().flux(FU, GU, U, n, stride, g);
+    }
+
+    template <class T>
+    static inline void flux_row(T *FU, T *GU, const T *U, int n, int stride) {
+        #pragma omp simd
+        for (int i = 0; i < n; ++i)
+            flux(FU+i, GU+i, U+i, stride);
+    }
+
+    // Fold the wave speeds of n consecutive planar cells into cx, cy
+    static inline void wave_speed_row(real& cx, real& cy, const real *U, int n, int stride) {
+        simd::kernels<real>().wave_speed(cx, cy, U, n, stride, g);
+    }
+
+    static inline void wave_speed_row(real& cx, real& cy, const fp16 *U, int n, int stride) {
+        simd::kernels<real, fp16>().wave_speed(cx, cy, U, n, stride, g);
+    }
+
+    template <class T>
+    static inline void wave_speed_row(real& cx_, real& cy_, const T *U, int n, int stride) {
+        using namespace std;
+        real cx = cx_, cy = cy_;
+        #pragma omp simd reduction(max:cx,cy)
+        for (int i = 0; i < n; ++i) {
+            real cell_cx, cell_cy;
+            wave_speed(cell_cx, cell_cy, U+i, stride);
+            cx = max(cx, cell_cx);
+            cy = max(cy, cell_cy);
+        }
+        cx_ = cx;
+        cy_ = cy;
+    }
 };
 
+#if defined _DOUBLE
+typedef BasicShallow2D<double> Shallow2D;
+#elif defined _MIXED
+typedef BasicShallow2D<float, double> Shallow2D;
+#elif defined _HALF
+typedef BasicShallow2D<float, float, fp16> Shallow2D;
+#elif defined _BFLOAT16
+typedef BasicShallow2D<float, float, bf16> Shallow2D;
+#else
+typedef BasicShallow2D<float> Shallow2D;
+#endif
+
 //ldoc off
 #endif /* SHALLOW2D_H */
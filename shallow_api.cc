@@ -0,0 +1,163 @@
+#if defined _SERIAL
+    #include "central2d.h"
+#elif defined _PARALLEL_NODE
+    #include "central2d_pnode.h"
+#endif
+#include "shallow2d.h"
+#include "minmod.h"
+#include "initial_conditions.h"
+#include "shallow_api.h"
+
+#include <string>
+#include <new>
+#include <cstdio>
+
+//ldoc on
+/**
+ * ## C interface implementation
+ *
+ * The opaque `shallow_sim` is the same simulator type the driver uses,
+ * plus the batch depth that the serial tiled kernel needs later.  The
+ * solvers want their members aligned to the vector width, which plain
+ * `new` does not promise, so the handle is placed in `_mm_malloc`
+ * storage as the arrays are.  Nothing here reaches into the solver:
+ * the view is worked out from the addresses of a few cells, so it
+ * follows whatever layout and ghost padding the solver uses.
+ */
+
+typedef Central2D< Shallow2D, MinMod<Shallow2D::real> > Sim;
+
+struct shallow_sim {
+    Sim sim;
+    int nbatch;
+
+    shallow_sim(double w, double h, int nx, int ny,
+                int nxblocks, int nyblocks, int nbatch) :
+#if defined _PARALLEL_NODE
+        sim(w,h, nx,ny, nxblocks,nyblocks, nbatch),
+#else
+        sim(w,h, nx,ny),
+#endif
+        nbatch(nbatch > 0 ? nbatch : 1) {}
+};
+
+extern "C" {
+
+shallow_sim* shallow_new(double w, double h, int nx, int ny,
+                         int nxblocks, int nyblocks, int nbatch)
+{
+    if (nx < 1 || ny < 1 || nxblocks < 1 || nyblocks < 1 || nbatch < 0) {
+        fprintf(stderr, "Bad simulator size\n");
+        return nullptr;
+    }
+    void* mem = _mm_malloc(sizeof(shallow_sim), alignof(shallow_sim));
+    if (mem) {
+        try {
+            return new (mem) shallow_sim(w,h, nx,ny, nxblocks,nyblocks, nbatch);
+        } catch (const std::bad_alloc&) {
+            _mm_free(mem);
+        }
+    }
+    fprintf(stderr, "Could not allocate the simulator\n");
+    return nullptr;
+}
+
+void shallow_free(shallow_sim* sim)
+{
+    if (!sim)
+        return;
+    sim->~shallow_sim();
+    _mm_free(sim);
+}
+
+int shallow_init(shallow_sim* sim, const char* ic)
+{
+    void (*icfun)(Sim::vec& u, double x, double y) = initial_condition<Sim::vec>(ic);
+    if (!icfun) {
+        fprintf(stderr, "Unknown initial conditions\n");
+        return -1;
+    }
+    sim->sim.init(icfun);
+    return 0;
+}
+
+int shallow_set_kernel(shallow_sim* sim, const char* kernel, int tile)
+{
+    std::string name = kernel;
+#if defined _SERIAL
+    if (name == "staged") {
+        sim->sim.set_tiled(0);
+        sim->sim.set_fused(false);
+        return 0;
+    }
+    if (name == "fused") {
+        sim->sim.set_tiled(0);
+        sim->sim.set_fused(true);
+        return 0;
+    }
+    if (name == "tiled") {
+        sim->sim.set_tiled(tile > 0 ? tile : 64, sim->nbatch);
+        return 0;
+    }
+    fprintf(stderr, "Unknown kernel\n");
+#else
+    if (name == "staged")
+        return 0;
+    fprintf(stderr, "Fused and tiled kernels are only available in the serial build\n");
+#endif
+    return -1;
+}
+
+int shallow_set_schedule(shallow_sim* sim, const char* schedule)
+{
+    std::string name = schedule;
+#if defined _PARALLEL_NODE
+    if (name == "fork" || name == "persistent" || name == "tasks") {
+        sim->sim.set_schedule(name == "fork"       ? Sim::FORK_JOIN :
+                              name == "persistent" ? Sim::PERSISTENT :
+                                                     Sim::TASKS);
+        return 0;
+    }
+    fprintf(stderr, "Unknown schedule\n");
+#else
+    if (name == "fork")
+        return 0;
+    fprintf(stderr, "Persistent and task schedules are only available in the node build\n");
+#endif
+    return -1;
+}
+
+void shallow_run(shallow_sim* sim, double t)
+{
+    sim->sim.run(t);
+}
+
+/**
+ * The strides come from the distances between cell $(0,0)$ and its
+ * neighbours.  On a one-cell-wide grid there is no neighbour to measure,
+ * and any stride will do.
+ */
+
+int shallow_view_state(shallow_sim* sim, shallow_view* view)
+{
+    Sim& s = sim->sim;
+    char* base = (char*) s(0,0).data();
+    view->data    = base;
+    view->nx      = s.xsize();
+    view->ny      = s.ysize();
+    view->nfields = Shallow2D::nfields;
+    view->elsize  = sizeof(Sim::real);
+    view->strides[0] = s.ysize() > 1 ? (char*) s(0,1).data() - base : 0;
+    view->strides[1] = s.xsize() > 1 ? (char*) s(1,0).data() - base : 0;
+    view->strides[2] = sizeof(Sim::real);
+    return 0;
+}
+
+void shallow_check(shallow_sim* sim)
+{
+    sim->sim.solution_check();
+}
+
+}
+
+//ldoc off
@@ -0,0 +1,74 @@
+#ifndef SHALLOW_API_H
+#define SHALLOW_API_H
+
+//ldoc on
+/**
+ * # C interface
+ *
+ * The `shallow` executable is one way to drive the solver; this is the
+ * other.  `libshallow.so` (the serial solver) and `libshallow-pnode.so`
+ * (the node solver) wrap the same `Central2D` that the driver builds
+ * behind a small C interface.  Any language with a C foreign function
+ * interface can then create a simulator, set it up, advance it, and
+ * look at the solution between calls without going through an output
+ * file.  The Python module `shallow.py` is one such client.
+ *
+ * The state is not copied out.  `shallow_view` describes where the
+ * solver keeps $(h, hu, hv)$ for each cell, as a base pointer and byte
+ * strides, so a caller can wrap the solver's own array (a numpy array,
+ * say) and read or write it in place.  Writes between calls to
+ * `shallow_run` are picked up by the next step.  Some kernels (the
+ * serial tiled kernel) trade the current and next state arrays at the
+ * end of a run, so a view should be taken again after each
+ * `shallow_run`.
+ *
+ * Functions that can fail return 0 on success and -1 on failure, with
+ * a message on `stderr`.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct shallow_sim shallow_sim;
+
+typedef struct shallow_view {
+    void* data;        /* Component 0 of cell (0,0) */
+    int   nx, ny;      /* Cells in x and y (ghost cells excluded) */
+    int   nfields;     /* Components per cell (h, hu, hv) */
+    int   elsize;      /* Bytes per value: 4 (float) or 8 (double) */
+    long  strides[3];  /* Bytes to the next cell in y, cell in x, component */
+} shallow_view;
+
+/* Create a w-by-h domain of nx-by-ny cells.  The node library splits
+ * it into nxblocks-by-nyblocks blocks and batches nbatch steps per
+ * block (0 = tune); the serial library uses nbatch for the tiled
+ * kernel and ignores the blocks.  Returns NULL on failure. */
+shallow_sim* shallow_new(double w, double h, int nx, int ny,
+                         int nxblocks, int nyblocks, int nbatch);
+void shallow_free(shallow_sim* sim);
+
+/* Set named initial conditions (dam_break, pond, river, wave) */
+int shallow_init(shallow_sim* sim, const char* ic);
+
+/* Serial library: staged, fused or tiled kernel (tile = 0 for 64) */
+int shallow_set_kernel(shallow_sim* sim, const char* kernel, int tile);
+
+/* Node library: fork, persistent or tasks schedule */
+int shallow_set_schedule(shallow_sim* sim, const char* schedule);
+
+/* Advance by time t */
+void shallow_run(shallow_sim* sim, double t);
+
+/* Describe the solution array; valid until the next shallow_run */
+int shallow_view_state(shallow_sim* sim, shallow_view* view);
+
+/* Print volume, momentum and the range of h to stdout */
+void shallow_check(shallow_sim* sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+//ldoc off
+#endif /* SHALLOW_API_H */
@@ -0,0 +1,493 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "half.h"
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+    #define SIMD_X86
+    #include <immintrin.h>
+#endif
+
+//ldoc on
+/**
+ * # Explicit SIMD kernels
+ *
+ * The solvers were tuned for icc, which takes `#pragma simd` and
+ * `declare simd` at their word.  GCC mostly does not: the limiter's
+ * `copysign`/`fabs`/ternary becomes vector blends only sometimes, and
+ * the strided flux loops not at all.  So the hot row operations are
+ * written out here against a small portable wrapper, one `Pack` type
+ * per instruction set, and the one the CPU supports is picked at run
+ * time.
+ *
+ * A `Pack<real>` holds `width` lanes of `float` or `double` and has
+ * unaligned `load` and `store`, a broadcast constructor, the four
+ * arithmetic operators, and `sqrt`, `abs`, `copysign`, `min`, `max`
+ * and a horizontal `hmax`.  `min(a,b)` and `max(a,b)` are `a < b ? a : b`
+ * and `a < b ? b : a` lane by lane, exactly as the scalar code wrote
+ * them.  The levels are
+ *
+ *  - `scalar`: one lane, plain C++ (any compiler, any machine);
+ *  - `sse`: 128-bit SSE2;
+ *  - `avx2`: 256-bit AVX2 (with F16C);
+ *  - `avx512`: 512-bit AVX-512F.
+ *
+ * `Pack<float>` can also `load` from and `store` to IEEE half storage
+ * (`fp16`), converting to `float` in registers.  AVX2 does this with
+ * the F16C instructions (`vcvtph2ps`, `vcvtps2ph`) and AVX-512 with
+ * their 512-bit forms, eight or sixteen values at a time, rounding to
+ * nearest even.  SSE2 has no conversion instructions, so it runs the
+ * branch-free software conversions of `half.h` four lanes at a time,
+ * and the scalar level, the fallback, calls them directly.  Both round
+ * the same way as the hardware.  (The scalar level can still differ
+ * from the others in the last bits with `fp16`: GCC fuses some of its
+ * products and sums into multiply-adds, which the intrinsics never do.
+ * With `-ffp-contract=off` all levels agree.)
+ *
+ * Code using intrinsics for a wider instruction set than the build
+ * targets has to live in functions compiled for that set, and GCC will
+ * not inline it into anything else.  The vector types and the kernels
+ * built on them are therefore defined once per level, each inside its
+ * own `#pragma GCC target` region: `simd_kernels.h` holds the kernel
+ * templates and is included once into each level's namespace.  The
+ * only thing that crosses between levels is a table of plain function
+ * pointers, `Kernels<real>`, which the solvers fetch once.
+ *
+ * The kernels are the limiter (`minmod`), the shallow water fluxes
+ * (`flux`), the wave speed bound (`wave_speed`) and the two halves of
+ * the planar solver's step (`predict`, `correct`), each over a run of
+ * `n` cells.  They are templates on the element type of the arrays,
+ * `T`, which is `real` or, for `float`, `fp16`:
+ *
+ *  - `minmod(du, u, n, s, theta)` sets `du[i]` to the MinMod slope
+ *    through `u[i-s]`, `u[i]`, `u[i+s]`.  With `s` one vector
+ *    (interleaved storage) or one element (planar storage) that is a
+ *    slope in $x$; with `s` a row it is a slope in $y$.
+ *  - `flux(F, G, U, n, stride, g)` and `wave_speed(cx, cy, U, n,
+ *    stride, g)` take planar cells, component `m` at `U[m*stride]`.
+ *    The speed kernel folds its maxima into `cx` and `cy`.
+ *  - `predict(uh, u, fx, gy, n, a, b)` sets `uh[i] = u[i] - a*fx[i] -
+ *    b*gy[i]`, and `correct(v, u, ux, uy, f, g, n, row, a, b)` the
+ *    staggered corrector of `central2d_soa.h`, with cell `(ix+1,iy)`
+ *    one element and `(ix,iy+1)` one `row` away.
+ *
+ * The kernels compute the same expressions in the same order as the
+ * scalar code, without fused multiply-adds, so every level gives the
+ * same bits.  `SHALLOW_SIMD=scalar|sse|avx2|avx512` caps the level
+ * (to compare them, say); the default is the best the CPU has.
+ */
+
+namespace simd {
+
+enum Level { SCALAR, SSE, AVX2, AVX512, NLEVELS };
+
+static const char* const level_names[NLEVELS] = {
+    "scalar", "sse", "avx2", "avx512"
+};
+
+inline const char* name(Level level) { return level_names[level]; }
+
+// Best level the CPU (and OS) support, capped by SHALLOW_SIMD
+inline Level detect()
+{
+    Level best = SCALAR;
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        best = SSE;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+        best = AVX2;
+    if (__builtin_cpu_supports("avx512f"))
+        best = AVX512;
+#endif
+    if (const char* s = getenv("SHALLOW_SIMD")) {
+        for (int l = 0; l < NLEVELS; ++l)
+            if (strcmp(s, level_names[l]) == 0 && l < best)
+                best = (Level) l;
+    }
+    return best;
+}
+
+inline Level level()
+{
+    static const Level chosen = detect();
+    return chosen;
+}
+
+// One level's row kernels, on arrays of T
+template <class real, class T = real>
+struct Kernels {
+    void (*minmod)(T* du, const T* u, int n, int s, real theta);
+    void (*flux)(T* F, T* G, const T* U, int n, int stride, real g);
+    void (*wave_speed)(real& cx, real& cy, const T* U, int n, int stride, real g);
+    void (*predict)(T* uh, const T* u, const T* fx, const T* gy, int n, real a, real b);
+    void (*correct)(T* v, const T* u, const T* ux, const T* uy,
+                    const T* f, const T* g, int n, int row, real a, real b);
+};
+
+/**
+ * ## Scalar packs
+ *
+ * One lane of plain C++.  These are also the tail loops of the wider
+ * levels, so they carry no target and can be inlined anywhere.
+ */
+
+namespace scalar {
+
+template <class real>
+struct Pack {
+    static constexpr int width = 1;
+    real v;
+
+    Pack() = default;
+    Pack(real x) : v(x) {}
+    template <class T> static inline Pack load(const T* p) { return Pack(real(*p)); }
+    template <class T> inline void store(T* p) const { *p = v; }
+};
+
+template <class real> inline Pack<real> operator+(Pack<real> a, Pack<real> b) { return a.v + b.v; }
+template <class real> inline Pack<real> operator-(Pack<real> a, Pack<real> b) { return a.v - b.v; }
+template <class real> inline Pack<real> operator*(Pack<real> a, Pack<real> b) { return a.v * b.v; }
+template <class real> inline Pack<real> operator/(Pack<real> a, Pack<real> b) { return a.v / b.v; }
+template <class real> inline Pack<real> sqrt(Pack<real> a) { return std::sqrt(a.v); }
+template <class real> inline Pack<real> abs(Pack<real> a)  { return std::fabs(a.v); }
+template <class real> inline Pack<real> copysign(Pack<real> a, Pack<real> b) { return std::copysign(a.v, b.v); }
+template <class real> inline Pack<real> min(Pack<real> a, Pack<real> b) { return a.v < b.v ? a.v : b.v; }
+template <class real> inline Pack<real> max(Pack<real> a, Pack<real> b) { return a.v < b.v ? b.v : a.v; }
+template <class real> inline real hmax(Pack<real> a) { return a.v; }
+
+#include "simd_kernels.h"
+
+} // namespace scalar
+
+#ifdef SIMD_X86
+
+/**
+ * ## SSE packs
+ */
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+namespace sse {
+
+template <class real> struct Pack;
+
+template <>
+struct Pack<float> {
+    static constexpr int width = 4;
+    __m128 v;
+
+    Pack() = default;
+    Pack(__m128 x) : v(x) {}
+    Pack(float x) : v(_mm_set1_ps(x)) {}
+    static inline Pack load(const float* p) { return _mm_loadu_ps(p); }
+    inline void store(float* p) const { _mm_storeu_ps(p, v); }
+
+    // No conversion instructions: the software conversions of half.h
+    static inline Pack load(const fp16* p);
+    inline void store(fp16* p) const;
+};
+
+template <>
+struct Pack<double> {
+    static constexpr int width = 2;
+    __m128d v;
+
+    Pack() = default;
+    Pack(__m128d x) : v(x) {}
+    Pack(double x) : v(_mm_set1_pd(x)) {}
+    static inline Pack load(const double* p) { return _mm_loadu_pd(p); }
+    inline void store(double* p) const { _mm_storeu_pd(p, v); }
+};
+
+typedef Pack<float>  F;
+typedef Pack<double> D;
+
+// fp16::to_float on four lanes (in the low halves of h)
+inline F F::load(const fp16* p) {
+    __m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)),
+                                   _mm_setzero_si128());
+    __m128i w = _mm_slli_epi32(h, 17);
+    __m128i n = _mm_add_epi32(_mm_srli_epi32(w, 4), _mm_set1_epi32(0xe0 << 23));
+    __m128  nf = _mm_mul_ps(_mm_castsi128_ps(n), _mm_set1_ps(1.925929944387236e-34f));
+    __m128i d = _mm_or_si128(_mm_srli_epi32(w, 17), _mm_set1_epi32(126 << 23));
+    __m128  df = _mm_sub_ps(_mm_castsi128_ps(d), _mm_set1_ps(0.5f));
+    __m128i sub = _mm_cmpeq_epi32(_mm_srli_epi32(w, 27), _mm_setzero_si128());
+    __m128i r = _mm_or_si128(_mm_and_si128(sub, _mm_castps_si128(df)),
+                             _mm_andnot_si128(sub, _mm_castps_si128(nf)));
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    return _mm_castsi128_ps(_mm_or_si128(r, sign));
+}
+
+// fp16::from_float on four lanes
+inline void F::store(fp16* p) const {
+    __m128i u = _mm_castps_si128(v);
+    __m128i sign = _mm_and_si128(u, _mm_set1_epi32(0x80000000));
+    u = _mm_xor_si128(u, sign);
+    __m128i d = _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(u), _mm_set1_ps(0.5f)));
+    __m128i sub = _mm_sub_epi32(d, _mm_set1_epi32(0x3f000000));
+    __m128i odd = _mm_and_si128(_mm_srli_epi32(u, 13), _mm_set1_epi32(1));
+    __m128i nrm = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(u, _mm_set1_epi32(0xc8000fff)), odd), 13);
+    __m128i big = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x477fffff));  // Overflow, Inf, NaN
+    __m128i nan = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x7f800000));
+    __m128i tiny = _mm_cmplt_epi32(u, _mm_set1_epi32(0x38800000)); // Subnormal result
+    __m128i inf = _mm_or_si128(_mm_and_si128(nan, _mm_set1_epi32(0x7e00)),
+                               _mm_andnot_si128(nan, _mm_set1_epi32(0x7c00)));
+    __m128i o = _mm_or_si128(_mm_and_si128(tiny, sub), _mm_andnot_si128(tiny, nrm));
+    o = _mm_or_si128(_mm_and_si128(big, inf), _mm_andnot_si128(big, o));
+    o = _mm_or_si128(o, _mm_srli_epi32(sign, 16));
+    // Sign-extend the 16-bit results so the saturating pack keeps them
+    o = _mm_srai_epi32(_mm_slli_epi32(o, 16), 16);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi32(o, o));
+}
+
+inline F operator+(F a, F b) { return _mm_add_ps(a.v, b.v); }
+inline F operator-(F a, F b) { return _mm_sub_ps(a.v, b.v); }
+inline F operator*(F a, F b) { return _mm_mul_ps(a.v, b.v); }
+inline F operator/(F a, F b) { return _mm_div_ps(a.v, b.v); }
+inline F sqrt(F a)       { return _mm_sqrt_ps(a.v); }
+inline F abs(F a)        { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+inline F copysign(F a, F b) {
+    __m128 sign = _mm_set1_ps(-0.0f);
+    return _mm_or_ps(_mm_andnot_ps(sign, a.v), _mm_and_ps(sign, b.v));
+}
+inline F min(F a, F b)   { return _mm_min_ps(a.v, b.v); }
+inline F max(F a, F b)   { return _mm_max_ps(b.v, a.v); }
+inline float hmax(F a) {
+    __m128 x = _mm_max_ps(a.v, _mm_movehl_ps(a.v, a.v));
+    x = _mm_max_ps(x, _mm_shuffle_ps(x, x, 1));
+    return _mm_cvtss_f32(x);
+}
+
+inline D operator+(D a, D b) { return _mm_add_pd(a.v, b.v); }
+inline D operator-(D a, D b) { return _mm_sub_pd(a.v, b.v); }
+inline D operator*(D a, D b) { return _mm_mul_pd(a.v, b.v); }
+inline D operator/(D a, D b) { return _mm_div_pd(a.v, b.v); }
+inline D sqrt(D a)       { return _mm_sqrt_pd(a.v); }
+inline D abs(D a)        { return _mm_andnot_pd(_mm_set1_pd(-0.0), a.v); }
+inline D copysign(D a, D b) {
+    __m128d sign = _mm_set1_pd(-0.0);
+    return _mm_or_pd(_mm_andnot_pd(sign, a.v), _mm_and_pd(sign, b.v));
+}
+inline D min(D a, D b)   { return _mm_min_pd(a.v, b.v); }
+inline D max(D a, D b)   { return _mm_max_pd(b.v, a.v); }
+inline double hmax(D a) {
+    return _mm_cvtsd_f64(_mm_max_pd(a.v, _mm_unpackhi_pd(a.v, a.v)));
+}
+
+#include "simd_kernels.h"
+
+} // namespace sse
+
+#pragma GCC pop_options
+
+/**
+ * ## AVX2 packs
+ */
+
+#pragma GCC push_options
+#pragma GCC target("avx2,f16c")
+
+namespace avx2 {
+
+template <class real> struct Pack;
+
+template <>
+struct Pack<float> {
+    static constexpr int width = 8;
+    __m256 v;
+
+    Pack() = default;
+    Pack(__m256 x) : v(x) {}
+    Pack(float x) : v(_mm256_set1_ps(x)) {}
+    static inline Pack load(const float* p) { return _mm256_loadu_ps(p); }
+    inline void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+    static inline Pack load(const fp16* p) {
+        return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    }
+    inline void store(fp16* p) const {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p),
+                         _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+};
+
+template <>
+struct Pack<double> {
+    static constexpr int width = 4;
+    __m256d v;
+
+    Pack() = default;
+    Pack(__m256d x) : v(x) {}
+    Pack(double x) : v(_mm256_set1_pd(x)) {}
+    static inline Pack load(const double* p) { return _mm256_loadu_pd(p); }
+    inline void store(double* p) const { _mm256_storeu_pd(p, v); }
+};
+
+typedef Pack<float>  F;
+typedef Pack<double> D;
+
+inline F operator+(F a, F b) { return _mm256_add_ps(a.v, b.v); }
+inline F operator-(F a, F b) { return _mm256_sub_ps(a.v, b.v); }
+inline F operator*(F a, F b) { return _mm256_mul_ps(a.v, b.v); }
+inline F operator/(F a, F b) { return _mm256_div_ps(a.v, b.v); }
+inline F sqrt(F a)       { return _mm256_sqrt_ps(a.v); }
+inline F abs(F a)        { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+inline F copysign(F a, F b) {
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    return _mm256_or_ps(_mm256_andnot_ps(sign, a.v), _mm256_and_ps(sign, b.v));
+}
+inline F min(F a, F b)   { return _mm256_min_ps(a.v, b.v); }
+inline F max(F a, F b)   { return _mm256_max_ps(b.v, a.v); }
+inline float hmax(F a) {
+    __m128 x = _mm_max_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+    x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_max_ps(x, _mm_shuffle_ps(x, x, 1));
+    return _mm_cvtss_f32(x);
+}
+
+inline D operator+(D a, D b) { return _mm256_add_pd(a.v, b.v); }
+inline D operator-(D a, D b) { return _mm256_sub_pd(a.v, b.v); }
+inline D operator*(D a, D b) { return _mm256_mul_pd(a.v, b.v); }
+inline D operator/(D a, D b) { return _mm256_div_pd(a.v, b.v); }
+inline D sqrt(D a)       { return _mm256_sqrt_pd(a.v); }
+inline D abs(D a)        { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+inline D copysign(D a, D b) {
+    __m256d sign = _mm256_set1_pd(-0.0);
+    return _mm256_or_pd(_mm256_andnot_pd(sign, a.v), _mm256_and_pd(sign, b.v));
+}
+inline D min(D a, D b)   { return _mm256_min_pd(a.v, b.v); }
+inline D max(D a, D b)   { return _mm256_max_pd(b.v, a.v); }
+inline double hmax(D a) {
+    __m128d x = _mm_max_pd(_mm256_castpd256_pd128(a.v), _mm256_extractf128_pd(a.v, 1));
+    return _mm_cvtsd_f64(_mm_max_pd(x, _mm_unpackhi_pd(x, x)));
+}
+
+#include "simd_kernels.h"
+
+} // namespace avx2
+
+#pragma GCC pop_options
+
+/**
+ * ## AVX-512 packs
+ *
+ * AVX-512F has no floating point `and`/`or` (those came with DQ), so
+ * the sign bit is handled in the integer domain.
+ */
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+namespace avx512 {
+
+template <class real> struct Pack;
+
+template <>
+struct Pack<float> {
+    static constexpr int width = 16;
+    __m512 v;
+
+    Pack() = default;
+    Pack(__m512 x) : v(x) {}
+    Pack(float x) : v(_mm512_set1_ps(x)) {}
+    static inline Pack load(const float* p) { return _mm512_loadu_ps(p); }
+    inline void store(float* p) const { _mm512_storeu_ps(p, v); }
+
+    static inline Pack load(const fp16* p) {
+        return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+    }
+    inline void store(fp16* p) const {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p),
+                            _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+};
+
+template <>
+struct Pack<double> {
+    static constexpr int width = 8;
+    __m512d v;
+
+    Pack() = default;
+    Pack(__m512d x) : v(x) {}
+    Pack(double x) : v(_mm512_set1_pd(x)) {}
+    static inline Pack load(const double* p) { return _mm512_loadu_pd(p); }
+    inline void store(double* p) const { _mm512_storeu_pd(p, v); }
+};
+
+typedef Pack<float>  F;
+typedef Pack<double> D;
+
+inline F operator+(F a, F b) { return _mm512_add_ps(a.v, b.v); }
+inline F operator-(F a, F b) { return _mm512_sub_ps(a.v, b.v); }
+inline F operator*(F a, F b) { return _mm512_mul_ps(a.v, b.v); }
+inline F operator/(F a, F b) { return _mm512_div_ps(a.v, b.v); }
+inline F sqrt(F a)       { return _mm512_sqrt_ps(a.v); }
+inline F abs(F a)        { return _mm512_abs_ps(a.v); }
+inline F copysign(F a, F b) {
+    __m512i sign = _mm512_set1_epi32(0x80000000);
+    __m512i mag  = _mm512_andnot_si512(sign, _mm512_castps_si512(a.v));
+    return _mm512_castsi512_ps(_mm512_or_si512(mag, _mm512_and_si512(sign, _mm512_castps_si512(b.v))));
+}
+inline F min(F a, F b)   { return _mm512_min_ps(a.v, b.v); }
+inline F max(F a, F b)   { return _mm512_max_ps(b.v, a.v); }
+inline float hmax(F a)   { return _mm512_reduce_max_ps(a.v); }
+
+inline D operator+(D a, D b) { return _mm512_add_pd(a.v, b.v); }
+inline D operator-(D a, D b) { return _mm512_sub_pd(a.v, b.v); }
+inline D operator*(D a, D b) { return _mm512_mul_pd(a.v, b.v); }
+inline D operator/(D a, D b) { return _mm512_div_pd(a.v, b.v); }
+inline D sqrt(D a)       { return _mm512_sqrt_pd(a.v); }
+inline D abs(D a)        { return _mm512_abs_pd(a.v); }
+inline D copysign(D a, D b) {
+    __m512i sign = _mm512_set1_epi64(0x8000000000000000ll);
+    __m512i mag  = _mm512_andnot_si512(sign, _mm512_castpd_si512(a.v));
+    return _mm512_castsi512_pd(_mm512_or_si512(mag, _mm512_and_si512(sign, _mm512_castpd_si512(b.v))));
+}
+inline D min(D a, D b)   { return _mm512_min_pd(a.v, b.v); }
+inline D max(D a, D b)   { return _mm512_max_pd(b.v, a.v); }
+inline double hmax(D a)  { return _mm512_reduce_max_pd(a.v); }
+
+#include "simd_kernels.h"
+
+} // namespace avx512
+
+#pragma GCC pop_options
+
+#endif /* SIMD_X86 */
+
+/**
+ * ## Dispatch
+ *
+ * The table for the chosen level, built on first use.
+ */
+
+#define SIMD_KERNEL_TABLE(level) \
+    { level::minmod<real, T>, level::flux<real, T>, level::wave_speed<real, T>, \
+      level::predict<real, T>, level::correct<real, T> }
+
+template <class real, class T = real>
+const Kernels<real, T>& kernels()
+{
+    static const Kernels<real, T> table[NLEVELS] = {
+        SIMD_KERNEL_TABLE(scalar),
+#ifdef SIMD_X86
+        SIMD_KERNEL_TABLE(sse),
+        SIMD_KERNEL_TABLE(avx2),
+        SIMD_KERNEL_TABLE(avx512),
+#endif
+    };
+    return table[level()];
+}
+
+#undef SIMD_KERNEL_TABLE
+
+} // namespace simd
+
+//ldoc off
+#endif /* SIMD_H */
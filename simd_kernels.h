@@ -0,0 +1,150 @@
+/*
+ * Row kernels over Pack<real>, included by simd.h once per instruction
+ * set, inside that set's namespace and target region.  Not a header of
+ * its own: everything here is written against whichever Pack is in
+ * scope.  Cells left over after the last full pack go through the
+ * scalar pack, which inlines anywhere; those calls are qualified since
+ * argument-dependent lookup would otherwise find both copies.
+ */
+
+#ifndef SIMD_H
+    #error "simd_kernels.h is included by simd.h only"
+#endif
+
+// Branch-free minmod of two numbers, scaled by s (as MinMod::xmin2s)
+template <class P>
+inline P xmin2s(P s, P a, P b) {
+    P sa = copysign(s, a);
+    P sb = copysign(s, b);
+    P min_abs = min(abs(a), abs(b));
+    return (sa+sb) * min_abs;
+}
+
+// Limited combined slope estimate (as MinMod::limdiff)
+template <class P>
+inline P limdiff(P um, P u0, P up, P theta) {
+    P du1 = u0-um;
+    P du2 = up-u0;
+    P duc = up-um;
+    return xmin2s( P(0.25f), xmin2s(theta, du1, du2), duc );
+}
+
+template <class real, class T>
+void minmod(T* du, const T* u, int n, int s, real theta)
+{
+    typedef Pack<real> P;
+    typedef simd::scalar::Pack<real> S;
+    int i = 0;
+    for (; i + P::width <= n; i += P::width)
+        limdiff(P::load(u+i-s), P::load(u+i), P::load(u+i+s), P(theta)).store(du+i);
+    for (; i < n; ++i)
+        simd::scalar::limdiff(S::load(u+i-s), S::load(u+i), S::load(u+i+s), S(theta)).store(du+i);
+}
+
+// Shallow water fluxes of one pack of cells (as Shallow2D::flux)
+template <class P, class T>
+inline void flux_cells(T* F, T* G, const T* U, int stride, P g2) {
+    P h = P::load(U), hu = P::load(U+stride), hv = P::load(U+2*stride);
+    P huv = hu*hv/h;
+    P gh2 = g2*h*h;
+
+    hu.store(F);
+    (hu*hu/h + gh2).store(F+stride);
+    huv.store(F+2*stride);
+
+    hv.store(G);
+    huv.store(G+stride);
+    (hv*hv/h + gh2).store(G+2*stride);
+}
+
+template <class real, class T>
+void flux(T* F, T* G, const T* U, int n, int stride, real g)
+{
+    typedef Pack<real> P;
+    typedef simd::scalar::Pack<real> S;
+    real g2 = real(0.5f)*g;
+    int i = 0;
+    for (; i + P::width <= n; i += P::width)
+        flux_cells<P>(F+i, G+i, U+i, stride, P(g2));
+    for (; i < n; ++i)
+        simd::scalar::flux_cells<S>(F+i, G+i, U+i, stride, S(g2));
+}
+
+// Wave speed bounds of one pack of cells (as Shallow2D::wave_speed)
+template <class P, class T>
+inline void speed_cells(P& cx, P& cy, const T* U, int stride, P g) {
+    P h = P::load(U), hu = P::load(U+stride), hv = P::load(U+2*stride);
+    P root_gh = sqrt(g*h);
+    cx = max(cx, abs(hu/h) + root_gh);
+    cy = max(cy, abs(hv/h) + root_gh);
+}
+
+template <class real, class T>
+void wave_speed(real& cx, real& cy, const T* U, int n, int stride, real g)
+{
+    typedef Pack<real> P;
+    typedef simd::scalar::Pack<real> S;
+    P cxp(cx), cyp(cy);
+    int i = 0;
+    for (; i + P::width <= n; i += P::width)
+        speed_cells<P>(cxp, cyp, U+i, stride, P(g));
+    S cxs(hmax(cxp)), cys(hmax(cyp));
+    for (; i < n; ++i)
+        simd::scalar::speed_cells<S>(cxs, cys, U+i, stride, S(g));
+    cx = cxs.v;
+    cy = cys.v;
+}
+
+// Predictor of one pack of cells (as Central2D<..., SoA>::compute_step)
+template <class P, class T>
+inline void predict_cells(T* uh, const T* u, const T* fx, const T* gy, P a, P b) {
+    P uho = P::load(u);
+    uho = uho - a*P::load(fx);
+    uho = uho - b*P::load(gy);
+    uho.store(uh);
+}
+
+template <class real, class T>
+void predict(T* uh, const T* u, const T* fx, const T* gy, int n, real a, real b)
+{
+    typedef Pack<real> P;
+    typedef simd::scalar::Pack<real> S;
+    int i = 0;
+    for (; i + P::width <= n; i += P::width)
+        predict_cells<P>(uh+i, u+i, fx+i, gy+i, P(a), P(b));
+    for (; i < n; ++i)
+        simd::scalar::predict_cells<S>(uh+i, u+i, fx+i, gy+i, S(a), S(b));
+}
+
+// Corrector of one pack of cells (as Central2D<..., SoA>::compute_step)
+template <class P, class T>
+inline void correct_cells(T* v, const T* u, const T* ux, const T* uy,
+                          const T* f, const T* g, int row, P a, P b) {
+    P u00  = P::load(u),     u10  = P::load(u+1);
+    P u01  = P::load(u+row), u11  = P::load(u+row+1);
+    P ux00 = P::load(ux),    ux10 = P::load(ux+1);
+    P ux01 = P::load(ux+row), ux11 = P::load(ux+row+1);
+    P uy00 = P::load(uy),    uy10 = P::load(uy+1);
+    P uy01 = P::load(uy+row), uy11 = P::load(uy+row+1);
+    P f00  = P::load(f),     f10  = P::load(f+1);
+    P f01  = P::load(f+row), f11  = P::load(f+row+1);
+    P g00  = P::load(g),     g10  = P::load(g+1);
+    P g01  = P::load(g+row), g11  = P::load(g+row+1);
+    (P(0.2500f) * (u00 + u10 + u01 + u11) -
+     P(0.0625f) * (ux10 - ux00 + ux11 - ux01 + uy01 - uy00 + uy11 - uy10) -
+     a * (f10 - f00 + f11 - f01) -
+     b * (g01 - g00 + g11 - g10)).store(v);
+}
+
+template <class real, class T>
+void correct(T* v, const T* u, const T* ux, const T* uy,
+             const T* f, const T* g, int n, int row, real a, real b)
+{
+    typedef Pack<real> P;
+    typedef simd::scalar::Pack<real> S;
+    int i = 0;
+    for (; i + P::width <= n; i += P::width)
+        correct_cells<P>(v+i, u+i, ux+i, uy+i, f+i, g+i, row, P(a), P(b));
+    for (; i < n; ++i)
+        simd::scalar::correct_cells<S>(v+i, u+i, ux+i, uy+i, f+i, g+i, row, S(a), S(b));
+}
@@ -0,0 +1,342 @@
+#ifndef STAGE_TIMERS_H
+#define STAGE_TIMERS_H
+
+//ldoc on
+/**
+ * # Stage timers
+ *
+ * The driver only times whole calls to `run`.  To see where that time
+ * goes, build with `-D_STAGE_TIMERS`: each stage of the solver then
+ * counts, per thread, the cycles it spends, how often it is called and
+ * how many cells it touches, and the barriers count how long threads
+ * sit waiting in them.  At the end of the run `stage_report` prints a
+ * summary.  Without `_STAGE_TIMERS` the `STAGE_TIMER` macro expands to
+ * nothing, so the instrumented code is exactly the uninstrumented one.
+ *
+ * Usage inside a stage is a single line at the top of the scope to be
+ * timed:
+ *
+ *     STAGE_TIMER(STAGE_FLUX, nx_block*ny_block);
+ *
+ * Building with `-D_STAGE_PERF` as well adds hardware counters (see
+ * `perf_counters.h`) and a roofline section to the report.
+ */
+
+#if defined _STAGE_PERF && !defined _STAGE_TIMERS
+    #define _STAGE_TIMERS
+#endif
+
+#ifdef _STAGE_TIMERS
+
+#include <cstdio>
+#include <cstdint>
+#include <omp.h>
+#if defined __x86_64__ || defined __i386__
+    #include <x86intrin.h>
+#endif
+#ifdef _STAGE_PERF
+    #include "perf_counters.h"
+#endif
+
+#define STAGE_TIMER(stage, cells) StageScope stage_scope_(stage, cells)
+
+#else
+
+#define STAGE_TIMER(stage, cells) ((void)0)
+
+#endif /* _STAGE_TIMERS */
+
+enum Stage {
+    STAGE_APPLY_PERIODIC,
+    STAGE_WAVE_SPEEDS,
+    STAGE_COPY_TO_LOCAL,
+    STAGE_FLUX,
+    STAGE_LIMITED_DERIVS,
+    STAGE_STEP,
+    STAGE_COPY_FROM_LOCAL,
+    STAGE_EXCHANGE_GHOSTS,
+    STAGE_FLUX_REGISTER,
+    STAGE_BARRIER,
+    NSTAGES
+};
+
+#ifdef _STAGE_TIMERS
+
+/**
+ * ## Cost model
+ *
+ * Achieved bandwidth and flop rates are estimates: per cell, each
+ * stage is charged for the solution-sized vectors it streams through
+ * memory (loads plus stores, neighbours assumed to hit in cache) and
+ * the arithmetic it does on all `vec_size` lanes, counted from the
+ * staged kernels (`xmin2s` counts as seven operations, a division or
+ * square root as one).
+ */
+
+struct StageModel {
+    const char* name;
+    double vecs;    // Vectors moved per cell
+    double flops;   // Operations per cell
+};
+
+static const StageModel stage_models[NSTAGES] = {
+    { "apply_periodic",   2,   0 },
+    { "wave_speeds",      1,  10 },
+    { "copy_to_local",    2,   0 },
+    { "flux",             3,  12 },
+    { "limited_derivs",   7, 272 },
+    { "step",            13, 120 },
+    { "copy_from_local",  2,   0 },
+    { "exchange_ghosts",  2,   0 },
+    { "flux_register",   20,  60 },
+    { "barrier",          0,   0 },
+};
+
+/**
+ * ## Counters
+ *
+ * Counters live in one cache-line-aligned slot per thread, so threads
+ * never write to the same line.  Threads beyond `max_threads` share
+ * slots (their counts are still right, just not separated).  Cycles
+ * come from the time stamp counter where there is one; we convert to
+ * seconds by comparing against the wall clock over the life of the
+ * counters.
+ */
+
+inline uint64_t stage_cycles()
+{
+#if defined __x86_64__ || defined __i386__
+    return __rdtsc();
+#else
+    return (uint64_t) (omp_get_wtime() * 1e9);
+#endif
+}
+
+struct alignas(64) StageCounters {
+    uint64_t cycles[NSTAGES] = {};
+    uint64_t calls[NSTAGES]  = {};
+    double   cells[NSTAGES]  = {};
+#ifdef _STAGE_PERF
+    uint64_t events[NSTAGES][perf::NEVENTS] = {};
+#endif
+};
+
+struct StageRegistry {
+    static constexpr int max_threads = 256;
+    StageCounters threads[max_threads];
+    uint64_t cycles0 = stage_cycles();
+    double   wall0   = omp_get_wtime();
+
+    StageCounters& mine() {
+        return threads[omp_get_thread_num() % max_threads];
+    }
+};
+
+inline StageRegistry& stage_registry()
+{
+    static StageRegistry registry;
+    return registry;
+}
+
+#ifdef _STAGE_PERF
+// Counters follow the OS thread, which is what perf_event counts
+inline perf::CounterGroup& stage_perf_group()
+{
+    static thread_local perf::CounterGroup group;
+    group.open();
+    return group;
+}
+#endif
+
+class StageScope {
+public:
+    StageScope(Stage stage, double cells)
+        : counters(stage_registry().mine()), stage(stage), cells(cells) {
+#ifdef _STAGE_PERF
+        stage_perf_group().read(events0);
+#endif
+        start = stage_cycles();
+    }
+    ~StageScope() {
+        counters.cycles[stage] += stage_cycles() - start;
+        counters.calls[stage]  += 1;
+        counters.cells[stage]  += cells;
+#ifdef _STAGE_PERF
+        uint64_t events1[perf::NEVENTS];
+        stage_perf_group().read(events1);
+        for (int e = 0; e < perf::NEVENTS; ++e)
+            counters.events[stage][e] += events1[e] - events0[e];
+#endif
+    }
+
+private:
+    StageCounters& counters;
+    Stage stage;
+    double cells;
+    uint64_t start;
+#ifdef _STAGE_PERF
+    uint64_t events0[perf::NEVENTS];
+#endif
+};
+
+#ifdef _STAGE_PERF
+
+/**
+ * ## Roofline
+ *
+ * With hardware counters we can replace the modelled memory traffic
+ * with a measured one: every last-level cache miss moves a 64-byte
+ * line from memory.  Arithmetic intensity is then the modelled flops
+ * over those bytes, and the bandwidth roof at that intensity is
+ * intensity times the STREAM bandwidth.  Attained rates divide by the
+ * stage time per thread (the threads run a stage side by side), so
+ * they compare with the all-thread STREAM figure.  A stage at half its
+ * roof or better is marked memory-bound; one above its roof must be
+ * running out of cache.  If the cache-miss counter is not available we
+ * fall back on the modelled bytes, which count every access as memory
+ * traffic, so small blocks that stay in cache will show up that way.
+ */
+
+inline void stage_roofline(FILE* fp, StageRegistry& reg, int nthreads,
+                           double hz, int vec_bytes)
+{
+    double bw = perf::stream_bandwidth();
+    bool measured = stage_perf_group().has(perf::LLC_MISSES);
+
+    fprintf(fp, "#\n# Hardware counters (%s)\n",
+            stage_perf_group().active() ? "perf_event" : "unavailable");
+    fprintf(fp, "# %-16s %8s %12s %10s %10s\n",
+            "stage", "IPC", "LLC miss/cell", "vec/instr", "cyc/cell");
+    for (int s = 0; s < NSTAGES; ++s) {
+        uint64_t ev[perf::NEVENTS] = {};
+        double cells = 0;
+        uint64_t calls = 0;
+        for (int t = 0; t < nthreads; ++t) {
+            for (int e = 0; e < perf::NEVENTS; ++e)
+                ev[e] += reg.threads[t].events[s][e];
+            cells += reg.threads[t].cells[s];
+            calls += reg.threads[t].calls[s];
+        }
+        if (!calls)
+            continue;
+        double ipc = ev[perf::CYCLES] ? (double) ev[perf::INSTRUCTIONS] / ev[perf::CYCLES] : 0;
+        double vec = ev[perf::INSTRUCTIONS] ? (double) ev[perf::VECTOR_OPS] / ev[perf::INSTRUCTIONS] : 0;
+        fprintf(fp, "# %-16s %8.2f %12.3f %9.1f%% %10.1f\n", stage_models[s].name, ipc,
+                cells ? ev[perf::LLC_MISSES] / cells : 0, 100*vec,
+                cells ? ev[perf::CYCLES] / cells : 0);
+    }
+
+    fprintf(fp, "#\n# Roofline (STREAM triad %.2f GB/s, %s bytes)\n",
+            bw/1e9, measured ? "measured" : "modelled");
+    fprintf(fp, "# %-16s %10s %10s %10s %8s  %s\n",
+            "stage", "flop/byte", "GFlop/s", "roof", "of roof", "bound");
+    for (int s = 0; s < NSTAGES; ++s) {
+        const StageModel& m = stage_models[s];
+        uint64_t cycles = 0, misses = 0;
+        double cells = 0;
+        int active = 0;
+        for (int t = 0; t < nthreads; ++t) {
+            const StageCounters& c = reg.threads[t];
+            cycles += c.cycles[s];
+            misses += c.events[s][perf::LLC_MISSES];
+            cells  += c.cells[s];
+            active += (c.calls[s] > 0);
+        }
+        if (!active || !m.flops)
+            continue;
+        double seconds = cycles / hz / active;
+        double flops = m.flops * cells;
+        double bytes = measured ? 64.0 * misses : m.vecs * vec_bytes * cells;
+        double intensity = bytes ? flops / bytes : 0;
+        double attained = flops / seconds;
+        double roof = intensity * bw;
+        double frac = roof ? attained / roof : 0;
+        fprintf(fp, "# %-16s %10.2f %10.3f %10.3f %7.1f%%  %s\n",
+                m.name, intensity, attained/1e9, roof/1e9, 100*frac,
+                bytes == 0 || frac > 1 ? "cache" :
+                frac >= 0.5 ? "memory" : "compute/latency");
+    }
+}
+
+#endif /* _STAGE_PERF */
+
+/**
+ * ## Report
+ *
+ * The first table sums over threads; the share of time is relative to
+ * the total over all stages, and `max/avg` is the busiest thread's
+ * time over the average of the threads that ran the stage (1.0 means
+ * perfectly balanced).  The second table gives the per-thread cycle
+ * counts in millions.  `vec_bytes` is the size of one solution vector.
+ */
+
+inline void stage_report(FILE* fp, int vec_bytes)
+{
+    StageRegistry& reg = stage_registry();
+    double hz = (stage_cycles() - reg.cycles0) / (omp_get_wtime() - reg.wall0);
+
+    int nthreads = 0;
+    for (int t = 0; t < StageRegistry::max_threads; ++t)
+        for (int s = 0; s < NSTAGES; ++s)
+            if (reg.threads[t].calls[s])
+                nthreads = t+1;
+
+    double total = 0;
+    for (int t = 0; t < nthreads; ++t)
+        for (int s = 0; s < NSTAGES; ++s)
+            total += reg.threads[t].cycles[s];
+
+    fprintf(fp, "#\n# Stage timers (%d threads, %.3g GHz counter)\n", nthreads, hz/1e9);
+    fprintf(fp, "# %-16s %10s %12s %7s %8s %10s %10s\n",
+            "stage", "calls", "seconds", "share", "max/avg", "GB/s", "GFlop/s");
+    for (int s = 0; s < NSTAGES; ++s) {
+        uint64_t calls = 0, cycles = 0, max_cycles = 0;
+        double cells = 0;
+        int active = 0;
+        for (int t = 0; t < nthreads; ++t) {
+            const StageCounters& c = reg.threads[t];
+            calls  += c.calls[s];
+            cycles += c.cycles[s];
+            cells  += c.cells[s];
+            active += (c.calls[s] > 0);
+            if (c.cycles[s] > max_cycles)
+                max_cycles = c.cycles[s];
+        }
+        if (!calls)
+            continue;
+
+        // Rates are per thread-second, summed over threads
+        double seconds = cycles / hz;
+        double imbalance = max_cycles / ((double) cycles / active);
+        const StageModel& m = stage_models[s];
+        fprintf(fp, "# %-16s %10llu %12.6f %6.1f%% %8.2f %10.3f %10.3f\n",
+                m.name, (unsigned long long) calls, seconds, 100*cycles/total,
+                imbalance, m.vecs*vec_bytes*cells/seconds/1e9,
+                m.flops*cells/seconds/1e9);
+    }
+
+    fprintf(fp, "#\n# Mcycles by thread\n# %-16s", "stage");
+    for (int t = 0; t < nthreads; ++t)
+        fprintf(fp, " %9d", t);
+    fprintf(fp, "\n");
+    for (int s = 0; s < NSTAGES; ++s) {
+        uint64_t calls = 0;
+        for (int t = 0; t < nthreads; ++t)
+            calls += reg.threads[t].calls[s];
+        if (!calls)
+            continue;
+        fprintf(fp, "# %-16s", stage_models[s].name);
+        for (int t = 0; t < nthreads; ++t)
+            fprintf(fp, " %9.2f", reg.threads[t].cycles[s] / 1e6);
+        fprintf(fp, "\n");
+    }
+
+#ifdef _STAGE_PERF
+    stage_roofline(fp, reg, nthreads, hz, vec_bytes);
+#endif
+}
+
+#endif /* _STAGE_TIMERS */
+
+//ldoc off
+#endif /* STAGE_TIMERS_H */
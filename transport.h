@@ -0,0 +1,540 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+#ifdef _USE_MPI
+#include <mpi.h>
+#endif
+
+//ldoc on
+/**
+ * # Message transport
+ *
+ * The distributed solver in `central2d_pdist.h` talks to the other
+ * ranks only through the small interface below: nonblocking point to
+ * point messages, a max-reduction, and a barrier.  There are two
+ * implementations:
+ *
+ *  - With `-D_USE_MPI` (build with `mpicxx`, launch with `mpirun`),
+ *    each call is the obvious MPI one.
+ *  - Otherwise, the ranks are processes forked by `transport::init`
+ *    on the local machine, and messages go through ring buffers in a
+ *    shared memory mapping set up before the fork.  The ranks still
+ *    have separate address spaces, so this exercises exactly the same
+ *    code paths as a real multi-node run.
+ *
+ * Messages follow MPI rules: a receive matches the oldest message from
+ * its source with the same tag; messages that arrive before their
+ * receive is posted are buffered; buffers passed to `isend`/`irecv`
+ * must not be touched until the request completes.  Tags at or above
+ * `RESERVED_TAG` are for the transport's own collectives.
+ */
+
+namespace transport {
+
+constexpr int RESERVED_TAG = 1 << 20;
+
+// A send or receive in flight
+class Request {
+public:
+    virtual ~Request() {}
+    virtual bool test() = 0;    // Make progress; true once complete
+};
+
+typedef std::unique_ptr<Request> RequestPtr;
+
+class Comm {
+public:
+    virtual ~Comm() {}
+
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+
+    virtual RequestPtr isend(const void* buf, size_t bytes, int dest, int tag) = 0;
+    virtual RequestPtr irecv(void* buf, size_t bytes, int src, int tag) = 0;
+
+    // Element-wise max of v[0..n) over all ranks, in place
+    virtual void allreduce_max(double* v, int n) = 0;
+
+    virtual void barrier() {
+        double dummy = 0;
+        allreduce_max(&dummy, 1);
+    }
+
+    // Block until every request in the list has completed
+    void wait_all(std::vector<RequestPtr>& requests) {
+        int idle = 0;
+        for (;;) {
+            bool all_done = true;
+            for (auto& r : requests)
+                if (r && !r->test())
+                    all_done = false;
+            if (all_done)
+                break;
+            backoff(idle++);
+        }
+        requests.clear();
+    }
+
+    void wait(RequestPtr& request) {
+        std::vector<RequestPtr> requests;
+        requests.push_back(std::move(request));
+        wait_all(requests);
+    }
+
+protected:
+    // Called while waiting with nothing to do
+    virtual void backoff(int idle) {
+        if (idle > 64)
+            usleep(20);
+        else
+            sched_yield();
+    }
+};
+
+#ifdef _USE_MPI
+
+/**
+ * ## MPI
+ */
+
+class MpiRequest : public Request {
+public:
+    MPI_Request request;
+    bool test() override {
+        int flag = 0;
+        MPI_Test(&request, &flag, MPI_STATUS_IGNORE);
+        return flag;
+    }
+};
+
+class MpiComm : public Comm {
+public:
+    int rank() const override {
+        int r;
+        MPI_Comm_rank(MPI_COMM_WORLD, &r);
+        return r;
+    }
+    int size() const override {
+        int n;
+        MPI_Comm_size(MPI_COMM_WORLD, &n);
+        return n;
+    }
+    RequestPtr isend(const void* buf, size_t bytes, int dest, int tag) override {
+        MpiRequest* r = new MpiRequest;
+        MPI_Isend(buf, (int) bytes, MPI_BYTE, dest, tag, MPI_COMM_WORLD, &r->request);
+        return RequestPtr(r);
+    }
+    RequestPtr irecv(void* buf, size_t bytes, int src, int tag) override {
+        MpiRequest* r = new MpiRequest;
+        MPI_Irecv(buf, (int) bytes, MPI_BYTE, src, tag, MPI_COMM_WORLD, &r->request);
+        return RequestPtr(r);
+    }
+    void allreduce_max(double* v, int n) override {
+        MPI_Allreduce(MPI_IN_PLACE, v, n, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    }
+    void barrier() override {
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+};
+
+#else
+
+/**
+ * ## Shared memory
+ *
+ * Every ordered pair of ranks has a single-producer, single-consumer
+ * ring buffer; `head` counts bytes written and `tail` bytes consumed.
+ * A message is a 16-byte header (tag and length) followed by the
+ * payload, and is streamed through the ring in as many pieces as it
+ * takes, so messages can be larger than the ring.  Nothing moves in
+ * the background: sends and receives make progress whenever some
+ * request is tested, which `wait_all` does for all of its requests in
+ * turn, so two ranks exchanging large messages cannot deadlock.
+ */
+
+struct Channel {
+    static constexpr size_t capacity = 1 << 20;
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) char data[capacity];
+};
+
+struct MessageHeader {
+    int64_t tag;
+    uint64_t bytes;
+};
+
+class LocalComm;
+
+class LocalRequest : public Request {
+public:
+    LocalRequest(LocalComm* comm) : comm(comm) {}
+    bool test() override;
+
+    LocalComm* comm;
+    bool done = false;
+};
+
+class LocalComm : public Comm {
+public:
+    LocalComm(int rank, int nranks, Channel* channels)
+        : rank_(rank), nranks(nranks), channels(channels),
+          outgoing(nranks), incoming(nranks) {}
+
+    int rank() const override { return rank_; }
+    int size() const override { return nranks; }
+
+    RequestPtr isend(const void* buf, size_t bytes, int dest, int tag) override {
+        auto r = std::make_shared<LocalRequest>(this);
+        Outgoing send;
+        send.header  = { tag, bytes };
+        send.payload = static_cast<const char*>(buf);
+        send.request = r;
+        outgoing[dest].push_back(send);
+        progress();
+        return RequestPtr(new Handle(r));
+    }
+
+    RequestPtr irecv(void* buf, size_t bytes, int src, int tag) override {
+        auto r = std::make_shared<LocalRequest>(this);
+        Inbox& in = incoming[src];
+
+        // Oldest buffered message with this tag, if any (one still
+        // coming in goes to the first receive posted for its tag)
+        for (auto it = in.unexpected.begin(); it != in.unexpected.end(); ++it)
+            if (it->tag == tag && it->complete) {
+                memcpy(buf, it->data.data(), std::min(bytes, it->data.size()));
+                in.unexpected.erase(it);
+                r->done = true;
+                return RequestPtr(new Handle(r));
+            }
+
+        Posted recv;
+        recv.tag = tag;
+        recv.buf = static_cast<char*>(buf);
+        recv.bytes = bytes;
+        recv.request = r;
+        in.posted.push_back(recv);
+        progress();
+        return RequestPtr(new Handle(r));
+    }
+
+    // Gather to rank 0, reduce, and send the result back out
+    void allreduce_max(double* v, int n) override {
+        const int tag = RESERVED_TAG;
+        std::vector<RequestPtr> requests;
+        if (rank_ == 0) {
+            std::vector<double> others((size_t) n * nranks);
+            for (int r = 1; r < nranks; ++r)
+                requests.push_back(irecv(&others[(size_t) r*n], n*sizeof(double), r, tag));
+            wait_all(requests);
+            for (int r = 1; r < nranks; ++r)
+                for (int k = 0; k < n; ++k)
+                    v[k] = std::max(v[k], others[(size_t) r*n + k]);
+            for (int r = 1; r < nranks; ++r)
+                requests.push_back(isend(v, n*sizeof(double), r, tag+1));
+        } else {
+            requests.push_back(isend(v, n*sizeof(double), 0, tag));
+            requests.push_back(irecv(v, n*sizeof(double), 0, tag+1));
+        }
+        wait_all(requests);
+    }
+
+    // Move whatever data can be moved right now
+    void progress() {
+        for (int dest = 0; dest < nranks; ++dest)
+            push(dest);
+        for (int src = 0; src < nranks; ++src)
+            pull(src);
+    }
+
+protected:
+    void backoff(int idle) override {
+        // A rank that died will never send what we are waiting for
+        if (rank_ == 0 && idle % 1024 == 1023) {
+            int status;
+            pid_t pid = waitpid(-1, &status, WNOHANG);
+            if (pid > 0 && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+                fprintf(stderr, "transport: a rank exited abnormally\n");
+                exit(1);
+            }
+        }
+        Comm::backoff(idle);
+    }
+
+private:
+    // Requests are shared between the caller's handle and our queues
+    struct Handle : public Request {
+        std::shared_ptr<LocalRequest> r;
+        Handle(std::shared_ptr<LocalRequest> r) : r(r) {}
+        bool test() override { return r->test(); }
+    };
+
+    struct Outgoing {
+        MessageHeader header;
+        const char* payload;
+        size_t sent = 0;    // Header and payload bytes written so far
+        std::shared_ptr<LocalRequest> request;
+    };
+
+    struct Posted {
+        int64_t tag;
+        char* buf;
+        size_t bytes;
+        std::shared_ptr<LocalRequest> request;
+    };
+
+    struct Unexpected {
+        int64_t tag;
+        bool complete;
+        std::vector<char> data;
+    };
+
+    struct Inbox {
+        std::deque<Posted> posted;
+        std::deque<Unexpected> unexpected;
+
+        // Message currently coming in
+        bool in_message = false;
+        MessageHeader header;
+        size_t header_read = 0;
+        size_t received = 0;
+        Posted target;          // Where the payload goes
+        bool buffered = false;  // ...or into unexpected.back()
+    };
+
+    int rank_, nranks;
+    Channel* channels;
+    std::vector<std::deque<Outgoing>> outgoing;
+    std::vector<Inbox> incoming;
+    char sink[4096];
+
+    Channel& channel(int src, int dest) { return channels[src*nranks + dest]; }
+
+    void push(int dest) {
+        Channel& ch = channel(rank_, dest);
+        auto& queue = outgoing[dest];
+        while (!queue.empty()) {
+            Outgoing& send = queue.front();
+            uint64_t head = ch.head.load(std::memory_order_relaxed);
+            uint64_t tail = ch.tail.load(std::memory_order_acquire);
+            size_t room = Channel::capacity - (head - tail);
+            size_t total = sizeof(MessageHeader) + send.header.bytes;
+            size_t n = std::min(room, total - send.sent);
+            if (n == 0)
+                return;
+            for (size_t k = 0; k < n; ) {
+                size_t off = send.sent + k;
+                const char* src = off < sizeof(MessageHeader)
+                    ? reinterpret_cast<const char*>(&send.header) + off
+                    : send.payload + (off - sizeof(MessageHeader));
+                size_t limit = off < sizeof(MessageHeader)
+                    ? sizeof(MessageHeader) - off
+                    : total - off;
+                size_t pos = (head + k) % Channel::capacity;
+                size_t chunk = std::min(std::min(limit, n-k), Channel::capacity - pos);
+                memcpy(ch.data + pos, src, chunk);
+                k += chunk;
+            }
+            ch.head.store(head + n, std::memory_order_release);
+            send.sent += n;
+            if (send.sent < total)
+                return;
+            send.request->done = true;
+            queue.pop_front();
+        }
+    }
+
+    // Copy up to n bytes out of the ring
+    size_t read_ring(Channel& ch, char* dst, size_t n) {
+        uint64_t tail = ch.tail.load(std::memory_order_relaxed);
+        uint64_t head = ch.head.load(std::memory_order_acquire);
+        n = std::min<size_t>(n, head - tail);
+        for (size_t k = 0; k < n; ) {
+            size_t pos = (tail + k) % Channel::capacity;
+            size_t chunk = std::min(n-k, Channel::capacity - pos);
+            memcpy(dst + k, ch.data + pos, chunk);
+            k += chunk;
+        }
+        ch.tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    void pull(int src) {
+        Channel& ch = channel(src, rank_);
+        Inbox& in = incoming[src];
+        for (;;) {
+            if (!in.in_message) {
+                char* h = reinterpret_cast<char*>(&in.header);
+                in.header_read += read_ring(ch, h + in.header_read,
+                                            sizeof(MessageHeader) - in.header_read);
+                if (in.header_read < sizeof(MessageHeader))
+                    return;
+                start_message(in);
+            }
+
+            // Payload (anything beyond the receive buffer is dropped)
+            while (in.received < in.header.bytes) {
+                size_t want = in.header.bytes - in.received;
+                char* dst = sink;
+                if (in.buffered) {
+                    dst = in.unexpected.back().data.data() + in.received;
+                } else if (in.received < in.target.bytes) {
+                    dst  = in.target.buf + in.received;
+                    want = std::min(want, in.target.bytes - in.received);
+                } else {
+                    want = std::min(want, sizeof(sink));
+                }
+                size_t got = read_ring(ch, dst, want);
+                if (got == 0)
+                    return;
+                in.received += got;
+            }
+
+            if (in.buffered)
+                finish_unexpected(in);
+            else
+                in.target.request->done = true;
+            in.in_message = false;
+            in.header_read = 0;
+        }
+    }
+
+    // A buffered message is complete: hand it to a receive posted
+    // while it was coming in, if there is one
+    void finish_unexpected(Inbox& in) {
+        Unexpected& msg = in.unexpected.back();
+        msg.complete = true;
+        for (auto it = in.posted.begin(); it != in.posted.end(); ++it)
+            if (it->tag == msg.tag) {
+                memcpy(it->buf, msg.data.data(), std::min(it->bytes, msg.data.size()));
+                it->request->done = true;
+                in.posted.erase(it);
+                in.unexpected.pop_back();
+                return;
+            }
+    }
+
+    // A header is in: find the receive it is for, or buffer it
+    void start_message(Inbox& in) {
+        in.in_message = true;
+        in.received = 0;
+        for (auto it = in.posted.begin(); it != in.posted.end(); ++it)
+            if (it->tag == in.header.tag) {
+                in.target = *it;
+                in.posted.erase(it);
+                in.buffered = false;
+                return;
+            }
+        in.buffered = true;
+        in.unexpected.push_back({ in.header.tag, false, std::vector<char>(in.header.bytes) });
+    }
+};
+
+inline bool LocalRequest::test()
+{
+    if (!done)
+        comm->progress();
+    return done;
+}
+
+#endif /* _USE_MPI */
+
+/**
+ * ## Start-up and shutdown
+ *
+ * `init` must be called before any threads are started.  Without MPI
+ * it forks `nranks-1` child processes; each returns from `init` as its
+ * own rank and runs the rest of `main` from there.  A child dies with
+ * its parent, and rank 0 notices in `finalize` (or while waiting on a
+ * message) if a child failed.  Under MPI the rank count comes from
+ * `mpirun` and `nranks` is ignored.
+ */
+
+inline std::unique_ptr<Comm>& world_ptr()
+{
+    static std::unique_ptr<Comm> comm;
+    return comm;
+}
+
+inline Comm& world() { return *world_ptr(); }
+
+inline Comm& init(int* argc, char*** argv, int nranks)
+{
+#ifdef _USE_MPI
+    (void) nranks;
+    MPI_Init(argc, argv);
+    world_ptr().reset(new MpiComm);
+#else
+    (void) argc;
+    (void) argv;
+    nranks = std::max(nranks, 1);
+    size_t bytes = sizeof(Channel) * nranks * nranks;
+    void* shared = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("transport");
+        exit(1);
+    }
+    Channel* channels = static_cast<Channel*>(shared);
+    for (int k = 0; k < nranks*nranks; ++k) {
+        channels[k].head.store(0);
+        channels[k].tail.store(0);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    int rank = 0;
+    for (int r = 1; r < nranks; ++r) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("transport");
+            exit(1);
+        }
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            rank = r;
+            break;
+        }
+    }
+    world_ptr().reset(new LocalComm(rank, nranks, channels));
+#endif
+    return world();
+}
+
+inline int finalize()
+{
+    int status = 0;
+#ifdef _USE_MPI
+    MPI_Finalize();
+#else
+    if (world().rank() == 0) {
+        int child;
+        while (wait(&child) > 0)
+            if (!(WIFEXITED(child) && WEXITSTATUS(child) == 0))
+                status = 1;
+    }
+#endif
+    return status;
+}
+
+} // namespace transport
+
+//ldoc off
+#endif /* TRANSPORT_H */
@@ -14,6 +14,130 @@ import matplotlib.pyplot as plt
 from mpl_toolkits.mplot3d import Axes3D
 import matplotlib.animation as manimation
 import sys
+import zlib
+
+
+# Layout of the output container (see meshio.h)
+HEADER = np.dtype([('magic', 'S8'), ('version', '<u4'),
+                   ('nx', '<u4'), ('ny', '<u4'),
+                   ('fields', '<u4'), ('nfields', '<u4'),
+                   ('max_frames', '<u4'), ('nframes', '<u4'),
+                   ('codec', '<u4'), ('table_offset', '<u8'),
+                   ('frame_bytes', '<u8'), ('tolerance', '<f8')])
+FRAME = np.dtype([('offset', '<u8'), ('time', '<f8')])
+FIELD_NAMES = ["h", "hu", "hv"]
+
+
+class ShallowOutput(object):
+    """Read-only view of a simulator output file.
+
+    The file is memory-mapped and frames are only read when asked for,
+    so runs much larger than memory can be inspected a frame at a time.
+    Both the self-describing container (raw or compressed) and the
+    original headerless format (two floats for nx and ny, then raw h
+    frames) are accepted.  Raw frames come back as views of the file;
+    compressed frames are decoded from the last keyframe (or from the
+    previous frame, when reading in order).
+
+    Attributes:
+        nx, ny: Grid size
+        fields: Names of the stored fields, in file order
+        times: Simulated time of each frame (frame numbers for old files)
+    """
+
+    def __init__(self, infile):
+        self.mm = np.memmap(infile, dtype=np.uint8, mode='r')
+        if bytes(self.mm[:8]) == b"SHALLOW\0":
+            hdr = np.frombuffer(self.mm, dtype=HEADER, count=1)[0]
+            self.nx = int(hdr['nx'])
+            self.ny = int(hdr['ny'])
+            self.fields = [FIELD_NAMES[m] if m < len(FIELD_NAMES) else "u%d" % m
+                           for m in range(32) if hdr['fields'] & (1 << m)]
+            table = np.frombuffer(self.mm, dtype=FRAME,
+                                  count=int(hdr['nframes']),
+                                  offset=int(hdr['table_offset']))
+            self.offsets = [int(off) for off in table['offset']]
+            self.times = np.array(table['time'])
+            self.codec = int(hdr['codec'])
+            self.tolerance = float(hdr['tolerance'])
+        else:
+            xy = np.frombuffer(self.mm, dtype='<f4', count=2)
+            self.nx = int(xy[0])
+            self.ny = int(xy[1])
+            self.fields = ["h"]
+            frame_bytes = 4 * self.nx * self.ny
+            nframes = (len(self.mm) - 8) // frame_bytes
+            self.offsets = [8 + k*frame_bytes for k in range(nframes)]
+            self.times = np.arange(nframes, dtype=float)
+            self.codec = 0
+            self.tolerance = 0.0
+        self._cached = None   # (frame, words) of the last decoded frame
+
+    def __len__(self):
+        return len(self.offsets)
+
+    def __getitem__(self, k):
+        """All stored fields of frame k, as an array (field, y, x)."""
+        if self.codec:
+            return self._decode(k)
+        n = len(self.fields) * self.ny * self.nx
+        return np.frombuffer(self.mm, dtype='<f4', count=n,
+                             offset=self.offsets[k]).reshape(
+                                 len(self.fields), self.ny, self.nx)
+
+    def field(self, k, name="h"):
+        """One field of frame k, as an array (y, x)."""
+        return self[k][self.fields.index(name)]
+
+    # Compressed frames (see meshio.h for the encoding)
+
+    def _quantized(self, f, flags):
+        return (f == 0 and self.fields[0] == "h" and self.tolerance > 0
+                and not flags & 2)
+
+    def _frame_info(self, k):
+        off = self.offsets[k]
+        flags, nfields = np.frombuffer(self.mm, dtype='<u4', count=2, offset=off)
+        sizes = np.frombuffer(self.mm, dtype='<u8', count=int(nfields), offset=off+8)
+        return int(flags), [int(size) for size in sizes], off + 8 + 8*int(nfields)
+
+    def _decode_words(self, k, prev):
+        flags, sizes, pos = self._frame_info(k)
+        key = flags & 1
+        n = self.nx * self.ny
+        words = []
+        for f, size in enumerate(sizes):
+            planes = np.frombuffer(zlib.decompress(self.mm[pos:pos+size]),
+                                   dtype=np.uint8).reshape(4, n).astype(np.uint32)
+            pos += size
+            resid = planes[0] | (planes[1] << 8) | (planes[2] << 16) | (planes[3] << 24)
+            if self._quantized(f, flags):
+                w = np.cumsum(resid, dtype=np.uint32) if key else prev[f] + resid
+            else:
+                w = np.bitwise_xor.accumulate(resid) if key else prev[f] ^ resid
+            words.append(w)
+        return words
+
+    def _decode(self, k):
+        start = k
+        while not self._frame_info(start)[0] & 1:
+            start -= 1
+        words = None
+        if self._cached is not None and start <= self._cached[0] < k:
+            start, words = self._cached[0] + 1, self._cached[1]
+        for j in range(start, k+1):
+            words = self._decode_words(j, words)
+        self._cached = (k, words)
+        flags = self._frame_info(k)[0]
+
+        frame = np.empty((len(self.fields), self.ny, self.nx), dtype=np.float32)
+        for f, w in enumerate(words):
+            if self._quantized(f, flags):
+                values = w.view('<i4') * (2*self.tolerance)
+            else:
+                values = w.view('<f4')
+            frame[f] = values.reshape(self.ny, self.nx)
+        return frame
 
 
 def main(infile="waves.out", outfile="out.mp4", startpic="start.png"):
@@ -25,15 +149,13 @@ def main(infile="waves.out", outfile="out.mp4", startpic="start.png"):
         startpic: Name of picture generated at first frame
     """
 
-    u = np.fromfile(infile, dtype=np.dtype('f4'))
-    nx = int(u[0])
-    ny = int(u[1])
+    u = ShallowOutput(infile)
+    nx = u.nx
+    ny = u.ny
     x = range(0,nx)
     y = range(0,ny)
-    u = u[2:]
-    nframe = len(u) // (nx*ny)
+    nframe = len(u)
     stride = nx // 20
-    u = np.reshape(u, (nframe,nx,ny))
     X, Y = np.meshgrid(x,y)
 
     fig = plt.figure(figsize=(10,10))
@@ -41,7 +163,7 @@ def main(infile="waves.out", outfile="out.mp4", startpic="start.png"):
     def plot_frame(i, stride=5):
         ax = fig.add_subplot(111, projection='3d')
         ax.set_zlim(0, 2)
-        Z = u[i,:,:];
+        Z = u.field(i, "h")
         ax.plot_surface(X, Y, Z, rstride=stride, cstride=stride)
         return ax
 